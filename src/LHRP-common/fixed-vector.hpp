@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include <initializer_list>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+
+using namespace std;
+
+// vector-like container with inline storage, never allocates; elements
+// beyond the capacity N are dropped and set `truncated` until the contents
+// are replaced (assign, resize, clear), so a cut-off copy can be refused
+template <typename T, size_t N>
+struct FixedVector
+{
+    typedef T value_type;
+
+    T items[N];
+    uint16_t count = 0;
+    bool truncated = false;
+
+    FixedVector() {}
+
+    FixedVector(std::initializer_list<T> init)
+    {
+        assign(init.begin(), init.end());
+    }
+
+    FixedVector(const vector<T> &v)
+    {
+        assign(v.data(), v.data() + v.size());
+    }
+
+    FixedVector(size_t n, const T &value)
+    {
+        resize(n, value);
+    }
+
+    FixedVector(const FixedVector &o)
+    {
+        assign(o.begin(), o.end());
+        truncated = o.truncated;
+    }
+
+    FixedVector &operator=(const FixedVector &o)
+    {
+        assign(o.begin(), o.end());
+        truncated = o.truncated;
+        return *this;
+    }
+
+    // false if [first, last) did not fit
+    bool assign(const T *first, const T *last)
+    {
+        count = min((size_t)(last - first), N);
+        memcpy(items, first, count * sizeof(T));
+        truncated = (size_t)(last - first) > N;
+        return !truncated;
+    }
+
+    size_t size() const { return count; }
+    static constexpr size_t capacity() { return N; }
+    bool empty() const { return count == 0; }
+    bool full() const { return count == N; }
+
+    T *data() { return items; }
+    const T *data() const { return items; }
+    T *begin() { return items; }
+    T *end() { return items + count; }
+    const T *begin() const { return items; }
+    const T *end() const { return items + count; }
+
+    T &operator[](size_t i) { return items[i]; }
+    const T &operator[](size_t i) const { return items[i]; }
+
+    // false if full, v is dropped
+    bool push_back(const T &v)
+    {
+        if (count == N)
+        {
+            truncated = true;
+            return false;
+        }
+        items[count++] = v;
+        return true;
+    }
+
+    // false if n is above the capacity, the size is N then
+    bool resize(size_t n, const T &value = T())
+    {
+        truncated = n > N;
+        n = min(n, N);
+        for (size_t i = count; i < n; i++)
+            items[i] = value;
+        count = n;
+        return !truncated;
+    }
+
+    void clear()
+    {
+        count = 0;
+        truncated = false;
+    }
+};
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+/* ============================================================
+   Compiled routing table (prefix trie over all connection addresses)
+   ============================================================ */
+#define LHRP_NO_CONNECTION 0xFFFF
+#define LHRP_NO_EDGE 0xFFFFFFFF
+
+struct RouteCandidate
+{
+    uint16_t conn = LHRP_NO_CONNECTION; // index into Node::connections
+    uint16_t len = 0;                   // length of the connection address
+
+    bool valid() const { return conn != LHRP_NO_CONNECTION; }
+
+    // same prefix depth: shorter address has the higher matchIndex, then the earlier connection wins
+    bool betterThan(const RouteCandidate &o) const
+    {
+        if (!valid())
+            return false;
+        if (!o.valid())
+            return true;
+        return len < o.len || (len == o.len && conn < o.conn);
+    }
+};
+
+template <typename Key>
+struct RouteTrieEdge
+{
+    Key key;
+    uint32_t child;
+};
+
+struct RouteTrieNode
+{
+    uint32_t firstEdge = 0;
+    uint16_t edgeCount = 0;
+    int32_t bestBranch = -1; // key of the child holding best, -1 = this node itself
+    RouteCandidate best;     // best connection in this subtree
+    RouteCandidate second;   // best connection outside of bestBranch
+};
+
+// Addr: the stack's address type, its elements are the trie keys;
+// connections: anything with an `address` member (the stack's Connection)
+template <typename Addr>
+struct RouteTrie
+{
+    typedef typename Addr::value_type Key;
+    typedef RouteTrieEdge<Key> Edge;
+
+    vector<RouteTrieNode> nodes;
+    vector<Edge> edges; // sorted by key per node
+
+    template <typename Connection>
+    void build(const vector<Connection> &connections)
+    {
+        vector<vector<Edge>> children(1);
+        vector<RouteCandidate> self(1);
+
+        for (size_t i = 0; i < connections.size() && i < LHRP_NO_CONNECTION; i++)
+        {
+            const Addr &a = connections[i].address;
+            uint32_t n = 0;
+
+            for (Key key : a)
+            {
+                uint32_t next = LHRP_NO_EDGE;
+                for (auto &e : children[n])
+                    if (e.key == key)
+                        next = e.child;
+
+                if (next == LHRP_NO_EDGE)
+                {
+                    next = children.size();
+                    children[n].push_back({key, next});
+                    children.emplace_back();
+                    self.emplace_back();
+                }
+                n = next;
+            }
+
+            RouteCandidate c;
+            c.conn = i;
+            c.len = a.size();
+            if (c.betterThan(self[n]))
+                self[n] = c;
+        }
+
+        nodes.assign(children.size(), RouteTrieNode{});
+        edges.clear();
+
+        for (size_t n = 0; n < children.size(); n++)
+        {
+            sort(children[n].begin(), children[n].end(),
+                 [](const Edge &a, const Edge &b)
+                 { return a.key < b.key; });
+
+            nodes[n].firstEdge = edges.size();
+            nodes[n].edgeCount = children[n].size();
+            edges.insert(edges.end(), children[n].begin(), children[n].end());
+        }
+
+        // children are always created after their parent -> reverse order is bottom-up
+        for (size_t n = nodes.size(); n-- > 0;)
+        {
+            RouteTrieNode &node = nodes[n];
+            node.best = self[n];
+            node.bestBranch = -1;
+
+            for (uint32_t e = node.firstEdge; e < node.firstEdge + node.edgeCount; e++)
+            {
+                const RouteCandidate &c = nodes[edges[e].child].best;
+                if (c.betterThan(node.best))
+                {
+                    node.best = c;
+                    node.bestBranch = edges[e].key;
+                }
+            }
+
+            node.second = node.bestBranch == -1 ? RouteCandidate{} : self[n];
+            for (uint32_t e = node.firstEdge; e < node.firstEdge + node.edgeCount; e++)
+            {
+                const RouteCandidate &c = nodes[edges[e].child].best;
+                if (edges[e].key != node.bestBranch && c.betterThan(node.second))
+                    node.second = c;
+            }
+        }
+    }
+
+    uint32_t findChild(const RouteTrieNode &node, Key key) const
+    {
+        const Edge *first = edges.data() + node.firstEdge;
+        const Edge *last = first + node.edgeCount;
+        const Edge *it = lower_bound(first, last, key,
+                                              [](const Edge &e, Key k)
+                                              { return e.key < k; });
+        return (it != last && it->key == key) ? it->child : LHRP_NO_EDGE;
+    }
+
+    // same ordering as the linear scan: highest matchIndex, then longest address, then first connection
+    static void consider(const RouteCandidate &c, size_t depth, RouteCandidate &best, int &bestIdx)
+    {
+        if (!c.valid())
+            return;
+
+        int idx = 2 * (int)depth - (int)c.len;
+        if (!best.valid() || idx > bestIdx ||
+            (idx == bestIdx && (c.len > best.len || (c.len == best.len && c.conn < best.conn))))
+        {
+            best = c;
+            bestIdx = idx;
+        }
+    }
+
+    bool lookup(const Addr &dest, RouteCandidate &best, int &bestIdx) const
+    {
+        best = RouteCandidate{};
+        bestIdx = 0;
+        if (nodes.empty())
+            return false;
+
+        uint32_t n = 0;
+        size_t depth = 0;
+
+        for (; depth < dest.size(); depth++)
+        {
+            const RouteTrieNode &node = nodes[n];
+
+            // everything branching off here shares exactly `depth` bytes with dest
+            consider(node.bestBranch == dest[depth] ? node.second : node.best, depth, best, bestIdx);
+
+            n = findChild(node, dest[depth]);
+            if (n == LHRP_NO_EDGE)
+                return best.valid();
+        }
+
+        consider(nodes[n].best, depth, best, bestIdx);
+        return best.valid();
+    }
+};
@@ -1,45 +1,37 @@
 #include "LHRP.hpp"
 
-#include <WiFi.h>
-#include <esp_wifi.h>
-#include <esp_now.h>
-#include <Preferences.h>
-
-LHRP_Node_Secure *LHRP_Node_Secure::instance = nullptr;
-unordered_map<string, LHRP_Node_Secure::PeerState> LHRP_Node_Secure::peerStates;
-
 // ------------------------
 inline uint8_t netIdToChannel(uint8_t netId)
 {
     return (netId * 7 % 13) + 1;
 }
 
-static string uint8ArrayToHex(const uint8_t *arr, size_t len)
+// ------------------------
+LHRP_Node_Secure::LHRP_Node_Secure(uint8_t netId, const array<uint8_t, 16> &key, initializer_list<LHRP_Peer> list)
+    : LHRP_Node_Secure(netId, key, vector<LHRP_Peer>(list))
 {
-    static const char hexDigits[] = "0123456789ABCDEF";
-    string s;
-    s.reserve(len * 2);
-    for (size_t i = 0; i < len; i++)
-    {
-        uint8_t v = arr[i];
-        s.push_back(hexDigits[(v >> 4) & 0xF]);
-        s.push_back(hexDigits[v & 0xF]);
-    }
-    return s;
 }
 
-string LHRP_Node_Secure::macToHexKey(const uint8_t *mac, const char *prefix)
+static vector<LHRP_Peer> topologyPeers(const TopologyTable &table)
 {
-    string machex = uint8ArrayToHex(mac, 6);
-    string key = prefix;
-    key += machex;
-    return key;
+    vector<LHRP_Peer> list;
+    list.reserve(table.peerCount + 1);
+    list.push_back({table.self.mac, table.self.address.toAddress()});
+    for (size_t i = 0; i < table.peerCount; i++)
+        list.push_back({table.peers[i].mac, table.peers[i].address.toAddress()});
+    return list;
 }
 
-// ------------------------
-LHRP_Node_Secure::LHRP_Node_Secure(uint8_t netId, const array<uint8_t, 16> &key, initializer_list<LHRP_Peer> list)
+LHRP_Node_Secure::LHRP_Node_Secure(uint8_t netId, const array<uint8_t, 16> &key, const TopologyTable &table)
+    : LHRP_Node_Secure(netId, key, topologyPeers(table))
+{
+}
+
+LHRP_Node_Secure::LHRP_Node_Secure(uint8_t netId, const array<uint8_t, 16> &key, const vector<LHRP_Peer> &list)
 {
-    instance = this;
+#ifdef ARDUINO
+    radio = &EspNowRadio::get();
+#endif
     this->netId = netId;
     this->key = key;
 
@@ -50,36 +42,120 @@ LHRP_Node_Secure::LHRP_Node_Secure(uint8_t netId, const array<uint8_t, 16> &key,
     {
         if (first)
         {
-            node.you = p.address;
+            node.setYou(p.address);
             ownMac = p.mac;
             first = false;
         }
         else
         {
-            node.connections.push_back({.address = p.address, .pin = ++pin});
+            node.addConnection({.address = p.address, .pin = ++pin});
             peers.push_back(p);
         }
     }
+
+    node.compile();
+
+    peerStates.resize(peers.size());
+    neighbors.resize(peers.size());
+    txCounts = vector<atomic<uint32_t>>(peers.size());
+    counters.peers = vector<LHRP_PeerMetrics>(peers.size());
+    flushScratch.reserve(peers.size());
+    for (size_t i = 0; i < peers.size(); i++)
+        macIndex.push_back({peers[i].mac, (uint8_t)i});
+
+    sort(macIndex.begin(), macIndex.end(), [](const MacIndexEntry &a, const MacIndexEntry &b)
+         { return a.mac < b.mac; });
+}
+
+LHRP_Node_Secure::~LHRP_Node_Secure()
+{
+    batchWorker.stop();
+    linkWorker.stop();
+    beaconWorker.stop();
+    reassemblyWorker.stop();
+    if (pipeline)
+    {
+        pipeline->rxWorker.stop();
+        pipeline->txWorker.stop();
+    }
+
+    flushWorker.stop();
+    flush();
+}
+
+void LHRP_Node_Secure::useRadio(Radio &radio)
+{
+    this->radio = &radio;
 }
 
 bool LHRP_Node_Secure::begin()
 {
-    WiFi.mode(WIFI_STA);
-    esp_wifi_set_channel(netIdToChannel(netId), WIFI_SECOND_CHAN_NONE);
+    if (!radio)
+        return false;
 
-    if (esp_now_init() != ESP_OK)
+    if (!gcm.setKey(key))
         return false;
 
-    esp_now_register_recv_cb(onReceiveStatic);
+    radio->useRssi(beaconIntervalMs || weightedRoutes);
+    if (!radio->begin(netIdToChannel(netId), onRadioReceive, onRadioSent, this))
+        return false;
 
-    prefs.begin("lhrp", false);
+    if (!store.begin("lhrp"))
+        return false;
 
-    for (auto &p : peers)
+    uint16_t msgId;
+    platformRandom(&msgId, sizeof(msgId));
+    nextMsgId = msgId; // message ids must not repeat right after a reboot
+
+    {
+        lock_guard<mutex> guard(stateLock);
+        lock_guard<mutex> storeGuard(storeLock);
+
+        // s_ holds the end of the last lease: every seq up to it may have been used
+        for (size_t i = 0; i < peers.size(); i++)
+        {
+            PeerState &state = peerStates[i];
+            macToNvsKey(state.recvKey, 'r', peers[i].mac.data());
+            macToNvsKey(state.sendKey, 's', peers[i].mac.data());
+            state.replay.reset(store.get(state.recvKey, 0));
+            state.lastSendSeq = store.get(state.sendKey, 0);
+            state.sendLease = state.lastSendSeq + LHRP_SEQ_LEASE;
+            store.put(state.sendKey, state.sendLease);
+        }
+
+        if (!store.commit())
+            return false;
+    }
+
+    flushWorker.start("lhrp-nvs", flushStage, this, LHRP_FLUSH_INTERVAL_MS);
+
+    if (pipeline)
+    {
+        if (!pipeline->rxWorker.start("lhrp-rx", rxStage, this, LHRP_WAIT_FOREVER, pipeline->core, 4096, 3) ||
+            !pipeline->txWorker.start("lhrp-tx", txStage, this, LHRP_WAIT_FOREVER, pipeline->core, 4096, 3))
+            return false;
+    }
+
+    if (!links.empty() && !linkWorker.start("lhrp-link", linkStage, this, LHRP_ACK_DELAY_MS))
+        return false;
+
+    if (beaconIntervalMs)
     {
-        string macKey = uint8ArrayToHex(p.mac.data(), 6);
-        peerStates[macKey].lastSeenSeq = prefs.getUInt(("r_" + macKey).c_str(), 0);
-        peerStates[macKey].lastSendSeq = prefs.getUInt(("s_" + macKey).c_str(), 0);
-        peerStates[macKey].lastFlushTime = millis();
+        {
+            lock_guard<mutex> guard(neighborLock);
+            uint32_t now = platformMillis();
+            for (auto &n : neighbors)
+            {
+                n.lastHeard = now; // grace period before the first beacon
+                n.lastBeaconAt = now - beaconIntervalMs;
+            }
+            beaconBudget.reset(beaconBudget.bytesPerSec, now);
+        }
+
+        // spread the beacons over the interval instead of one burst per round
+        uint32_t period = max<uint32_t>(10, beaconIntervalMs / max<size_t>(peers.size(), 1));
+        if (!beaconWorker.start("lhrp-beacon", beaconStage, this, min(period, beaconIntervalMs)))
+            return false;
     }
 
     bool allPeersAdded = true;
@@ -92,101 +168,1262 @@ bool LHRP_Node_Secure::begin()
     return allPeersAdded;
 }
 
-bool LHRP_Node_Secure::addPeer(const array<uint8_t, 6> &mac)
+bool LHRP_Node_Secure::setKey(const array<uint8_t, 16> &key)
 {
-    esp_now_peer_info_t peer{};
-    memcpy(peer.peer_addr, mac.data(), 6);
-    peer.channel = netIdToChannel(netId);
-    peer.encrypt = false;
+    this->key = key;
+    return gcm.setKey(key);
+}
 
-    return esp_now_add_peer(&peer) == ESP_OK;
+bool LHRP_Node_Secure::addPeer(const array<uint8_t, 6> &mac)
+{
+    return radio->addPeer(mac.data(), netIdToChannel(netId));
 }
 
 // ------------------------
-uint32_t LHRP_Node_Secure::getNextSendSeq(const array<uint8_t, 6> &mac)
+int LHRP_Node_Secure::findPeer(const uint8_t *mac) const
+{
+    auto it = lower_bound(macIndex.begin(), macIndex.end(), mac, [](const MacIndexEntry &e, const uint8_t *m)
+                          { return memcmp(e.mac.data(), m, 6) < 0; });
+
+    if (it == macIndex.end() || memcmp(it->mac.data(), mac, 6) != 0)
+        return -1;
+
+    return it->peer;
+}
+
+uint32_t LHRP_Node_Secure::getNextSendSeq(PeerState &state)
+{
+    lock_guard<mutex> guard(stateLock);
+    uint32_t seq = ++state.lastSendSeq;
+
+    // lease used up before the background task extended it:
+    // reserve synchronously, a seq must never be reused after a reboot
+    if ((int32_t)(seq - state.sendLease) > 0)
+    {
+        lock_guard<mutex> storeGuard(storeLock);
+        state.sendLease = seq + LHRP_SEQ_LEASE;
+        store.put(state.sendKey, state.sendLease);
+        store.commit();
+    }
+    else if (!state.leaseLow && state.sendLease - seq < LHRP_SEQ_LEASE / 2)
+    {
+        state.leaseLow = true;
+        flushWorker.notify();
+    }
+
+    return seq;
+}
+
+// the seq getNextSendSeq() hands out next, without taking it
+uint32_t LHRP_Node_Secure::nextSendSeq(uint8_t peer)
 {
-    string macKey = uint8ArrayToHex(mac.data(), 6);
-    auto &state = peerStates[macKey];
-    state.lastSendSeq++;
-    return state.lastSendSeq;
+    lock_guard<mutex> guard(stateLock);
+    return peerStates[peer].lastSendSeq + 1;
 }
 
-void LHRP_Node_Secure::maybeFlushToNVS(const string &macKey, PeerState &state)
+// ------------------------
+void LHRP_Node_Secure::flush()
 {
-    uint32_t now = millis();
-    if (now - state.lastFlushTime < 10000)
-        return; // nur alle 10 Sekunden
+    lock_guard<mutex> flushGuard(flushLock);
+    flushScratch.clear();
+
+    {
+        lock_guard<mutex> guard(stateLock);
+        for (size_t i = 0; i < peerStates.size(); i++)
+        {
+            PeerState &state = peerStates[i];
+            if (!state.seenDirty && !state.leaseLow)
+                continue;
+
+            uint32_t lease = laterSeq(state.lastSendSeq + LHRP_SEQ_LEASE, state.sendLease);
+            flushScratch.push_back({(uint8_t)i, state.replay.top, lease});
+            state.seenDirty = false;
+            state.leaseLow = false;
+        }
+    }
+
+    if (flushScratch.empty())
+        return;
+
+    bool ok;
+    {
+        lock_guard<mutex> storeGuard(storeLock);
+        for (auto &f : flushScratch)
+        {
+            // getNextSendSeq() may have committed a higher lease since the snapshot;
+            // sendLease is only written under storeLock or by flush() (flushLock)
+            f.sendLease = laterSeq(f.sendLease, peerStates[f.peer].sendLease);
+
+            store.put(peerStates[f.peer].recvKey, f.lastSeenSeq);
+            store.put(peerStates[f.peer].sendKey, f.sendLease);
+        }
+        ok = store.commit(); // one commit for all peers
+    }
+
+    lock_guard<mutex> guard(stateLock);
+    for (auto &f : flushScratch)
+    {
+        PeerState &state = peerStates[f.peer];
+        if (!ok)
+        {
+            state.seenDirty = true;
+            continue;
+        }
+
+        state.sendLease = laterSeq(f.sendLease, state.sendLease);
+    }
+}
 
-    prefs.putUInt(("r_" + macKey).c_str(), state.lastSeenSeq);
-    prefs.putUInt(("s_" + macKey).c_str(), state.lastSendSeq);
-    state.lastFlushTime = now;
+void LHRP_Node_Secure::flushStage(void *arg)
+{
+    ((LHRP_Node_Secure *)arg)->flush();
 }
 
 // ------------------------
+// set while onPocketReceive / onStreamReceive run: the acks sendMessage() would
+// wait for are processed by the same thread (radio callback or a worker)
+static thread_local bool inCallback = false;
+
+struct CallbackScope
+{
+    bool outer = inCallback;
+    CallbackScope() { inCallback = true; }
+    ~CallbackScope() { inCallback = outer; }
+};
+
 bool LHRP_Node_Secure::send(const Address &dest, const vector<uint8_t> &payload)
 {
-    Pocket p{.destAddress = dest, .srcAddress = node.you, .payload = payload};
+    if ((int)payload.size() > maxPayloadSize(dest))
+        return sendMessage(dest, payload.data(), payload.size());
+
+    Pocket p{.destAddress = dest, .srcAddress = node.you(), .payload = payload};
+    return send(p);
+}
+
+bool LHRP_Node_Secure::sendMessage(const Address &dest, const uint8_t *data, size_t len)
+{
+    if (!links.empty() && inCallback)
+        return false; // would block the receive path, see LHRP.hpp
+
+    int chunk = maxPayloadSize(dest) - LHRP_FRAGMENT_HEADER;
+    if (chunk <= 0)
+        return false;
+
+    size_t count = len == 0 ? 1 : (len + chunk - 1) / chunk;
+    if (count > 0xFFFF)
+        return false;
+
+    uint16_t msgId = nextMsgId.fetch_add(1, memory_order_relaxed);
+
+    Pocket p{};
+    p.destAddress = dest;
+    p.srcAddress = node.you();
+    p.flags = LHRP_FLAG_FRAGMENT;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t offset = i * chunk;
+        size_t n = min((size_t)chunk, len - offset);
+
+        p.payload.resize(LHRP_FRAGMENT_HEADER + n);
+        writeFragmentHeader(p.payload.data(), msgId, i, count);
+        memcpy(p.payload.data() + LHRP_FRAGMENT_HEADER, data + offset, n);
+
+        // the receiver can not complete the message any more, the rest would only cost airtime
+        if (!sendFragment(p))
+            return false;
+    }
+
+    return true;
+}
+
+// a message has more fragments than the link window takes: wait for acks
+// instead of failing every fragment behind the first LHRP_LINK_WINDOW
+bool LHRP_Node_Secure::sendFragment(const Pocket &p)
+{
+    uint8_t pin = routes.resolve(node, p.destAddress, p.srcAddress, p.flowId);
+    if (pin == 0 || pin == LHRP_PIN_ERROR)
+        return send(p);
+
+    RawPacket raw;
+    if (!pack(p, raw))
+        return false;
+
+    LinkHolds holds;
+    uint32_t start = platformMillis();
+    for (bool first = true; !holdLink(pin, holds, first); first = false)
+    {
+        if (platformMillis() - start >= LHRP_FRAGMENT_WAIT_MS)
+        {
+            counters.drop(LHRP_DROP_BACKPRESSURE);
+            return false;
+        }
+        platformSleep(1);
+    }
+
+    return transmit(pin, raw, 0, holds.take(pin));
+}
+
+void LHRP_Node_Secure::onStreamReceive(std::function<void(const StreamChunk &)> cb)
+{
+    reassembler.callback = cb;
+    reassembler.begin();
+    reassemblyWorker.start("lhrp-reasm", reassemblyStage, this, LHRP_REASSEMBLY_TIMEOUT_MS / 4);
+}
+
+void LHRP_Node_Secure::reassemblyStage(void *arg)
+{
+    CallbackScope scope; // aborts are reported to the stream callback
+    ((LHRP_Node_Secure *)arg)->reassembler.expire();
+}
+
+bool LHRP_Node_Secure::sendMulticast(const Address &prefix, const vector<uint8_t> &payload)
+{
+    if ((int)payload.size() > maxPayloadSize(prefix))
+        return false;
+
+    Pocket p{.destAddress = prefix, .srcAddress = node.you(), .payload = payload};
+    p.flags = LHRP_FLAG_MULTICAST;
     return send(p);
 }
 
-int LHRP_Node_Secure::maxPayloadSize(const Address &destAddress)
+int LHRP_Node_Secure::maxPayloadSize(const Address &destAddress, bool trace)
 {
-    return maxPayloadSizePocket(node.you, destAddress);
+    return maxPayloadSizePocket(node.you(), destAddress, false, trace);
 }
 
 bool LHRP_Node_Secure::send(const Pocket &p)
 {
-    uint8_t pin = node.send(p);
+    uint32_t since = platformMicros(); // start of our hop for traced pockets
+    RawPacket raw;
+
+    // an address or payload that overflowed its FixedVector is not the pocket the caller built
+    if (p.destAddress.truncated || p.srcAddress.truncated || p.payload.truncated)
+    {
+        counters.drop(LHRP_DROP_TRUNCATED);
+        return false;
+    }
+
+    if (p.flags & LHRP_FLAG_MULTICAST)
+        return pack(p, raw) && multicast(raw, -1, since); // never batched, records carry no flags
+
+    uint8_t pin = routes.resolve(node, p.destAddress, p.srcAddress, p.flowId);
     if (pin == LHRP_PIN_ERROR)
+    {
+        counters.drop(LHRP_DROP_NO_ROUTE);
         return false;
+    }
 
     if (pin == 0)
     {
-        if (rxCallback)
-            rxCallback(p);
+        deliver(p);
         return true;
     }
 
+    if (batchWindowMs && !p.flags && !(p.compress && codec) && !p.trace) // records carry no flags or trace
+        return enqueueBatch(pin, p);
+
+    return pack(p, raw) && transmit(pin, raw, since);
+}
+
+void LHRP_Node_Secure::useCompression(PayloadCodec &codec)
+{
+    this->codec = &codec;
+}
+
+// buildRawPacket() plus the compression stage and our trace record, the frame is the only buffer;
+// false if the payload does not fit, not even packed (flow id and trace area take room too)
+bool LHRP_Node_Secure::pack(const Pocket &p, RawPacket &raw)
+{
+    raw = buildRawPacket(p, netId);
+    size_t room = maxPayloadSizePocket(p.srcAddress, p.destAddress, p.flowId, p.trace);
+    size_t written = min(room, p.payload.size());
+    size_t offset = raw.dataLen - rawTraceSize(raw) - written;
+
+    size_t n = 0;
+    if (p.compress && codec && !p.payload.empty() && !(p.flags & LHRP_FLAG_COMPRESSED))
+    {
+        lock_guard<mutex> guard(codecLock);
+        n = codec->compress(p.payload.data(), p.payload.size(), raw.rawData + offset,
+                            min(room, p.payload.size() - 1)); // must get smaller
+
+        // not smaller: the codec may have left a partial result
+        if (n == 0)
+            memcpy(raw.rawData + offset, p.payload.data(), written);
+    }
+
+    if (n == 0)
+    {
+        if (p.payload.size() > room)
+        {
+            counters.drop(LHRP_DROP_TRUNCATED); // buildRawPacket() cut it, never sent
+            return false;
+        }
+    }
+    else
+    {
+        raw.flags |= LHRP_FLAG_COMPRESSED;
+        raw.dataLen = offset + n;
+        if (p.trace)
+            beginTraceArea(raw);
+    }
+
+    if (p.trace)
+        appendTraceHop(raw, traceNode(), 0);
+    return true;
+}
+
+void LHRP_Node_Secure::deliver(const Pocket &p)
+{
+    if (p.flags & LHRP_FLAG_COMPRESSED)
+    {
+        uint8_t plain[MAX_POCKET_PAYLOAD];
+        size_t n = codec ? codec->decompress(p.payload.data(), p.payload.size(), plain, sizeof(plain)) : 0;
+        if (n == 0)
+        {
+            counters.drop(LHRP_DROP_DECODE); // no codec or not ours
+            return;
+        }
+
+        Pocket q = p;
+        q.payload.assign(plain, plain + n);
+        q.flags &= ~LHRP_FLAG_COMPRESSED;
+        deliver(q);
+        return;
+    }
+
+    CallbackScope scope;
+    if (p.flags & LHRP_FLAG_FRAGMENT)
+    {
+        if (reassembler.receive(p))
+            counters.count(counters.delivered);
+        else
+            counters.drop(LHRP_DROP_FRAGMENT); // a fragment is never handed to onPocketReceive
+        return;
+    }
+
+    counters.count(counters.delivered);
+    if (rxCallback)
+        rxCallback(p);
+}
+
+// seals the plaintext frame for the link to `pin` and sends it
+bool LHRP_Node_Secure::transmit(uint8_t pin, RawPacket &raw, uint32_t since, bool held)
+{
     if (pin - 1 >= peers.size())
         return false;
 
-    const array<uint8_t, 6> &peerMac = peers[pin - 1].mac;
-    uint32_t seq = getNextSendSeq(peerMac);
-    RawPacket raw = serializePocket(p, netId, this->key, seq);
-    esp_err_t err = esp_now_send(peerMac.data(), (uint8_t *)&raw, sizeof(RawPacket));
+    PeerState &state = peerStates[pin - 1];
+
+    bool traced = rawTraced(raw);
+    if (traced)
+        finishTraceHop(raw, platformMicros() - since, traceSealUs.load(memory_order_relaxed));
+
+    if (links.empty())
+    {
+        uint32_t seq = getNextSendSeq(state);
+        if (!seal(raw, seq, traced))
+        {
+            counters.drop(LHRP_DROP_SEND_ERROR);
+            return false;
+        }
+
+        if (!radioSend(pin - 1, raw))
+            return false;
+
+        txCounts[pin - 1].fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+
+    lock_guard<mutex> guard(linkLock);
+    Link &link = links[pin - 1];
+
+    LinkWindow::Slot *slot = link.window.reserve(held, nextSendSeq(pin - 1));
+    if (!slot)
+    {
+        link.stats.windowFull++;
+        counters.drop(LHRP_DROP_BACKPRESSURE);
+        return false;
+    }
+
+    uint32_t seq = getNextSendSeq(state);
+    piggybackAck(pin - 1, raw);
+    if (!seal(raw, seq, traced))
+    {
+        counters.drop(LHRP_DROP_SEND_ERROR);
+        return false;
+    }
+
+    bool queue = (raw.flags & LHRP_FLAG_FRAGMENT) && link.window.fragmentOnAir();
+
+    // tracked even if this send fails, the retransmit timer takes over: sent for
+    // the caller, another send() of the same pocket would arrive twice
+    link.window.track(*slot, raw, seq, platformMillis());
+    link.stats.sent++;
+    txCounts[pin - 1].fetch_add(1, memory_order_relaxed);
+
+    if (queue)
+        slot->queued = true; // sent by sendQueued()
+    else
+        radioSend(pin - 1, raw);
+    return true;
+}
+
+// traced frames carry the seal time of the previous one, theirs is only known afterwards
+bool LHRP_Node_Secure::seal(RawPacket &raw, uint32_t seq, bool traced)
+{
+    if (!traced)
+        return sealRawPacket(raw, gcm, seq);
+
+    uint32_t start = platformMicros();
+    bool ok = sealRawPacket(raw, gcm, seq);
+    traceSealUs.store(platformMicros() - start, memory_order_relaxed);
+    return ok;
+}
 
-    string macKey = uint8ArrayToHex(peerMac.data(), 6);
-    maybeFlushToNVS(macKey, peerStates[macKey]);
+// every frame leaves here: counted for the peer or as LHRP_DROP_SEND_ERROR
+bool LHRP_Node_Secure::radioSend(uint8_t peer, const RawPacket &raw)
+{
+    size_t len = rawPacketSize(raw);
+    if (!radio->send(peers[peer].mac.data(), (const uint8_t *)&raw, len))
+    {
+        counters.drop(LHRP_DROP_SEND_ERROR);
+        return false;
+    }
 
-    return err == ESP_OK;
+    counters.sent(peer, len);
+    return true;
 }
 
 // ------------------------
-void LHRP_Node_Secure::onReceiveStatic(const uint8_t *mac, const uint8_t *data, int len)
+void LHRP_Node_Secure::onRadioReceive(void *arg, const uint8_t *mac, const uint8_t *data, int len, int8_t rssi)
+{
+    ((LHRP_Node_Secure *)arg)->onReceive(mac, data, len, rssi);
+}
+
+void LHRP_Node_Secure::onRadioSent(void *arg, const uint8_t *mac, bool ok)
 {
-    if (instance)
-        instance->onReceive(mac, data, len);
+    LHRP_Node_Secure *self = (LHRP_Node_Secure *)arg;
+    int peer = self->findPeer(mac);
+    if (peer < 0)
+        return;
+
+    lock_guard<mutex> guard(self->neighborLock);
+    self->neighbors[peer].onSent(ok);
 }
 
-void LHRP_Node_Secure::onReceive(const uint8_t *mac, const uint8_t *data, int len)
+void LHRP_Node_Secure::onReceive(const uint8_t *mac, const uint8_t *data, int len, int8_t rssi)
 {
-    if (len != sizeof(RawPacket))
+    uint32_t receivedAt = platformMicros();
+    counters.count(counters.rx);
+
+    if (!rawPacketLengthValid(data, len))
+    {
+        counters.drop(LHRP_DROP_LENGTH);
+        return;
+    }
+
+    if (pipeline)
+    {
+        // radio task: copy and hand over, nothing else
+        RxFrame *f = pipeline->rx.reserve();
+        if (!f)
+        {
+            counters.drop(LHRP_DROP_BACKPRESSURE);
+            return;
+        }
+
+        memcpy(f->mac, mac, 6);
+        f->rssi = rssi;
+        f->receivedAt = receivedAt;
+        memcpy(&f->raw, data, len);
+        pipeline->rx.commit();
+        pipeline->rxWorker.notify();
         return;
+    }
 
+    // the only copy: ESP-NOW owns `data`, everything else works in place
     RawPacket raw;
-    memcpy(&raw, data, sizeof(RawPacket));
-    Pocket p = deserializePocket(raw, netId, key);
-    if (p.errored)
+    memcpy(&raw, data, len);
+    receiveFrame(mac, raw, rssi, receivedAt);
+}
+
+void LHRP_Node_Secure::receiveFrame(const uint8_t *mac, RawPacket &raw, int8_t rssi, uint32_t receivedAt)
+{
+    size_t bytes = rawPacketSize(raw);
+
+    uint32_t openStart = platformMicros();
+    OpenResult opened = openRawPacketChecked(raw, netId, gcm);
+    uint32_t openUs = platformMicros() - openStart;
+
+    switch (opened)
+    {
+    case OPEN_OK:
+        break;
+    case OPEN_NETID:
+        counters.drop(LHRP_DROP_NETID);
+        return;
+    case OPEN_MALFORMED:
+        counters.drop(LHRP_DROP_MALFORMED);
+        return;
+    case OPEN_AUTH:
+        counters.drop(LHRP_DROP_AUTH);
+        return;
+    }
+
+    uint32_t seq = readRawSeq(raw);
+
+    int peer = findPeer(mac);
+    if (peer < 0)
+    {
+        counters.drop(LHRP_DROP_UNKNOWN_PEER); // no replay state for unknown senders
+        return;
+    }
+    counters.received(peer, bytes);
+
+    if (raw.flags & LHRP_FLAG_ACK)
+    {
+        uint32_t ackTop, ackBits;
+        stripAckTrailer(raw, ackTop, ackBits);
+        onAck(peer, ackTop, ackBits); // acks are cumulative, stale ones are harmless
+    }
+
+    bool beacon = raw.flags & LHRP_FLAG_BEACON;
+    bool empty = beacon || rawPacketEmpty(raw); // nothing to pass on or acknowledge
+
+    // the slots are held before the ack goes out, an acknowledged frame must not
+    // find the next hop's window full in transmit() (TX ring, other senders)
+    LinkHolds holds;
+    if (!empty && !links.empty() && !isDuplicate(peer, seq) && !canPassOn(raw, peer, holds))
+    {
+        counters.drop(LHRP_DROP_BACKPRESSURE); // not acknowledged either: the previous hop retransmits it
         return;
+    }
+
+    ReplayResult result;
+    {
+        lock_guard<mutex> guard(stateLock);
+        PeerState &state = peerStates[peer];
+
+        uint32_t top = state.replay.top;
+        result = state.replay.update(seq);
+
+        // a duplicate means our ack got lost: acknowledge again
+        if (!links.empty() && !empty && result != REPLAY_LATE)
+        {
+            if (!state.ackPending)
+            {
+                state.ackPending = true;
+                state.ackPendingSince = platformMillis();
+            }
 
-    string macKey = uint8ArrayToHex(mac, 6);
-    auto &state = peerStates[macKey];
+            // retransmission our acks at replay.top no longer cover (acks and beacons
+            // moved the sender's seqs on): the next ack is anchored at it instead
+            if (state.replay.top - seq >= LHRP_ACK_SPAN)
+            {
+                state.ackBehind = true;
+                state.ackBehindSeq = seq;
+            }
+        }
+
+        switch (result)
+        {
+        case REPLAY_LATE:
+            replayCounters.late++;
+            counters.drop(LHRP_DROP_REPLAY);
+            break;
+        case REPLAY_DUPLICATE:
+            replayCounters.duplicate++;
+            counters.drop(LHRP_DROP_REPLAY);
+            break;
+        case REPLAY_ACCEPTED:
+            replayCounters.accepted++;
+            if (state.replay.top != top)
+                state.seenDirty = true; // written by the background task
+            break;
+        }
+    }
 
-    if ((int32_t)(p.seq - state.lastSeenSeq) <= 0)
+    if (result != REPLAY_ACCEPTED)
+    {
+        releaseHolds(holds); // linkLock comes before stateLock
         return;
+    }
 
-    state.lastSeenSeq = p.seq;
-    maybeFlushToNVS(macKey, state);
+    {
+        // only fresh authenticated frames count, replays must not fake a good link
+        lock_guard<mutex> guard(neighborLock);
+        LinkQuality &n = neighbors[peer];
+        n.onFrame(rssi, platformMillis());
 
-    send(p);
+        uint16_t beaconSeq;
+        uint8_t quality;
+        int8_t peerRssi;
+        if (beacon && readBeacon(raw, beaconSeq, quality, peerRssi))
+            n.onBeacon(beaconSeq, quality, peerRssi);
+    }
+
+    if (empty)
+        return; // ack or beacon only
+
+    if (rawTraced(raw))
+        appendTraceHop(raw, traceNode(), traceMicros(openUs));
+
+    passOn(raw, peer, receivedAt, holds);
+    releaseHolds(holds); // whatever the route did not use (delivered here, route changed)
+}
+
+// a fresh frame from connection `from`: delivered here and/or sent on
+void LHRP_Node_Secure::passOn(RawPacket &raw, int from, uint32_t receivedAt, LinkHolds &holds)
+{
+    if (raw.flags & LHRP_FLAG_BATCH)
+    {
+        relayBatch(raw, receivedAt, holds);
+        return;
+    }
+
+    if (raw.flags & LHRP_FLAG_MULTICAST)
+    {
+        multicast(raw, from, receivedAt, &holds);
+        return;
+    }
+
+    Address dest, src;
+    uint16_t flowId;
+    readRawRoute(raw, dest, src, flowId);
+
+    uint8_t pin = routes.resolve(node, dest, src, flowId);
+    if (pin == LHRP_PIN_ERROR)
+    {
+        counters.drop(LHRP_DROP_NO_ROUTE);
+        return;
+    }
+
+    if (pin == 0)
+    {
+        Pocket p;
+        readRawPocket(raw, p);
+        finishTraceHop(p, platformMicros() - receivedAt);
+        deliver(p);
+        return;
+    }
+
+    // relay: re-seal the same buffer for the next link
+    forward(pin, raw, receivedAt, holds.take(pin));
+}
+
+// split the sub-records; the ones for the same next hop leave as one batch frame again,
+// so a relay needs one window slot per next hop (see canPassOn)
+void LHRP_Node_Secure::relayBatch(const RawPacket &raw, uint32_t receivedAt, LinkHolds &holds)
+{
+    uint8_t pins[sizeof(raw.rawData) / 2]; // a record takes 2 bytes at least
+    size_t count = 0;
+    size_t offset = 4;
+    Pocket p;
+
+    while (readBatchRecord(raw, offset, p))
+    {
+        uint8_t pin = routes.resolve(node, p.destAddress, p.srcAddress);
+        if (pin == 0 || pin == LHRP_PIN_ERROR)
+        {
+            send(p); // delivered here or counted as LHRP_DROP_NO_ROUTE
+            pin = 0;
+        }
+        pins[count++] = pin;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint8_t pin = pins[i];
+        if (pin == 0)
+            continue;
+
+        RawPacket out;
+        beginBatchPacket(out, netId);
+        offset = 4;
+        for (size_t j = 0; readBatchRecord(raw, offset, p); j++)
+            if (pins[j] == pin)
+            {
+                appendBatchRecord(out, p); // fits, it did in `raw`
+                pins[j] = 0;
+            }
+
+        forward(pin, out, receivedAt, holds.take(pin));
+    }
+}
+
+bool LHRP_Node_Secure::forward(uint8_t pin, RawPacket &raw, uint32_t receivedAt, bool held)
+{
+    if (!pipeline)
+    {
+        if (!transmit(pin, raw, receivedAt, held))
+            return false;
+        counters.relayed(receivedAt, platformMicros());
+        return true;
+    }
+
+    TxFrame *f = pipeline->tx.reserve();
+    if (!f)
+    {
+        if (held)
+            releaseHold(pin);
+        counters.drop(LHRP_DROP_BACKPRESSURE);
+        return false;
+    }
+
+    f->pin = pin;
+    f->held = held;
+    f->receivedAt = receivedAt;
+    memcpy(&f->raw, &raw, rawPacketSize(raw));
+    pipeline->tx.commit();
+    pipeline->txWorker.notify();
+    return true;
+}
+
+// one copy per tree neighbour towards the prefix (see Node::multicastTargets),
+// delivered here too if we are under it; `from` = connection it came over, -1 = ours
+// (receivedAt: radio callback, or send() for ours)
+bool LHRP_Node_Secure::multicast(const RawPacket &raw, int from, uint32_t receivedAt, LinkHolds *holds)
+{
+    Address prefix, src;
+    uint16_t flowId;
+    readRawRoute(raw, prefix, src, flowId);
+
+    uint16_t targets[LHRP_MULTICAST_FANOUT];
+    size_t count = node.multicastTargets(prefix, from, targets, LHRP_MULTICAST_FANOUT);
+
+    bool ok = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        RawPacket copy; // transmit() seals in place
+        memcpy(&copy, &raw, rawPacketSize(raw));
+        uint8_t pin = node.connections()[targets[i]].pin;
+        bool held = holds && holds->take(pin);
+        if (!(from < 0 ? transmit(pin, copy, receivedAt) : forward(pin, copy, receivedAt, held)))
+            ok = false;
+    }
+
+    if (node.inPrefix(prefix))
+    {
+        Pocket p;
+        readRawPocket(raw, p);
+        finishTraceHop(p, platformMicros() - receivedAt);
+        deliver(p);
+    }
+
+    return ok;
+}
+
+// ------------------------
+void LHRP_Node_Secure::usePipeline(int core)
+{
+    if (pipeline)
+        return;
+
+    pipeline.reset(new Pipeline());
+    pipeline->core = core;
+}
+
+LHRP_PipelineStats LHRP_Node_Secure::pipelineStats() const
+{
+    LHRP_PipelineStats s{};
+    if (!pipeline)
+        return s;
+
+    s.rxDepth = pipeline->rx.depth();
+    s.rxDrops = pipeline->rx.dropped();
+    s.txDepth = pipeline->tx.depth();
+    s.txDrops = pipeline->tx.dropped();
+    s.processed = pipeline->processed.load(memory_order_relaxed);
+    s.sent = pipeline->sent.load(memory_order_relaxed);
+    return s;
+}
+
+void LHRP_Node_Secure::useEcmp(bool on)
+{
+    routes.setEcmp(on);
+}
+
+uint32_t LHRP_Node_Secure::txCount(uint8_t pin) const
+{
+    if (pin == 0 || pin > txCounts.size())
+        return 0;
+    return txCounts[pin - 1].load(memory_order_relaxed);
+}
+
+size_t LHRP_Node_Secure::metricsSnapshot(uint8_t *out, size_t cap) const
+{
+    return writeMetricsSnapshot(counters, out, cap);
+}
+
+LHRP_ReplayStats LHRP_Node_Secure::replayStats()
+{
+    lock_guard<mutex> guard(stateLock);
+    return replayCounters;
+}
+
+void LHRP_Node_Secure::rxStage(void *arg)
+{
+    LHRP_Node_Secure *self = (LHRP_Node_Secure *)arg;
+    Pipeline &pl = *self->pipeline;
+
+    while (RxFrame *f = pl.rx.peek())
+    {
+        self->receiveFrame(f->mac, f->raw, f->rssi, f->receivedAt);
+        pl.rx.pop();
+        pl.processed.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+void LHRP_Node_Secure::txStage(void *arg)
+{
+    LHRP_Node_Secure *self = (LHRP_Node_Secure *)arg;
+    Pipeline &pl = *self->pipeline;
+
+    while (TxFrame *f = pl.tx.peek())
+    {
+        if (self->transmit(f->pin, f->raw, f->receivedAt, f->held))
+        {
+            pl.sent.fetch_add(1, memory_order_relaxed);
+            self->counters.relayed(f->receivedAt, platformMicros());
+        }
+        pl.tx.pop();
+    }
+}
+
+// ------------------------
+void LHRP_Node_Secure::useReliability()
+{
+    lock_guard<mutex> guard(linkLock);
+    if (links.empty())
+        links.resize(peers.size());
+}
+
+LHRP_LinkStats LHRP_Node_Secure::linkStats(uint8_t pin)
+{
+    lock_guard<mutex> guard(linkLock);
+    if (pin == 0 || pin > links.size())
+        return LHRP_LinkStats{};
+
+    Link &link = links[pin - 1];
+    LHRP_LinkStats s = link.stats;
+    s.inFlight = link.window.inFlight;
+    s.srttMs = link.window.srtt;
+    s.rtoMs = link.window.rto;
+    return s;
+}
+
+// acknowledged again without being passed on: must not be refused for a full window
+bool LHRP_Node_Secure::isDuplicate(uint8_t peer, uint32_t seq)
+{
+    lock_guard<mutex> guard(stateLock);
+    return peerStates[peer].replay.check(seq) == REPLAY_DUPLICATE;
+}
+
+// keeps a window slot of the link to `pin` free for a frame, false if there is none
+// (countFull: as LHRP_LinkStats::windowFull, not while polling)
+bool LHRP_Node_Secure::holdLink(uint8_t pin, LinkHolds &holds, bool countFull)
+{
+    lock_guard<mutex> guard(linkLock);
+    if (pin == 0 || pin > links.size())
+        return true; // delivered here or no route: nothing to hold
+
+    if (holds.count == LHRP_MULTICAST_FANOUT)
+        return false;
+
+    Link &link = links[pin - 1];
+    if (!link.window.hold(nextSendSeq(pin - 1)))
+    {
+        if (countFull)
+            link.stats.windowFull++;
+        return false;
+    }
+
+    holds.pins[holds.count++] = pin;
+    return true;
+}
+
+void LHRP_Node_Secure::releaseHold(uint8_t pin)
+{
+    lock_guard<mutex> guard(linkLock);
+    links[pin - 1].window.unhold();
+}
+
+void LHRP_Node_Secure::releaseHolds(LinkHolds &holds)
+{
+    while (holds.count)
+        releaseHold(holds.pins[--holds.count]);
+}
+
+// with link acks a relay only takes frames it can queue for the next hop:
+// one held slot per next hop, released again if nothing is passed on
+bool LHRP_Node_Secure::canPassOn(const RawPacket &raw, int from, LinkHolds &holds)
+{
+    if (links.empty())
+        return true;
+
+    bool ok = true;
+    if (raw.flags & LHRP_FLAG_MULTICAST)
+    {
+        Address prefix, src;
+        uint16_t flowId;
+        readRawRoute(raw, prefix, src, flowId);
+
+        uint16_t targets[LHRP_MULTICAST_FANOUT];
+        size_t count = node.multicastTargets(prefix, from, targets, LHRP_MULTICAST_FANOUT);
+        for (size_t i = 0; i < count && ok; i++)
+            ok = holdLink(node.connections()[targets[i]].pin, holds);
+    }
+    else if (raw.flags & LHRP_FLAG_BATCH)
+    {
+        // relayBatch() keeps the records for one next hop together
+        size_t offset = 4;
+        Pocket p;
+        while (ok && readBatchRecord(raw, offset, p))
+        {
+            uint8_t pin = routes.resolve(node, p.destAddress, p.srcAddress);
+            if (holds.find(pin) < 0)
+                ok = holdLink(pin, holds);
+        }
+    }
+    else
+    {
+        Address dest, src;
+        uint16_t flowId;
+        readRawRoute(raw, dest, src, flowId);
+        uint8_t pin = routes.resolve(node, dest, src, flowId);
+
+        if (pin == 0 && (raw.flags & LHRP_FLAG_FRAGMENT) && !(raw.flags & LHRP_FLAG_COMPRESSED))
+        {
+            // ours: the link reorders freely, fragments past the reassembly window wait at the previous hop
+            Pocket p;
+            readRawPocket(raw, p);
+            ok = reassembler.fits(p);
+        }
+        else
+            ok = holdLink(pin, holds);
+    }
+
+    if (!ok)
+        releaseHolds(holds);
+    return ok;
+}
+
+// linkLock must be held, raw is still plaintext
+void LHRP_Node_Secure::piggybackAck(uint8_t peer, RawPacket &raw)
+{
+    lock_guard<mutex> guard(stateLock);
+    PeerState &state = peerStates[peer];
+    if (!state.ackPending)
+        return;
+
+    // an anchored ack leaves ackPending set, the newest seqs get the next one
+    uint32_t top = state.ackBehind ? state.ackBehindSeq : state.replay.top;
+    if (appendAckTrailer(raw, top, state.replay.ackBits(top)))
+    {
+        state.ackPending = state.ackBehind;
+        state.ackBehind = false;
+    }
+}
+
+// linkLock must be held
+void LHRP_Node_Secure::sendAck(uint8_t peer)
+{
+    RawPacket raw;
+    beginAckPacket(raw, netId);
+    piggybackAck(peer, raw);
+
+    uint32_t seq = getNextSendSeq(peerStates[peer]);
+    if (!sealRawPacket(raw, gcm, seq))
+        return;
+
+    radioSend(peer, raw);
+    links[peer].stats.acksSent++;
+}
+
+void LHRP_Node_Secure::onAck(uint8_t peer, uint32_t top, uint32_t bits)
+{
+    lock_guard<mutex> guard(linkLock);
+    if (peer >= links.size())
+        return;
+
+    Link &link = links[peer];
+    link.stats.acked += link.window.onAck(top, bits, platformMillis());
+    sendQueued(peer);
+}
+
+// linkLock must be held: the next fragment once the one before it is acked or given up
+void LHRP_Node_Secure::sendQueued(uint8_t peer)
+{
+    if (LinkWindow::Slot *s = links[peer].window.nextQueued(platformMillis()))
+        radioSend(peer, s->raw);
+}
+
+// resends expired frames, sends acks that found nothing to ride on
+void LHRP_Node_Secure::serviceLinks()
+{
+    lock_guard<mutex> guard(linkLock);
+    uint32_t now = platformMillis();
+
+    for (size_t i = 0; i < links.size(); i++)
+    {
+        Link &link = links[i];
+
+        for (auto &s : link.window.slots)
+        {
+            if (!link.window.expired(s, now))
+                continue;
+
+            if (s.retries >= LHRP_MAX_RETRIES)
+            {
+                link.window.release(s);
+                link.stats.expired++;
+                sendQueued(i);
+                continue;
+            }
+
+            // same sealed bytes: the receiver's replay window drops the copy if
+            // the original did arrive and only the ack was lost
+            s.retries++;
+            s.sentAt = now;
+            radioSend(i, s.raw);
+            link.stats.retransmits++;
+        }
+
+        bool ackDue;
+        {
+            lock_guard<mutex> stateGuard(stateLock);
+            PeerState &state = peerStates[i];
+            ackDue = state.ackPending && now - state.ackPendingSince >= LHRP_ACK_DELAY_MS;
+        }
+
+        if (ackDue)
+            sendAck(i);
+    }
+}
+
+void LHRP_Node_Secure::linkStage(void *arg)
+{
+    ((LHRP_Node_Secure *)arg)->serviceLinks();
+}
+
+// ------------------------
+void LHRP_Node_Secure::useBatching(uint32_t windowMs)
+{
+    batchWorker.stop();
+    flushBatches();
+
+    {
+        lock_guard<mutex> guard(batchLock);
+
+        // still waiting for a full link window
+        for (auto &b : batches)
+            for (uint8_t i = 0; i < b.count; i++)
+                counters.drop(LHRP_DROP_BACKPRESSURE);
+
+        batchWindowMs = windowMs;
+        batches.assign(windowMs ? peers.size() : 0, Batch{});
+    }
+
+    if (windowMs)
+        batchWorker.start("lhrp-batch", batchStage, this, max(1u, windowMs / 2));
+}
+
+bool LHRP_Node_Secure::enqueueBatch(uint8_t pin, const Pocket &p)
+{
+    lock_guard<mutex> guard(batchLock);
+    if (pin == 0 || pin > batches.size())
+        return false;
+
+    Batch &b = batches[pin - 1];
+    if (b.count && appendBatchRecord(b.raw, p))
+    {
+        b.count++;
+        return true;
+    }
+
+    // empty or full: start a new batch
+    if (!flushBatch(pin))
+    {
+        counters.drop(LHRP_DROP_BACKPRESSURE); // the full batch still waits for the window
+        return false;
+    }
+    beginBatchPacket(b.raw, netId);
+
+    if (!appendBatchRecord(b.raw, p))
+    {
+        // too large for a sub-record, goes out alone
+        RawPacket raw;
+        return pack(p, raw) && transmit(pin, raw);
+    }
+
+    b.count = 1;
+    b.openedAt = platformMillis();
+    return true;
+}
+
+// batchLock must be held; false if the link window is full, the batch then
+// stays as it is and goes out with a later flush
+bool LHRP_Node_Secure::flushBatch(uint8_t pin)
+{
+    Batch &b = batches[pin - 1];
+    if (!b.count)
+        return true;
+
+    LinkHolds holds;
+    if (!holdLink(pin, holds))
+        return false;
+    bool held = holds.take(pin); // transmit() cannot fail for the window any more
+
+    bool sent;
+    if (b.count == 1)
+    {
+        // nothing to coalesce: send a normal frame without record overhead
+        size_t offset = 4;
+        Pocket p;
+        readBatchRecord(b.raw, offset, p);
+        RawPacket raw = buildRawPacket(p, netId);
+        sent = transmit(pin, raw, 0, held);
+    }
+    else
+        sent = transmit(pin, b.raw, 0, held);
+
+    // sealing or the radio failed: transmit() counted the frame, the other records are lost too
+    if (!sent)
+        for (uint8_t i = 1; i < b.count; i++)
+            counters.drop(LHRP_DROP_SEND_ERROR);
+
+    b.count = 0;
+    return true;
+}
+
+void LHRP_Node_Secure::flushBatches(bool force)
+{
+    lock_guard<mutex> guard(batchLock);
+    uint32_t now = platformMillis();
+
+    for (size_t i = 0; i < batches.size(); i++)
+        if (batches[i].count && (force || now - batches[i].openedAt >= batchWindowMs))
+            flushBatch(i + 1);
+}
+
+void LHRP_Node_Secure::batchStage(void *arg)
+{
+    ((LHRP_Node_Secure *)arg)->flushBatches(false);
+}
+
+// ------------------------
+void LHRP_Node_Secure::useBeacons(uint32_t intervalMs, uint32_t budgetBytesPerSec)
+{
+    lock_guard<mutex> guard(neighborLock);
+    beaconIntervalMs = intervalMs;
+    beaconBudget.bytesPerSec = budgetBytesPerSec;
+}
+
+void LHRP_Node_Secure::useRoutePolicy(const RoutePolicy &policy)
+{
+    bool rssi;
+    {
+        lock_guard<mutex> guard(neighborLock);
+        weightedRoutes = policy.enabled();
+        lastCosts.clear(); // next updateCosts() hands them over again
+        rssi = beaconIntervalMs || weightedRoutes;
+    }
+
+    if (radio)
+        radio->useRssi(rssi);
+    routes.setPolicy(policy);
+}
+
+LHRP_NeighborStats LHRP_Node_Secure::neighborStats(uint8_t pin)
+{
+    lock_guard<mutex> guard(neighborLock);
+    if (pin == 0 || pin > neighbors.size())
+        return LHRP_NeighborStats{};
+
+    const LinkQuality &n = neighbors[pin - 1];
+    uint32_t now = platformMillis();
+    uint32_t timeout = beaconIntervalMs * LHRP_NEIGHBOR_MISSED;
+
+    LHRP_NeighborStats s{};
+    s.rssi = n.rssi;
+    s.peerRssi = n.peerRssi;
+    s.rxQuality = n.rxQuality;
+    s.txQuality = n.txQuality;
+    s.txSuccess = n.txSuccess;
+    s.alive = n.alive(now, timeout);
+    s.cost = n.cost(now, timeout, LHRP_MIN_RSSI);
+    s.lastHeardMs = now - n.lastHeard;
+    s.beaconsSent = n.beaconsSent;
+    s.beaconsReceived = n.beaconsReceived;
+    s.txOk = n.txOk;
+    s.txFail = n.txFail;
+    return s;
+}
+
+// one beacon per due neighbour, as far as the budget allows (round robin, so
+// a tight budget slows every neighbour's beacons down instead of starving some)
+void LHRP_Node_Secure::sendBeacons()
+{
+    uint32_t frameBytes = RAWPACKET_HEADER_SIZE + 4 + LHRP_BEACON_SIZE;
+
+    for (size_t k = 0; k < peers.size(); k++)
+    {
+        size_t i = (nextBeaconPeer + k) % peers.size();
+        RawPacket raw;
+
+        {
+            lock_guard<mutex> guard(neighborLock);
+            LinkQuality &n = neighbors[i];
+            uint32_t now = platformMillis();
+
+            if (now - n.lastBeaconAt < beaconIntervalMs)
+                continue;
+
+            if (!beaconBudget.take(frameBytes, now))
+            {
+                nextBeaconPeer = i; // first in line next time
+                return;
+            }
+
+            n.lastBeaconAt = now;
+            n.beaconsSent++;
+            buildBeaconPacket(raw, netId, ++n.sentBeaconSeq, n.rxQuality, n.rssi);
+        }
+
+        uint32_t seq = getNextSendSeq(peerStates[i]);
+        if (sealRawPacket(raw, gcm, seq))
+            radioSend(i, raw);
+    }
+
+    nextBeaconPeer = (nextBeaconPeer + 1) % max<size_t>(peers.size(), 1);
+}
+
+// hands changed link costs to the route cache
+void LHRP_Node_Secure::updateCosts()
+{
+    {
+        lock_guard<mutex> guard(neighborLock);
+        if (!weightedRoutes)
+            return;
+
+        uint32_t now = platformMillis();
+        costScratch.resize(neighbors.size());
+        for (size_t i = 0; i < neighbors.size(); i++)
+            costScratch[i] = neighbors[i].cost(now, beaconIntervalMs * LHRP_NEIGHBOR_MISSED, LHRP_MIN_RSSI);
+
+        if (costScratch == lastCosts)
+            return;
+        lastCosts = costScratch;
+    }
+
+    // only this task writes costScratch
+    routes.setCosts(costScratch);
+}
+
+void LHRP_Node_Secure::beaconStage(void *arg)
+{
+    LHRP_Node_Secure *self = (LHRP_Node_Secure *)arg;
+    self->sendBeacons();
+    self->updateCosts();
 }
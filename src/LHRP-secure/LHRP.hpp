@@ -3,16 +3,32 @@
 #include <vector>
 #include <array>
 #include <initializer_list>
-#include <unordered_map>
 #include <functional>
-#include <string>
-
-#include <WiFi.h>
-#include <esp_now.h>
-#include <Preferences.h>
+#include <mutex>
+#include <memory>
 
+#include "platform.hpp"
 #include "protocol.hpp"
 #include "raw-packet.hpp"
+#include "route-cache.hpp"
+#include "seq-store.hpp"
+#include "spsc-ring.hpp"
+#include "worker.hpp"
+#include "reassembly.hpp"
+#include "replay-window.hpp"
+#include "link-window.hpp"
+#include "topology.hpp"
+#include "link-quality.hpp"
+#include "compression.hpp"
+#include "metrics.hpp"
+
+#define LHRP_SEQ_LEASE 1024          // send seqs reserved per NVS write
+#define LHRP_FLUSH_INTERVAL_MS 10000 // write-behind period for received seqs
+
+#define LHRP_RX_RING_SIZE 16 // frames between ESP-NOW callback and worker
+#define LHRP_TX_RING_SIZE 16 // frames between worker and TX stage
+#define LHRP_MULTICAST_FANOUT 20 // copies per multicast frame (ESP-NOW peer limit)
+#define LHRP_FRAGMENT_WAIT_MS 1000 // sendMessage(): longest wait for room in the link window, per fragment
 
 using namespace std;
 
@@ -22,52 +38,329 @@ struct LHRP_Peer
     Address address;
 };
 
+struct LHRP_PipelineStats
+{
+    uint32_t rxDepth;   // frames waiting for the worker
+    uint32_t rxDrops;   // callback found the RX ring full
+    uint32_t txDepth;   // frames waiting for the TX stage
+    uint32_t txDrops;   // worker found the TX ring full
+    uint32_t processed; // frames handled by the worker
+    uint32_t sent;      // frames sent by the TX stage
+};
+
+struct LHRP_LinkStats
+{
+    uint32_t sent;        // frames handed to ESP-NOW for the first time
+    uint32_t retransmits; // frames sent again after their RTO
+    uint32_t acked;       // frames confirmed by the peer
+    uint32_t expired;     // given up after LHRP_MAX_RETRIES
+    uint32_t windowFull;  // send refused, LHRP_LINK_WINDOW frames in flight
+    uint32_t acksSent;    // ack-only frames (nothing to piggyback on)
+    uint32_t inFlight;
+    uint32_t srttMs;      // smoothed round trip, 0 = no sample yet
+    uint32_t rtoMs;
+};
+
+struct LHRP_NeighborStats
+{
+    int8_t rssi;              // dBm of its frames (0 = unknown)
+    int8_t peerRssi;          // dBm of our frames at the neighbour, from its beacons
+    uint8_t rxQuality;        // 0..255 share of its beacons we heard
+    uint8_t txQuality;        // 0..255 share of our beacons it heard
+    uint8_t txSuccess;        // 0..255 share of sends confirmed by the link layer
+    bool alive;               // heard within LHRP_NEIGHBOR_MISSED beacon intervals
+    uint16_t cost;            // ETX in 1/16, LHRP_COST_DEAD if not alive
+    uint32_t lastHeardMs;     // ms since the last authenticated frame
+    uint32_t beaconsSent;
+    uint32_t beaconsReceived;
+    uint32_t txOk;
+    uint32_t txFail;
+};
+
+struct LHRP_ReplayStats
+{
+    uint32_t accepted;  // passed the replay window
+    uint32_t duplicate; // inside the window, seen before
+    uint32_t late;      // older than LHRP_REPLAY_WINDOW
+};
+
 struct LHRP_Node_Secure
 {
 public:
     Node node;
+    RouteCache routes; // hits / misses of the next-hop cache
     array<uint8_t, 6> ownMac;
     array<uint8_t, 16> key;
     uint8_t netId;
+    SeqStore store; // persisted seqs ("lhrp" namespace)
 
     LHRP_Node_Secure(uint8_t netId, const array<uint8_t, 16> &key, std::initializer_list<LHRP_Peer> peers);
+    LHRP_Node_Secure(uint8_t netId, const array<uint8_t, 16> &key, const vector<LHRP_Peer> &peers);
+    LHRP_Node_Secure(uint8_t netId, const array<uint8_t, 16> &key, const TopologyTable &table); // from makeTopology()
+    ~LHRP_Node_Secure();
+
+    // call before begin(), defaults to ESP-NOW on the ESP32 (required on the host)
+    void useRadio(Radio &radio);
+
+    // call before begin(): the ESP-NOW callback only queues frames, decryption /
+    // replay check / routing run in a worker task, sealing and sending in a TX task
+    // (both pinned to `core`, -1 = no affinity)
+    void usePipeline(int core = 1);
+    LHRP_PipelineStats pipelineStats() const;
+
+    // call before begin(): every frame stays in a per-peer window until the next
+    // hop acknowledges it and is resent after an adaptive timeout, acks ride on
+    // reverse traffic (LHRP_FLAG_ACK); send() fails while the window is full
+    void useReliability();
+    LHRP_LinkStats linkStats(uint8_t pin);
+
+    // pockets for the same next hop sent within `windowMs` are packed into one
+    // frame (LHRP_FLAG_BATCH); send() then only queues, 0 turns batching off
+    void useBatching(uint32_t windowMs);
+    void flushBatches(bool force = true);
+
+    // call before begin(): every neighbour gets an authenticated beacon each
+    // `intervalMs`, all beacons together stay below `budgetBytesPerSec`
+    void useBeacons(uint32_t intervalMs = LHRP_BEACON_INTERVAL_MS, uint32_t budgetBytesPerSec = LHRP_BEACON_BUDGET);
+    LHRP_NeighborStats neighborStats(uint8_t pin);
+
+    // lets link costs (from beacons, see useBeacons) break ties or override the prefix choice
+    void useRoutePolicy(const RoutePolicy &policy);
+
+    // equal-cost multipath: connections tied on matchIndex and length share the
+    // load, hashed by src, dest and Pocket::flowId so one flow keeps its path
+    void useEcmp(bool on = true);
+    uint32_t txCount(uint8_t pin) const; // data frames sent to that pin (no retransmits, acks, beacons)
+
+    // call before begin(), same codec on every node: pockets with `compress`
+    // set go out packed (LHRP_FLAG_COMPRESSED) if that makes them smaller,
+    // the destination unpacks them before onPocketReceive
+    void useCompression(PayloadCodec &codec);
 
     bool begin();
-    bool send(const Pocket &p);
-    bool send(const Address &dest, const vector<uint8_t> &payload);
-    int maxPayloadSize(const Address &destAddress);
+    bool setKey(const array<uint8_t, 16> &key); // use this instead of writing `key`
+    bool send(const Pocket &p); // false if the payload does not fit (see maxPayloadSize)
+    bool send(const Address &dest, const vector<uint8_t> &payload); // fragments if too large (see sendMessage)
+
+    // every node under `prefix` (including the node with that address) gets the
+    // pocket, frames only split where the tree branches (LHRP_FLAG_MULTICAST)
+    bool sendMulticast(const Address &prefix, const vector<uint8_t> &payload);
+    int maxPayloadSize(const Address &destAddress, bool trace = false); // trace: room for Pocket::trace
+
+    // splits data into LHRP_FLAG_FRAGMENT pockets, relays forward them one by one;
+    // with useReliability() it blocks while the window to the next hop is full,
+    // so it returns false inside onPocketReceive / onStreamReceive (the acks it
+    // waits for arrive on that thread). Stops at the first fragment that fails.
+    bool sendMessage(const Address &dest, const uint8_t *data, size_t len);
+
+    LHRP_ReplayStats replayStats();
+
+    // always-on counters (rx / tx / forwarded / delivered, drops by reason,
+    // per-peer frames and bytes, receive -> forward latency)
+    const LHRP_Metrics &metrics() const { return counters; }
+    size_t metricsSnapshot(uint8_t *out, size_t cap) const; // see writeMetricsSnapshot, 0 if cap is too small
+
+    // writes all dirty peer states in one commit (normally done by the background task)
+    void flush();
 
     void onPocketReceive(std::function<void(const Pocket &)> cb)
     {
         rxCallback = cb;
     }
 
-    static void onReceiveStatic(const uint8_t *mac, const uint8_t *data, int len);
+    // fragmented messages, handed out in order while they arrive (see Reassembler)
+    void onStreamReceive(std::function<void(const StreamChunk &)> cb);
 
 private:
     // Vollständige PeerState-Struktur im Header
     struct PeerState
     {
-        uint32_t lastSeenSeq = 0;
+        ReplayWindow replay;    // replay.top is the persisted receive seq
         uint32_t lastSendSeq = 0;
-        uint32_t lastFlushTime = 0;
+        uint32_t sendLease = 0; // send seqs up to here are reserved in NVS
+        bool seenDirty = false; // replay.top not yet written
+        bool leaseLow = false;  // background task should extend the lease
+        bool ackPending = false; // received data not yet acknowledged
+        uint32_t ackPendingSince = 0;
+        bool ackBehind = false;  // ackBehindSeq is too old for an ack at replay.top
+        uint32_t ackBehindSeq = 0;
+        char recvKey[16];       // "r_<MACHEX>", built once in begin()
+        char sendKey[16]; // "s_<MACHEX>"
+    };
+
+    struct MacIndexEntry
+    {
+        array<uint8_t, 6> mac;
+        uint8_t peer;
     };
 
-    static std::unordered_map<std::string, PeerState> peerStates;
+    vector<PeerState> peerStates; // indexed like peers (pin - 1)
+    vector<atomic<uint32_t>> txCounts; // indexed like peers
+    LHRP_Metrics counters;
+    atomic<uint32_t> traceSealUs{0}; // last seal of a traced frame, see seal()
+    LHRP_ReplayStats replayCounters{}; // under stateLock
+    vector<MacIndexEntry> macIndex; // sorted by mac, for inbound frames
 
     vector<LHRP_Peer> peers;
-    static LHRP_Node_Secure *instance;
+    Radio *radio = nullptr;
+
+    static void onRadioReceive(void *arg, const uint8_t *mac, const uint8_t *data, int len, int8_t rssi);
+    static void onRadioSent(void *arg, const uint8_t *mac, bool ok);
+    void onReceive(const uint8_t *mac, const uint8_t *data, int len, int8_t rssi);
+    // window slots canPassOn() holds for a received frame until transmit() takes them
+    struct LinkHolds
+    {
+        uint8_t pins[LHRP_MULTICAST_FANOUT]; // one slot each
+        uint8_t count = 0;
+
+        int find(uint8_t pin) const
+        {
+            for (uint8_t i = 0; i < count; i++)
+                if (pins[i] == pin)
+                    return i;
+            return -1;
+        }
 
-    void onReceive(const uint8_t *mac, const uint8_t *data, int len);
+        bool take(uint8_t pin)
+        {
+            int i = find(pin);
+            if (i < 0)
+                return false;
+            pins[i] = pins[--count];
+            return true;
+        }
+    };
+
+    void receiveFrame(const uint8_t *mac, RawPacket &raw, int8_t rssi, uint32_t receivedAt);
+    void passOn(RawPacket &raw, int from, uint32_t receivedAt, LinkHolds &holds);
+    void relayBatch(const RawPacket &raw, uint32_t receivedAt, LinkHolds &holds);
+    bool forward(uint8_t pin, RawPacket &raw, uint32_t receivedAt, bool held = false);
+    bool multicast(const RawPacket &raw, int from, uint32_t receivedAt, LinkHolds *holds = nullptr);
+    bool radioSend(uint8_t peer, const RawPacket &raw);
+    bool pack(const Pocket &p, RawPacket &raw);
+    // since: start of our hop, traced frames only; held: uses a slot holdLink() kept free
+    bool transmit(uint8_t pin, RawPacket &raw, uint32_t since = 0, bool held = false);
+    bool seal(RawPacket &raw, uint32_t seq, bool traced);
+    uint16_t traceNode() const { return (ownMac[4] << 8) | ownMac[5]; } // TraceHop::node
+
+    struct RxFrame
+    {
+        uint8_t mac[6];
+        int8_t rssi;
+        uint32_t receivedAt; // platformMicros() in the radio callback
+        RawPacket raw;
+    };
+
+    struct TxFrame
+    {
+        uint8_t pin;
+        bool held;           // owns a held window slot of the link
+        uint32_t receivedAt; // platformMicros() when the relayed frame came in
+        RawPacket raw;       // opened, sealed by the TX stage
+    };
+
+    struct Pipeline
+    {
+        SpscRing<RxFrame, LHRP_RX_RING_SIZE> rx;
+        SpscRing<TxFrame, LHRP_TX_RING_SIZE> tx;
+        Worker rxWorker;
+        Worker txWorker;
+        atomic<uint32_t> processed{0};
+        atomic<uint32_t> sent{0};
+        int core;
+    };
+
+    unique_ptr<Pipeline> pipeline; // only with usePipeline()
+
+    static void rxStage(void *arg);
+    static void txStage(void *arg);
+
+    int findPeer(const uint8_t *mac) const;
+    uint32_t getNextSendSeq(PeerState &state);
+
+    // lock order: flushLock -> stateLock -> storeLock
+    mutex stateLock;
+    mutex storeLock;
+    mutex flushLock;
+
+    struct PendingFlush
+    {
+        uint8_t peer;
+        uint32_t lastSeenSeq;
+        uint32_t sendLease;
+    };
+    vector<PendingFlush> flushScratch; // preallocated, one entry per peer
+
+    Worker flushWorker;
+    static void flushStage(void *arg);
+
+    struct Batch
+    {
+        RawPacket raw;
+        uint8_t count = 0;
+        uint32_t openedAt = 0;
+    };
 
-    uint32_t getNextSendSeq(const array<uint8_t, 6> &mac);
-    void maybeFlushToNVS(const string &macKey, PeerState &state);
+    vector<Batch> batches; // one per peer, empty = batching off
+    uint32_t batchWindowMs = 0;
+    mutex batchLock; // before stateLock
+    Worker batchWorker;
+
+    bool enqueueBatch(uint8_t pin, const Pocket &p);
+    bool flushBatch(uint8_t pin);
+    static void batchStage(void *arg);
+
+    struct Link
+    {
+        LinkWindow window;
+        LHRP_LinkStats stats{};
+    };
+
+    vector<Link> links; // one per peer, empty = no link acks
+    mutex linkLock;     // before stateLock
+    Worker linkWorker;
+
+    bool holdLink(uint8_t pin, LinkHolds &holds, bool countFull = true);
+    void releaseHold(uint8_t pin);
+    void releaseHolds(LinkHolds &holds);
+    bool isDuplicate(uint8_t peer, uint32_t seq);
+    bool canPassOn(const RawPacket &raw, int from, LinkHolds &holds);
+    void piggybackAck(uint8_t peer, RawPacket &raw);
+    uint32_t nextSendSeq(uint8_t peer);
+    void sendAck(uint8_t peer);
+    void onAck(uint8_t peer, uint32_t top, uint32_t bits);
+    void sendQueued(uint8_t peer);
+    void serviceLinks();
+    static void linkStage(void *arg);
+
+    vector<LinkQuality> neighbors; // indexed like peers
+    vector<uint16_t> costScratch;
+    vector<uint16_t> lastCosts;
+    BeaconBudget beaconBudget;
+    uint32_t beaconIntervalMs = 0; // 0 = no beacons
+    size_t nextBeaconPeer = 0;
+    bool weightedRoutes = false;
+    mutex neighborLock; // leaf, nothing is called while holding it
+    Worker beaconWorker;
+
+    void sendBeacons();
+    void updateCosts();
+    static void beaconStage(void *arg);
+
+    PayloadCodec *codec = nullptr;
+    mutex codecLock; // leaf, compressor state
 
     std::function<void(const Pocket &)> rxCallback;
+    Reassembler reassembler;
+    Worker reassemblyWorker; // aborts idle messages
+    atomic<uint16_t> nextMsgId{0};
 
-    bool addPeer(const array<uint8_t, 6> &mac);
+    bool sendFragment(const Pocket &p);
+    static void reassemblyStage(void *arg);
 
-    Preferences prefs;
+    void deliver(const Pocket &p);
+
+    bool addPeer(const array<uint8_t, 6> &mac);
 
-    static string macToHexKey(const uint8_t *mac, const char *prefix);
+    AesGcm gcm;
 };
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+
+#ifndef LHRP_LZ_HASH_BITS
+#define LHRP_LZ_HASH_BITS 8 // compressor hash table: 2^bits uint16_t
+#endif
+
+#define LHRP_LZ_MIN_MATCH 3
+#define LHRP_LZ_MAX_OFFSET 255 // offsets are one byte, pocket payloads are shorter anyway
+
+using namespace std;
+
+/* ============================================================
+   Payload codec for LHRP_FLAG_COMPRESSED (see useCompression)
+   both sides of a network must use the same codec
+   ============================================================ */
+struct PayloadCodec
+{
+    virtual ~PayloadCodec() {}
+
+    // 0 if the result would not be smaller than len or does not fit into cap;
+    // called under a lock, may keep state between calls
+    virtual size_t compress(const uint8_t *in, size_t len, uint8_t *out, size_t cap) = 0;
+
+    // 0 on malformed input or if the result does not fit into cap;
+    // called concurrently, must not keep state
+    virtual size_t decompress(const uint8_t *in, size_t len, uint8_t *out, size_t cap) = 0;
+};
+
+/* ============================================================
+   LZ77 in LZ4 block style with one-byte offsets:
+     | token (literals << 4 | match - 3) | [+len] | literals | offset | [+len] |
+   a nibble of 15 continues in bytes of 255 until a smaller one;
+   the stream may end after any literals. Compressor state is a
+   512-byte hash table, the decompressor needs nothing
+   ============================================================ */
+struct LzCodec : PayloadCodec
+{
+    size_t compress(const uint8_t *in, size_t len, uint8_t *out, size_t cap) override
+    {
+        if (len <= LHRP_LZ_MIN_MATCH)
+            return 0;
+
+        memset(table, 0, sizeof(table));
+
+        size_t o = 0, i = 0, anchor = 0;
+        while (i + LHRP_LZ_MIN_MATCH <= len)
+        {
+            uint32_t h = hash(in + i);
+            size_t candidate = table[h]; // position + 1
+            table[h] = i + 1;
+
+            if (candidate && i + 1 - candidate <= LHRP_LZ_MAX_OFFSET &&
+                memcmp(in + candidate - 1, in + i, LHRP_LZ_MIN_MATCH) == 0)
+            {
+                size_t from = candidate - 1;
+                size_t match = LHRP_LZ_MIN_MATCH;
+                while (i + match < len && in[from + match] == in[i + match])
+                    match++;
+
+                if (!emit(out, o, cap, in + anchor, i - anchor, i - from, match))
+                    return 0;
+
+                i += match;
+                anchor = i;
+            }
+            else
+                i++;
+        }
+
+        if (anchor < len && !emit(out, o, cap, in + anchor, len - anchor, 0, 0))
+            return 0;
+
+        return o < len ? o : 0;
+    }
+
+    size_t decompress(const uint8_t *in, size_t len, uint8_t *out, size_t cap) override
+    {
+        size_t i = 0, o = 0;
+        while (i < len)
+        {
+            uint8_t token = in[i++];
+
+            size_t literals = token >> 4;
+            if (!readLength(in, len, i, literals) || i + literals > len || o + literals > cap)
+                return 0;
+            memcpy(out + o, in + i, literals);
+            i += literals;
+            o += literals;
+
+            if (i == len)
+                break; // last sequence: literals only
+
+            size_t offset = in[i++];
+            size_t match = token & 0x0F;
+            if (!readLength(in, len, i, match))
+                return 0;
+            match += LHRP_LZ_MIN_MATCH;
+
+            if (offset == 0 || offset > o || o + match > cap)
+                return 0;
+
+            // may overlap (offset < match repeats a pattern)
+            for (size_t k = 0; k < match; k++, o++)
+                out[o] = out[o - offset];
+        }
+        return o;
+    }
+
+private:
+    uint16_t table[1 << LHRP_LZ_HASH_BITS];
+
+    static uint32_t hash(const uint8_t *p)
+    {
+        uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+        return (v * 2654435761u) >> (32 - LHRP_LZ_HASH_BITS);
+    }
+
+    static bool writeLength(uint8_t *out, size_t &o, size_t cap, size_t n)
+    {
+        for (; n >= 255; n -= 255)
+        {
+            if (o >= cap)
+                return false;
+            out[o++] = 255;
+        }
+        if (o >= cap)
+            return false;
+        out[o++] = n;
+        return true;
+    }
+
+    static bool readLength(const uint8_t *in, size_t len, size_t &i, size_t &n)
+    {
+        if (n != 15)
+            return true;
+
+        uint8_t b;
+        do
+        {
+            if (i >= len)
+                return false;
+            b = in[i++];
+            n += b;
+        } while (b == 255);
+        return true;
+    }
+
+    // one sequence, match == 0: literals only (end of the stream)
+    static bool emit(uint8_t *out, size_t &o, size_t cap, const uint8_t *literals, size_t count, size_t offset, size_t match)
+    {
+        size_t m = match ? match - LHRP_LZ_MIN_MATCH : 0;
+        if (o >= cap)
+            return false;
+        out[o++] = (min<size_t>(count, 15) << 4) | min<size_t>(m, 15);
+
+        if (count >= 15 && !writeLength(out, o, cap, count - 15))
+            return false;
+        if (o + count > cap)
+            return false;
+        memcpy(out + o, literals, count);
+        o += count;
+
+        if (!match)
+            return true;
+
+        if (o >= cap)
+            return false;
+        out[o++] = offset;
+        return m < 15 || writeLength(out, o, cap, m - 15);
+    }
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+
+#include "protocol.hpp"
+
+#define LHRP_BEACON_INTERVAL_MS 1000 // per neighbour
+#define LHRP_BEACON_BUDGET 400       // beacon bytes per second, all neighbours together
+#define LHRP_NEIGHBOR_MISSED 4       // beacon intervals without a frame: neighbour is dead
+#define LHRP_MIN_RSSI -85            // dBm, weaker links cost double
+
+using namespace std;
+
+// EWMA with weight 1/8, rounded towards the sample so 0 and 255 are reachable
+inline uint8_t qualityAverage(uint8_t q, uint8_t sample)
+{
+    return sample > q ? (q * 7 + sample + 7) / 8 : (q * 7 + sample) / 8;
+}
+
+/* ============================================================
+   Link quality of one neighbour (ratios 0..255): loss of its
+   beacons, our loss as it reports it, send callback results
+   ============================================================ */
+struct LinkQuality
+{
+    int8_t rssi = 0;         // dBm of its frames, EWMA, 0 = no sample
+    int8_t peerRssi = 0;     // dBm of our frames at the neighbour
+    uint8_t rxQuality = 255; // share of its beacons we heard
+    uint8_t txQuality = 255; // share of our beacons it heard
+    uint8_t txSuccess = 255; // share of sends the link layer confirmed
+    uint32_t lastHeard = 0;  // ms, last authenticated frame
+
+    uint16_t sentBeaconSeq = 0;
+    uint16_t heardBeaconSeq = 0;
+    bool beaconHeard = false;
+    uint32_t lastBeaconAt = 0;
+
+    uint32_t beaconsSent = 0;
+    uint32_t beaconsReceived = 0;
+    uint32_t txOk = 0;
+    uint32_t txFail = 0;
+
+    void onFrame(int8_t sample, uint32_t now)
+    {
+        lastHeard = now;
+        if (sample)
+            rssi = rssi ? (rssi * 7 + sample) / 8 : sample;
+    }
+
+    void onBeacon(uint16_t seq, uint8_t reportedQuality, int8_t reportedRssi)
+    {
+        beaconsReceived++;
+        txQuality = reportedQuality; // averaged by the neighbour
+        peerRssi = reportedRssi;
+
+        if (beaconHeard)
+        {
+            uint16_t gap = seq - heardBeaconSeq;
+            if (gap == 0 || gap > 0x8000)
+                return; // reordered, counted already
+
+            for (uint16_t i = 1; i < gap && i <= 8; i++)
+                rxQuality = qualityAverage(rxQuality, 0);
+        }
+
+        rxQuality = qualityAverage(rxQuality, 255);
+        heardBeaconSeq = seq;
+        beaconHeard = true;
+    }
+
+    void onSent(bool ok)
+    {
+        ok ? txOk++ : txFail++;
+        txSuccess = qualityAverage(txSuccess, ok ? 255 : 0);
+    }
+
+    // timeoutMs = 0: no liveness tracking (beacons off)
+    bool alive(uint32_t now, uint32_t timeoutMs) const
+    {
+        return !timeoutMs || now - lastHeard <= timeoutMs;
+    }
+
+    // expected transmissions (ETX) in 1/16 of a frame
+    uint16_t cost(uint32_t now, uint32_t timeoutMs, int8_t minRssi) const
+    {
+        if (!alive(now, timeoutMs))
+            return LHRP_COST_DEAD;
+
+        // both directions count, the link-layer ack has to come back
+        uint32_t delivery = min<uint32_t>(txQuality * rxQuality / 255, txSuccess);
+        uint32_t c = LHRP_COST_PERFECT * 255 / max<uint32_t>(delivery, 1);
+
+        int8_t weakest = min<int8_t>(rssi ? rssi : 0, peerRssi ? peerRssi : 0);
+        if (weakest && weakest < minRssi)
+            c *= 2;
+
+        return min<uint32_t>(c, LHRP_COST_DEAD - 1);
+    }
+};
+
+// token bucket: `bytesPerSec` on average, never more than one second's worth at once
+struct BeaconBudget
+{
+    uint32_t bytesPerSec = LHRP_BEACON_BUDGET;
+    uint64_t tokens = 0; // in 1/1000 byte
+    uint32_t refilledAt = 0;
+
+    void reset(uint32_t rate, uint32_t now)
+    {
+        bytesPerSec = rate;
+        tokens = 0;
+        refilledAt = now;
+    }
+
+    bool take(uint32_t bytes, uint32_t now)
+    {
+        tokens = min<uint64_t>(tokens + (uint64_t)(now - refilledAt) * bytesPerSec, (uint64_t)bytesPerSec * 1000);
+        refilledAt = now;
+
+        if (tokens < (uint64_t)bytes * 1000)
+            return false;
+
+        tokens -= (uint64_t)bytes * 1000;
+        return true;
+    }
+};
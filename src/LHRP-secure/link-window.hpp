@@ -0,0 +1,190 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+#include "raw-packet.hpp"
+
+#define LHRP_LINK_WINDOW 8        // unacknowledged frames per next hop
+#define LHRP_RTO_INITIAL_MS 50    // before the first RTT sample
+#define LHRP_RTO_MIN_MS 10
+#define LHRP_RTO_MAX_MS 1000
+#define LHRP_MAX_RETRIES 5        // then the frame is given up
+#define LHRP_ACK_DELAY_MS 5       // wait this long for traffic to piggyback on
+#define LHRP_ACK_SPAN 32          // seqs one ack covers (top + 32-bit bitmap)
+
+static_assert(LHRP_LINK_WINDOW < LHRP_ACK_SPAN, "acks only cover the 32 newest seqs");
+
+using namespace std;
+
+// true if `seq` is covered by an ack (top + bitmap, bit i = top - i)
+inline bool ackCovers(uint32_t top, uint32_t bits, uint32_t seq)
+{
+    uint32_t behind = top - seq;
+    if ((int32_t)behind < 0 || behind >= LHRP_ACK_SPAN)
+        return false;
+    return (bits >> behind) & 1;
+}
+
+/* ============================================================
+   Sender side of one link: sealed frames waiting for their ack,
+   RTO after RFC 6298 (Karn: no samples from retransmissions)
+   ============================================================ */
+struct LinkWindow
+{
+    struct Slot
+    {
+        RawPacket raw; // sealed, resent as is
+        uint32_t seq = 0;
+        uint32_t sentAt = 0;
+        uint32_t firstSentAt = 0;
+        uint8_t retries = 0;
+        bool used = false;
+        bool queued = false; // sealed, not sent yet: waits for the fragment before it
+    };
+
+    Slot slots[LHRP_LINK_WINDOW];
+    uint8_t inFlight = 0;
+    uint8_t held = 0; // free slots promised to frames we acknowledged but have not sealed yet
+
+    uint32_t srtt = 0;   // ms, 0 = no sample yet
+    uint32_t rttvar = 0; // ms
+    uint32_t rto = LHRP_RTO_INITIAL_MS;
+
+    // true if the frame sealed with `next` (and every held one after it) would be
+    // LHRP_ACK_SPAN seqs or more ahead of an unacked frame: no ack could cover both
+    bool spanFull(uint32_t next) const
+    {
+        for (auto &s : slots)
+            if (s.used && next + held - s.seq >= LHRP_ACK_SPAN)
+                return true;
+        return false;
+    }
+
+    // keeps a slot free until reserve(true) or unhold(), `next`: the link's next send seq
+    bool hold(uint32_t next)
+    {
+        if (inFlight + held >= LHRP_LINK_WINDOW || spanFull(next))
+            return false;
+        held++;
+        return true;
+    }
+
+    void unhold()
+    {
+        held--;
+    }
+
+    // fromHold: takes a slot hold() kept free, otherwise only the ones nobody holds
+    Slot *reserve(bool fromHold, uint32_t next)
+    {
+        if (fromHold)
+            held--;
+        else if (inFlight + held >= LHRP_LINK_WINDOW || spanFull(next))
+            return nullptr;
+
+        for (auto &s : slots)
+            if (!s.used)
+                return &s;
+        return nullptr;
+    }
+
+    void track(Slot &s, const RawPacket &sealed, uint32_t seq, uint32_t now)
+    {
+        memcpy(&s.raw, &sealed, rawPacketSize(sealed));
+        s.seq = seq;
+        s.sentAt = now;
+        s.firstSentAt = now;
+        s.retries = 0;
+        s.used = true;
+        s.queued = false;
+        inFlight++;
+    }
+
+    // fragments go out one at a time: a retransmitted fragment cannot be overtaken
+    // by the ones behind it, the reassembly window only has to absorb route changes
+    bool fragmentOnAir() const
+    {
+        for (auto &s : slots)
+            if (s.used && !s.queued && (s.raw.flags & LHRP_FLAG_FRAGMENT))
+                return true;
+        return false;
+    }
+
+    // the oldest queued fragment if none is on air any more, marked as sent at `now`
+    Slot *nextQueued(uint32_t now)
+    {
+        if (fragmentOnAir())
+            return nullptr;
+
+        Slot *next = nullptr;
+        for (auto &s : slots)
+            if (s.used && s.queued && (!next || (int32_t)(s.seq - next->seq) < 0))
+                next = &s;
+
+        if (next)
+        {
+            next->queued = false;
+            next->sentAt = now;
+            next->firstSentAt = now;
+        }
+        return next;
+    }
+
+    void release(Slot &s)
+    {
+        s.used = false;
+        inFlight--;
+    }
+
+    // releases every frame the ack covers, returns how many
+    int onAck(uint32_t top, uint32_t bits, uint32_t now)
+    {
+        int n = 0;
+        for (auto &s : slots)
+        {
+            if (!s.used || !ackCovers(top, bits, s.seq))
+                continue;
+
+            if (s.retries == 0)
+                sample(now - s.firstSentAt);
+
+            release(s);
+            n++;
+        }
+        return n;
+    }
+
+    // per-frame timeout, doubled for every retransmission
+    uint32_t timeout(const Slot &s) const
+    {
+        uint32_t t = rto << min<uint8_t>(s.retries, 6);
+        return min<uint32_t>(t, LHRP_RTO_MAX_MS);
+    }
+
+    bool expired(const Slot &s, uint32_t now) const
+    {
+        return s.used && !s.queued && now - s.sentAt >= timeout(s);
+    }
+
+private:
+    void sample(uint32_t rtt)
+    {
+        if (srtt == 0)
+        {
+            srtt = max<uint32_t>(rtt, 1);
+            rttvar = rtt / 2;
+        }
+        else
+        {
+            uint32_t err = rtt > srtt ? rtt - srtt : srtt - rtt;
+            rttvar = (3 * rttvar + err) / 4;
+            srtt = max<uint32_t>((7 * srtt + rtt) / 8, 1);
+        }
+
+        rto = srtt + max<uint32_t>(4 * rttvar, 1);
+        rto = max<uint32_t>(rto, LHRP_RTO_MIN_MS);
+        rto = min<uint32_t>(rto, LHRP_RTO_MAX_MS);
+    }
+};
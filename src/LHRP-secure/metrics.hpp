@@ -0,0 +1,201 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+
+#ifndef LHRP_LATENCY_BUCKETS
+#define LHRP_LATENCY_BUCKETS 16 // log2 us: 0, <2, <4, ... and >= 2^14 us in the last one
+#endif
+
+#define LHRP_METRICS_VERSION 1
+
+using namespace std;
+
+enum LHRP_DropReason : uint8_t
+{
+    LHRP_DROP_LENGTH,       // on-air length != header + dataLen
+    LHRP_DROP_NETID,        // other network
+    LHRP_DROP_MALFORMED,    // unknown flags, lengths that do not fit
+    LHRP_DROP_AUTH,         // GCM tag did not verify
+    LHRP_DROP_UNKNOWN_PEER, // authenticated, but not from a neighbour
+    LHRP_DROP_REPLAY,       // duplicate or too old, details in replayStats()
+    LHRP_DROP_NO_ROUTE,     // LHRP_PIN_ERROR
+    LHRP_DROP_BACKPRESSURE, // RX / TX ring or link window full
+    LHRP_DROP_SEND_ERROR,   // sealing or the radio (esp_now_send) failed
+    LHRP_DROP_TRUNCATED,    // send refused: payload does not fit into the frame or was cut off
+    LHRP_DROP_DECODE,       // compressed payload could not be unpacked
+    LHRP_DROP_FRAGMENT,     // not taken: no onStreamReceive(), no reassembly slot, duplicate or too far ahead
+    LHRP_DROP_REASONS
+};
+
+struct LHRP_PeerMetrics
+{
+    atomic<uint32_t> rxFrames{0}; // authenticated frames from the peer
+    atomic<uint32_t> rxBytes{0};  // on-air bytes of those
+    atomic<uint32_t> txFrames{0}; // everything handed to the radio, retransmits, acks and beacons too
+    atomic<uint32_t> txBytes{0};
+};
+
+// 0 -> 0, 1 -> 1, 2..3 -> 2, 4..7 -> 3, ...
+inline uint8_t latencyBucket(uint32_t us)
+{
+    uint8_t b = us ? 32 - __builtin_clz(us) : 0;
+    return b < LHRP_LATENCY_BUCKETS ? b : LHRP_LATENCY_BUCKETS - 1;
+}
+
+/* ============================================================
+   Always-on counters, every event is one relaxed atomic add
+   (no lock, no fence); readers see each counter on its own
+   ============================================================ */
+struct LHRP_Metrics
+{
+    atomic<uint32_t> rx{0};        // frames from the radio
+    atomic<uint32_t> tx{0};        // frames handed to the radio
+    atomic<uint32_t> forwarded{0}; // relayed pockets sent on
+    atomic<uint32_t> delivered{0}; // pockets for us (callback, or fragments the reassembler took)
+    atomic<uint32_t> drops[LHRP_DROP_REASONS];
+    atomic<uint32_t> forwardLatency[LHRP_LATENCY_BUCKETS]; // radio callback -> radio send of relayed frames
+    vector<LHRP_PeerMetrics> peers;                        // indexed like peers (pin - 1)
+
+    explicit LHRP_Metrics(size_t peerCount = 0) : peers(peerCount)
+    {
+        for (auto &d : drops)
+            d.store(0, memory_order_relaxed);
+        for (auto &b : forwardLatency)
+            b.store(0, memory_order_relaxed);
+    }
+
+    void count(atomic<uint32_t> &c, uint32_t n = 1) { c.fetch_add(n, memory_order_relaxed); }
+    void drop(LHRP_DropReason reason) { count(drops[reason]); }
+
+    void received(int peer, size_t bytes)
+    {
+        count(peers[peer].rxFrames);
+        count(peers[peer].rxBytes, bytes);
+    }
+
+    void sent(int peer, size_t bytes)
+    {
+        count(tx);
+        count(peers[peer].txFrames);
+        count(peers[peer].txBytes, bytes);
+    }
+
+    void relayed(uint32_t receivedAt, uint32_t now)
+    {
+        count(forwarded);
+        count(forwardLatency[latencyBucket(now - receivedAt)]);
+    }
+};
+
+/* ============================================================
+   Binary snapshot, all counters as little-endian uint32:
+     | version | reasons | buckets | peers |
+     | rx | tx | forwarded | delivered | drops[reasons] | latency[buckets] |
+     | per peer: rxFrames | rxBytes | txFrames | txBytes |
+   readers ignore unknown drop reasons and fold extra buckets into their last
+   ============================================================ */
+inline size_t metricsSnapshotSize(size_t peers)
+{
+    return 4 + 4 * (4 + LHRP_DROP_REASONS + LHRP_LATENCY_BUCKETS + 4 * min<size_t>(peers, 255));
+}
+
+// 0 if cap is too small
+inline size_t writeMetricsSnapshot(const LHRP_Metrics &m, uint8_t *out, size_t cap)
+{
+    size_t peers = min<size_t>(m.peers.size(), 255);
+    size_t size = metricsSnapshotSize(peers);
+    if (cap < size)
+        return 0;
+
+    *out++ = LHRP_METRICS_VERSION;
+    *out++ = LHRP_DROP_REASONS;
+    *out++ = LHRP_LATENCY_BUCKETS;
+    *out++ = peers;
+
+    auto put = [&](const atomic<uint32_t> &c)
+    {
+        uint32_t v = c.load(memory_order_relaxed);
+        for (int i = 0; i < 4; i++)
+            *out++ = v >> (8 * i);
+    };
+
+    put(m.rx);
+    put(m.tx);
+    put(m.forwarded);
+    put(m.delivered);
+    for (auto &d : m.drops)
+        put(d);
+    for (auto &b : m.forwardLatency)
+        put(b);
+    for (size_t i = 0; i < peers; i++)
+    {
+        put(m.peers[i].rxFrames);
+        put(m.peers[i].rxBytes);
+        put(m.peers[i].txFrames);
+        put(m.peers[i].txBytes);
+    }
+
+    return size;
+}
+
+// decoded snapshot, e.g. on a host that collects them
+struct LHRP_MetricsSnapshot
+{
+    struct Peer
+    {
+        uint32_t rxFrames, rxBytes, txFrames, txBytes;
+    };
+
+    uint32_t rx = 0, tx = 0, forwarded = 0, delivered = 0;
+    uint32_t drops[LHRP_DROP_REASONS] = {};
+    uint32_t forwardLatency[LHRP_LATENCY_BUCKETS] = {};
+    vector<Peer> peers;
+};
+
+inline bool readMetricsSnapshot(const uint8_t *in, size_t len, LHRP_MetricsSnapshot &s)
+{
+    if (len < 4 || in[0] != LHRP_METRICS_VERSION)
+        return false;
+
+    size_t reasons = in[1], buckets = in[2], peers = in[3];
+    if (len < 4 + 4 * (4 + reasons + buckets + 4 * peers))
+        return false;
+
+    s = LHRP_MetricsSnapshot();
+    const uint8_t *p = in + 4;
+    auto get = [&]
+    {
+        uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+        p += 4;
+        return v;
+    };
+
+    s.rx = get();
+    s.tx = get();
+    s.forwarded = get();
+    s.delivered = get();
+    for (size_t i = 0; i < reasons; i++)
+    {
+        uint32_t v = get();
+        if (i < LHRP_DROP_REASONS)
+            s.drops[i] = v;
+    }
+    for (size_t i = 0; i < buckets; i++)
+    {
+        uint32_t v = get();
+        s.forwardLatency[min<size_t>(i, LHRP_LATENCY_BUCKETS - 1)] += v;
+    }
+    s.peers.resize(peers);
+    for (auto &peer : s.peers)
+    {
+        peer.rxFrames = get();
+        peer.rxBytes = get();
+        peer.txFrames = get();
+        peer.txBytes = get();
+    }
+    return true;
+}
@@ -0,0 +1,103 @@
+#ifdef ARDUINO
+
+#include "platform.hpp"
+
+#include <WiFi.h>
+#include <esp_wifi.h>
+#include <esp_now.h>
+#include <string.h>
+
+// ------------------------
+EspNowRadio &EspNowRadio::get()
+{
+    static EspNowRadio radio;
+    return radio;
+}
+
+bool EspNowRadio::begin(uint8_t channel, ReceiveFn receive, SentFn sent, void *arg)
+{
+    WiFi.mode(WIFI_STA);
+    esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+
+    if (esp_now_init() != ESP_OK)
+        return false;
+
+    receiveFn = receive;
+    sentFn = sent;
+    receiveArg = arg;
+    esp_now_register_recv_cb(onReceive);
+    esp_now_register_send_cb(onSent);
+
+    started = true;
+    applyRssi();
+    return true;
+}
+
+void EspNowRadio::useRssi(bool on)
+{
+    rssiOn = on;
+    if (started)
+        applyRssi();
+}
+
+// the ESP-NOW receive callback has no RSSI: take it from the frame seen just before
+void EspNowRadio::applyRssi()
+{
+    if (rssiOn)
+    {
+        wifi_promiscuous_filter_t filter{};
+        filter.filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT;
+        esp_wifi_set_promiscuous_filter(&filter);
+        esp_wifi_set_promiscuous_rx_cb(onPromiscuous);
+    }
+    else
+        lastRssi = 0;
+
+    esp_wifi_set_promiscuous(rssiOn);
+}
+
+bool EspNowRadio::addPeer(const uint8_t mac[6], uint8_t channel)
+{
+    esp_now_peer_info_t peer{};
+    memcpy(peer.peer_addr, mac, 6);
+    peer.channel = channel;
+    peer.encrypt = false;
+
+    return esp_now_add_peer(&peer) == ESP_OK;
+}
+
+bool EspNowRadio::send(const uint8_t mac[6], const uint8_t *data, size_t len)
+{
+    return esp_now_send(mac, data, len) == ESP_OK;
+}
+
+void EspNowRadio::onReceive(const uint8_t *mac, const uint8_t *data, int len)
+{
+    EspNowRadio &radio = get();
+    if (!radio.receiveFn)
+        return;
+
+    // both callbacks run in the WiFi task, the last frame is only ours if the sender matches
+    int8_t rssi = memcmp(mac, radio.lastMac, 6) == 0 ? radio.lastRssi : 0;
+    radio.receiveFn(radio.receiveArg, mac, data, len, rssi);
+}
+
+void EspNowRadio::onSent(const uint8_t *mac, esp_now_send_status_t status)
+{
+    EspNowRadio &radio = get();
+    if (radio.sentFn)
+        radio.sentFn(radio.receiveArg, mac, status == ESP_NOW_SEND_SUCCESS);
+}
+
+void EspNowRadio::onPromiscuous(void *buf, wifi_promiscuous_pkt_type_t type)
+{
+    if (type != WIFI_PKT_MGMT)
+        return;
+
+    const wifi_promiscuous_pkt_t *pkt = (const wifi_promiscuous_pkt_t *)buf;
+    EspNowRadio &radio = get();
+    memcpy(radio.lastMac, pkt->payload + 10, 6); // 802.11 header: fc, duration, addr1, addr2
+    radio.lastRssi = pkt->rx_ctrl.rssi;
+}
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef ARDUINO
+
+#include "virtual-radio.hpp"
+
+#include <string.h>
+
+// ------------------------
+static uint64_t macKey(const uint8_t mac[6])
+{
+    uint64_t k = 0;
+    for (int i = 0; i < 6; i++)
+        k = (k << 8) | mac[i];
+    return k;
+}
+
+static uint64_t nowUs()
+{
+    static const auto start = chrono::steady_clock::now();
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+}
+
+// ------------------------
+bool VirtualRadio::begin(uint8_t channel, ReceiveFn receive, SentFn sent, void *arg)
+{
+    lock_guard<mutex> guard(medium->lock);
+    this->channel = channel;
+    receiveFn = receive;
+    sentFn = sent;
+    receiveArg = arg;
+    return true;
+}
+
+bool VirtualRadio::addPeer(const uint8_t mac[6], uint8_t channel)
+{
+    return true; // every radio on the channel is reachable
+}
+
+bool VirtualRadio::send(const uint8_t mac[6], const uint8_t *data, size_t len)
+{
+    if (len > sizeof(VirtualMedium::Frame::data))
+        return false;
+
+    // like the ESP-NOW send callback: did the frame reach the other radio
+    bool ok = medium->transmit(*this, mac, data, len);
+    if (sentFn)
+        sentFn(receiveArg, mac, ok);
+    return true;
+}
+
+// ------------------------
+VirtualMedium::VirtualMedium(uint32_t seed) : rng(seed)
+{
+}
+
+VirtualMedium::~VirtualMedium()
+{
+    stop();
+}
+
+VirtualRadio &VirtualMedium::attach(const array<uint8_t, 6> &mac)
+{
+    lock_guard<mutex> guard(lock);
+    unique_ptr<VirtualRadio> &radio = radios[macKey(mac.data())];
+    if (!radio)
+    {
+        radio.reset(new VirtualRadio());
+        radio->mac = mac;
+        radio->medium = this;
+    }
+    return *radio;
+}
+
+void VirtualMedium::setDefaultLink(const VirtualLink &link)
+{
+    lock_guard<mutex> guard(lock);
+    defaultLink = link;
+    for (auto &kv : links)
+        kv.second.config = link;
+}
+
+void VirtualMedium::setLink(const array<uint8_t, 6> &from, const array<uint8_t, 6> &to, const VirtualLink &link)
+{
+    lock_guard<mutex> guard(lock);
+    linkState(macKey(from.data()), macKey(to.data())).config = link;
+}
+
+void VirtualMedium::start()
+{
+    lock_guard<mutex> guard(lock);
+    if (running)
+        return;
+
+    running = true;
+    deliveryThread = thread(&VirtualMedium::deliveryLoop, this);
+}
+
+void VirtualMedium::stop()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        if (!running)
+            return;
+        running = false;
+    }
+
+    wake.notify_all();
+    deliveryThread.join();
+}
+
+bool VirtualMedium::waitIdle(uint32_t timeoutMs)
+{
+    unique_lock<mutex> guard(lock);
+    return idle.wait_for(guard, chrono::milliseconds(timeoutMs), [this]
+                         { return queue.empty() && delivering == 0; });
+}
+
+VirtualMediumStats VirtualMedium::stats()
+{
+    lock_guard<mutex> guard(lock);
+    return counters;
+}
+
+// lock must be held
+VirtualMedium::LinkState &VirtualMedium::linkState(uint64_t from, uint64_t to)
+{
+    auto it = links.find({from, to});
+    if (it == links.end())
+    {
+        it = links.emplace(make_pair(from, to), LinkState()).first;
+        it->second.config = defaultLink;
+    }
+    return it->second;
+}
+
+// false if the frame goes nowhere (the send itself succeeds anyway, like ESP-NOW)
+bool VirtualMedium::transmit(VirtualRadio &from, const uint8_t to[6], const uint8_t *data, size_t len)
+{
+    lock_guard<mutex> guard(lock);
+    counters.sent++;
+
+    auto it = radios.find(macKey(to));
+    if (it == radios.end() || !it->second->receiveFn || it->second->channel != from.channel)
+    {
+        counters.unreachable++;
+        return false;
+    }
+
+    LinkState &link = linkState(macKey(from.mac.data()), macKey(to));
+    if (link.config.loss > 0 && uniform_real_distribution<float>(0, 1)(rng) < link.config.loss)
+    {
+        counters.lost++;
+        return false;
+    }
+
+    uint64_t now = nowUs();
+    uint64_t done = now;
+    if (link.config.bytesPerSec)
+    {
+        uint64_t start = max(now, link.busyUntilUs);
+        done = start + len * 1000000ull / link.config.bytesPerSec;
+        link.busyUntilUs = done;
+    }
+
+    Frame f;
+    f.dueUs = done + link.config.latencyUs;
+    f.order = nextOrder++;
+    f.to = it->second.get();
+    memcpy(f.from, from.mac.data(), 6);
+    f.rssi = link.config.rssi;
+    f.len = len;
+    memcpy(f.data, data, len);
+    queue.push(f);
+
+    wake.notify_one();
+    return true;
+}
+
+void VirtualMedium::deliveryLoop()
+{
+    unique_lock<mutex> guard(lock);
+
+    while (running)
+    {
+        if (queue.empty())
+        {
+            idle.notify_all();
+            wake.wait(guard);
+            continue;
+        }
+
+        uint64_t now = nowUs();
+        if (queue.top().dueUs > now)
+        {
+            wake.wait_for(guard, chrono::microseconds(queue.top().dueUs - now));
+            continue;
+        }
+
+        Frame f = queue.top();
+        queue.pop();
+        counters.delivered++;
+        delivering++;
+
+        // receivers may send from the callback
+        guard.unlock();
+        f.to->receiveFn(f.to->receiveArg, f.from, f.data, f.len, f.rssi);
+        guard.lock();
+
+        delivering--;
+    }
+
+    idle.notify_all();
+}
+
+#endif
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_system.h>
+#include <esp_now.h>
+#include <esp_wifi_types.h>
+#else
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <mutex>
+#include <thread>
+#endif
+
+/* ============================================================
+   Platform: clock and randomness (compile time), radio (per
+   node, so many nodes can share one process on the host)
+   ============================================================ */
+#ifdef ARDUINO
+
+inline uint32_t platformMillis() { return millis(); }
+inline uint32_t platformMicros() { return micros(); }
+inline void platformSleep(uint32_t ms) { delay(ms); } // yields to other tasks
+
+inline void platformRandom(void *out, size_t len)
+{
+    esp_fill_random(out, len);
+}
+
+#else
+
+// microseconds since any start; replaces the steady clock for platformMicros /
+// platformMillis, e.g. a virtual clock in tests (VirtualMedium keeps real time)
+typedef uint64_t (*PlatformClock)();
+
+inline std::atomic<PlatformClock> &platformClock()
+{
+    static std::atomic<PlatformClock> clock{nullptr};
+    return clock;
+}
+
+// nullptr: back to the steady clock
+inline void platformUseClock(PlatformClock clock)
+{
+    platformClock().store(clock);
+}
+
+inline uint32_t platformMicros()
+{
+    if (PlatformClock clock = platformClock().load(std::memory_order_relaxed))
+        return (uint32_t)clock();
+
+    static const auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+inline uint32_t platformMillis()
+{
+    if (PlatformClock clock = platformClock().load(std::memory_order_relaxed))
+        return (uint32_t)(clock() / 1000);
+
+    static const auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+}
+
+// real time, also with platformUseClock()
+inline void platformSleep(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// IVs and message ids only have to be unique, not secret
+inline void platformRandom(void *out, size_t len)
+{
+    static std::mutex lock;
+    static std::mt19937_64 rng(std::random_device{}());
+
+    std::lock_guard<std::mutex> guard(lock);
+    uint8_t *p = (uint8_t *)out;
+    for (size_t i = 0; i < len; i += 8)
+    {
+        uint64_t v = rng();
+        for (size_t j = 0; j < 8 && i + j < len; j++)
+            p[i + j] = v >> (8 * j);
+    }
+}
+
+#endif
+
+// link layer below LHRP_Node_Secure: ESP-NOW on the ESP32, VirtualRadio on the host
+struct Radio
+{
+    typedef void (*ReceiveFn)(void *arg, const uint8_t *mac, const uint8_t *data, int len, int8_t rssi); // rssi 0 = unknown
+    typedef void (*SentFn)(void *arg, const uint8_t *mac, bool ok);                                      // link-layer result of send()
+
+    virtual ~Radio() {}
+
+    // tunes to `channel`, delivers every received frame to receive(arg, ...)
+    // and the outcome of every send() to sent(arg, ...) (may be nullptr)
+    virtual bool begin(uint8_t channel, ReceiveFn receive, SentFn sent, void *arg) = 0;
+    virtual bool addPeer(const uint8_t mac[6], uint8_t channel) = 0;
+    virtual bool send(const uint8_t mac[6], const uint8_t *data, size_t len) = 0;
+
+    // RSSI for received frames, only wanted with link quality (beacons, route policy);
+    // before or after begin()
+    virtual void useRssi(bool on) {}
+};
+
+#ifdef ARDUINO
+
+// ESP-NOW has a single receive callback: only one node per device
+struct EspNowRadio : Radio
+{
+    static EspNowRadio &get();
+
+    bool begin(uint8_t channel, ReceiveFn receive, SentFn sent, void *arg) override;
+    bool addPeer(const uint8_t mac[6], uint8_t channel) override;
+    bool send(const uint8_t mac[6], const uint8_t *data, size_t len) override;
+    void useRssi(bool on) override; // promiscuous mode, costs a callback per management frame
+
+private:
+    ReceiveFn receiveFn = nullptr;
+    SentFn sentFn = nullptr;
+    void *receiveArg = nullptr;
+    bool started = false;
+    bool rssiOn = false;
+
+    // of the last management frame (ESP-NOW frames are action frames) and its sender (addr2)
+    volatile int8_t lastRssi = 0;
+    uint8_t lastMac[6] = {};
+
+    void applyRssi();
+
+    static void onReceive(const uint8_t *mac, const uint8_t *data, int len);
+    static void onSent(const uint8_t *mac, esp_now_send_status_t status);
+    static void onPromiscuous(void *buf, wifi_promiscuous_pkt_type_t type);
+};
+
+#endif
@@ -1,25 +1,46 @@
 #pragma once
 
 #include <vector>
-#include <Arduino.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include "../LHRP-common/fixed-vector.hpp"
+
+#define MAX_ADDRESS_DEPTH 15
+#define MAX_POCKET_PAYLOAD 214 // RawPacket::rawData without seq
+
+#ifndef LHRP_TRACE_MAX_HOPS
+#define LHRP_TRACE_MAX_HOPS 8 // records a traced pocket reserves room for (6 bytes each)
+#endif
 
 using namespace std;
 
-struct Address : public vector<uint8_t>
+struct Address : public FixedVector<uint8_t, MAX_ADDRESS_DEPTH>
 {
-    // inherit vector constructors
-    using vector<uint8_t>::vector;
+    using FixedVector<uint8_t, MAX_ADDRESS_DEPTH>::FixedVector;
+};
 
-    // initializer_list constructor
-    Address(std::initializer_list<uint8_t> init)
-        : vector<uint8_t>(init) {}
+typedef FixedVector<uint8_t, MAX_POCKET_PAYLOAD> Payload;
+
+// one node on the path of a traced pocket (Pocket::trace), times saturate at 65535 us
+struct TraceHop
+{
+    uint16_t node;     // last two bytes of its MAC
+    uint16_t queuedUs; // radio callback (source: send()) until sealed for the next hop or delivered, minus crypto
+    uint16_t cryptoUs; // opening plus sealing (the seal time of the node's previous traced frame)
 };
 
 struct Pocket
 {
     Address destAddress;
     Address srcAddress;
-    vector<uint8_t> payload;
+    Payload payload;
     bool errored;
     uint32_t seq; // neu: Sequenznummer (32-bit), wird beim Deserialisieren gesetzt
+    uint8_t flags = 0; // per-pocket LHRP_FLAG_* (e.g. LHRP_FLAG_FRAGMENT)
+    uint16_t flowId = 0; // != 0: sent along (LHRP_FLAG_FLOW), part of the ECMP flow key
+    bool compress = false; // send(): try the codec from useCompression(), sent as is if not smaller
+    bool trace = false;    // send(): every node on the path adds a TraceHop (LHRP_PREFIX_TRACE)
+    FixedVector<TraceHop, LHRP_TRACE_MAX_HOPS> hops; // received traced pockets: source first, this node last
+    uint8_t hopCount = 0;  // nodes the traced pocket passed, more than hops.size() once the trace area was full
 };
@@ -1,37 +1,83 @@
 #pragma once
 
+#include <string.h>
 #include <vector>
 #include <algorithm>
 #include "pocket.hpp"
+#include "../LHRP-common/route-trie.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define LHRP_PIN_ERROR 255
 
 using namespace std;
 
+/* ============================================================
+   Routing rules on plain byte ranges; constexpr, so Node and the
+   compile-time checks in topology.hpp decide with the same code
+   ============================================================ */
 struct Match
 {
     uint16_t positive;
     uint16_t negative;
 };
 
-inline Match match(const Address &connection, const Address &pocket)
+constexpr Match match(const uint8_t *connection, size_t connectionLen, const uint8_t *pocket, size_t pocketLen)
 {
-    size_t minLen = min(connection.size(), pocket.size());
     Match m{0, 0};
 
-    while (m.positive < minLen &&
+    while (m.positive < connectionLen && m.positive < pocketLen &&
            connection[m.positive] == pocket[m.positive])
         m.positive++;
 
-    m.negative = connection.size() - m.positive;
+    m.negative = connectionLen - m.positive;
     return m;
 }
 
-inline int matchIndex(const Match &m)
+constexpr int matchIndex(const Match &m)
 {
     return (int)m.positive - (int)m.negative;
 }
 
+constexpr bool isChildren(const uint8_t *other, size_t otherLen, const uint8_t *you, size_t youLen)
+{
+    return otherLen > youLen && match(you, youLen, other, otherLen).negative == 0;
+}
+
+// a connection beats the best one so far: higher matchIndex, then the longer address
+constexpr bool betterMatch(int idx, size_t len, int bestIdx, size_t bestLen)
+{
+    return idx > bestIdx || (idx == bestIdx && len > bestLen);
+}
+
+enum RouteDecision
+{
+    ROUTE_LOCAL,   // deliver here
+    ROUTE_NONE,    // LHRP_PIN_ERROR
+    ROUTE_FORWARD, // to the best connection
+};
+
+// directChild: dest lies below us, bestIsChild: so does the best connection
+constexpr RouteDecision decideRoute(bool directChild, bool bestIsChild, int bestIdx, int ownMatchIdx)
+{
+    // wen child nicht vorhanden ist
+    if (directChild && (!bestIsChild || bestIdx < ownMatchIdx))
+        return ROUTE_LOCAL;
+
+    // wenn parent nicht vorhanden ist
+    if (bestIdx <= ownMatchIdx)
+        return ROUTE_NONE;
+
+    return ROUTE_FORWARD;
+}
+
+inline Match match(const Address &connection, const Address &pocket)
+{
+    return match(connection.data(), connection.size(), pocket.data(), pocket.size());
+}
+
 inline bool eq(const Address &a1, const Address &a2)
 {
     return a1.size() == a2.size() &&
@@ -40,14 +86,24 @@ inline bool eq(const Address &a1, const Address &a2)
 
 inline bool isChildren(const Address &other, const Address &you)
 {
-    if (other.size() <= you.size())
-        return false;
+    return isChildren(other.data(), other.size(), you.data(), you.size());
+}
 
-    for (size_t i = 0; i < you.size(); i++)
-        if (other[i] != you[i])
-            return false;
+// FNV-1a over src, dest and flow id: one flow, one path (ECMP)
+inline uint32_t flowHash(const Address &src, const Address &dest, uint16_t flowId)
+{
+    uint32_t h = 2166136261u;
+    auto mix = [&h](uint8_t b)
+    { h = (h ^ b) * 16777619u; };
 
-    return true;
+    for (uint8_t b : src)
+        mix(b);
+    mix(0xFF); // separator: {1},{1,2} != {1,1},{2}
+    for (uint8_t b : dest)
+        mix(b);
+    mix(flowId >> 8);
+    mix(flowId & 0xFF);
+    return h;
 }
 
 struct Connection
@@ -56,46 +112,428 @@ struct Connection
     uint8_t pin;
 };
 
+typedef RouteTrie<Address> RoutingTable;
+
+/* ============================================================
+   Connection lanes: every address zero-padded into 16 bytes,
+   lengths / pins in parallel arrays; the common prefix comes from
+   word-wide XOR + count trailing zeros (little endian)
+   ============================================================ */
+#define LHRP_LANE_BYTES 16
+#ifndef LHRP_LANE_LIMIT
+#define LHRP_LANE_LIMIT 8 // up to this many connections scanning the lanes beats the trie
+#endif
+
+static_assert(MAX_ADDRESS_DEPTH < LHRP_LANE_BYTES, "an address must fit into one lane");
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "lane prefix uses count trailing zeros");
+
+typedef size_t LaneWord; // 4 bytes on the ESP32, 8 on the host
+
+struct alignas(LHRP_LANE_BYTES) AddressLane
+{
+    uint8_t bytes[LHRP_LANE_BYTES];
+
+    void pack(const Address &a)
+    {
+        memset(bytes, 0, sizeof(bytes));
+        memcpy(bytes, a.data(), a.size());
+    }
+
+    LaneWord word(size_t w) const
+    {
+        LaneWord v;
+        memcpy(&v, bytes + w * sizeof(LaneWord), sizeof(v));
+        return v;
+    }
+};
+
+// bytes a and b share within the first `limit` bytes
+inline uint32_t lanePrefix(const AddressLane &a, const AddressLane &b, uint32_t limit)
+{
+#ifdef __SSE2__
+    __m128i x = _mm_load_si128((const __m128i *)a.bytes);
+    __m128i y = _mm_load_si128((const __m128i *)b.bytes);
+    uint32_t equal = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) & ((1u << limit) - 1);
+    return __builtin_ctz(~equal); // limit < 16, so there is always a zero bit
+#else
+    for (size_t w = 0; w < LHRP_LANE_BYTES / sizeof(LaneWord); w++)
+    {
+        LaneWord x = a.word(w) ^ b.word(w);
+        if (x)
+            return min<uint32_t>(w * sizeof(LaneWord) + (sizeof(LaneWord) == 8 ? __builtin_ctzll(x) : __builtin_ctz(x)) / 8, limit);
+    }
+    return limit;
+#endif
+}
+
+struct ConnectionLanes
+{
+    vector<AddressLane> lanes;
+    vector<uint8_t> lens;
+    vector<uint8_t> pins;
+    vector<uint8_t> below; // the connection lies below you
+
+    void build(const vector<Connection> &connections, const Address &you)
+    {
+        size_t n = min<size_t>(connections.size(), 0xFFFF);
+        lanes.resize(n);
+        lens.resize(n);
+        pins.resize(n);
+        below.resize(n);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            lanes[i].pack(connections[i].address);
+            lens[i] = connections[i].address.size();
+            pins[i] = connections[i].pin;
+            below[i] = isChildren(connections[i].address, you);
+        }
+    }
+
+    // matchIndex(match(connection i, dest)), d = dest packed
+    int matchIndexAt(size_t i, const AddressLane &d, uint32_t destLen) const
+    {
+        return 2 * (int)lanePrefix(lanes[i], d, min<uint32_t>(lens[i], destLen)) - lens[i];
+    }
+
+    // index of the best connection (same ordering as routeLinear), -1 if there is none
+    int best(const Address &dest, int &bestIdx) const
+    {
+        AddressLane d;
+        d.pack(dest);
+        uint32_t destLen = dest.size();
+
+        // key = matchIndex | length | inverted index: its maximum is the linear scan's pick
+        uint32_t bestKey = 0;
+        for (size_t i = 0; i < lanes.size(); i++)
+        {
+            uint32_t len = lens[i];
+            uint32_t positive = lanePrefix(lanes[i], d, min(len, destLen));
+            uint32_t idx = 2 * positive - len + LHRP_LANE_BYTES; // matchIndex, biased to >= 1
+            uint32_t key = idx << 24 | len << 16 | (0xFFFF - (uint32_t)i);
+            bestKey = max(bestKey, key);
+        }
+
+        if (!bestKey)
+            return -1;
+
+        bestIdx = (int)(bestKey >> 24) - LHRP_LANE_BYTES;
+        return 0xFFFF - (bestKey & 0xFFFF);
+    }
+};
+
+/* ============================================================
+   Link-cost aware next hop: the prefix decision stays the default,
+   a policy may pick another connection that still makes progress
+   (higher matchIndex than our own, so no loops)
+   ============================================================ */
+#define LHRP_COST_PERFECT 16  // ETX 1.0 in 1/16
+#define LHRP_COST_DEAD 0xFFFF // neighbour not heard anymore
+
+struct RoutePolicy
+{
+    bool tieBreak = false; // same matchIndex: the cheaper link wins ...
+    uint16_t tieMargin = 4; // ... if it is cheaper by more than this (no flapping)
+    uint16_t maxCost = 0;   // 0 = off; above it a worse prefix over a cheaper link is taken
+
+    bool enabled() const { return tieBreak || maxCost; }
+};
+
 struct Node
 {
-    vector<Connection> connections;
-    Address you;
+    RoutingTable table;
+    ConnectionLanes lanes;
+    uint32_t generation = 0; // bumped on every compile() and every change of you / connections
+
+    const Address &you() const { return self; }
+    const vector<Connection> &connections() const { return links; }
+
+    // every change makes the compiled table stale: route() falls back to
+    // routeLinear() until the next compile()
+    void setYou(const Address &a)
+    {
+        self = a;
+        generation++;
+    }
+
+    void addConnection(const Connection &c)
+    {
+        links.push_back(c);
+        generation++;
+    }
+
+    void setConnection(size_t i, const Connection &c)
+    {
+        links[i] = c;
+        generation++;
+    }
+
+    void clearConnections()
+    {
+        links.clear();
+        generation++;
+    }
 
-    uint8_t send(const Pocket &p)
+    bool compiled() const { return compiledGeneration == generation; }
+
+    // must be called after connections or you changed
+    void compile()
     {
-        if (eq(you, p.destAddress))
+        table.build(links);
+        lanes.build(links, self);
+        compiledGeneration = ++generation;
+    }
+
+    uint8_t send(const Pocket &p) const
+    {
+        return route(p.destAddress);
+    }
+
+    uint8_t route(const Address &dest) const
+    {
+        // not compiled (or you / connections changed afterwards)
+        if (!compiled())
+            return routeLinear(dest);
+
+        if (links.size() <= LHRP_LANE_LIMIT)
+            return routeLanes(dest);
+
+        if (eq(self, dest))
+            return 0;
+
+        RouteCandidate best;
+        int bestIdx;
+        if (!table.lookup(dest, best, bestIdx))
+            return LHRP_PIN_ERROR;
+
+        return decide(links[best.conn], bestIdx, dest);
+    }
+
+    // only valid after compile()
+    uint8_t routeLanes(const Address &dest) const
+    {
+        if (eq(self, dest))
             return 0;
 
-        if (connections.empty())
+        int bestIdx;
+        int best = lanes.best(dest, bestIdx);
+        if (best < 0)
             return LHRP_PIN_ERROR;
 
-        Connection *best = &connections[0];
-        int bestIdx = matchIndex(match(best->address, p.destAddress));
+        return decide(links[best], bestIdx, dest);
+    }
+
+    uint8_t routeLinear(const Address &dest) const
+    {
+        if (eq(self, dest))
+            return 0;
+
+        if (links.empty())
+            return LHRP_PIN_ERROR;
+
+        const Connection *best = &links[0];
+        int bestIdx = matchIndex(match(best->address, dest));
         size_t bestLen = best->address.size();
 
-        for (size_t i = 1; i < connections.size(); i++)
+        for (size_t i = 1; i < links.size(); i++)
         {
-            int idx = matchIndex(match(connections[i].address, p.destAddress));
-            size_t len = connections[i].address.size();
+            int idx = matchIndex(match(links[i].address, dest));
+            size_t len = links[i].address.size();
 
-            if (idx > bestIdx || (idx == bestIdx && len > bestLen))
+            if (betterMatch(idx, len, bestIdx, bestLen))
             {
-                best = &connections[i];
+                best = &links[i];
                 bestIdx = idx;
                 bestLen = len;
             }
         }
 
-         // wen child nicht vorhanden ist
-        bool directChild = isChildren(p.destAddress, you);
-        int ownMatchIdx = matchIndex(match(you, p.destAddress));
-        if (directChild && (!isChildren(best->address, you) || bestIdx < ownMatchIdx))
+        return decide(*best, bestIdx, dest);
+    }
+
+    // route() adjusted by `policy`, cost[i] belongs to connections[i]; the best
+    // connection comes from the lanes / trie like in route(), the alternatives
+    // are matched on the lanes
+    uint8_t routeWeighted(const Address &dest, const RoutePolicy &policy, const uint16_t *cost) const
+    {
+        if (eq(self, dest))
+            return 0;
+
+        int bestIdx;
+        int best = bestLink(dest, bestIdx);
+        if (best < 0)
+            return LHRP_PIN_ERROR;
+
+        uint8_t pin = decide(links[best], bestIdx, dest);
+        if (pin == 0 || pin == LHRP_PIN_ERROR || !policy.enabled())
+            return pin;
+
+        bool overpriced = policy.maxCost && cost[best] > policy.maxCost;
+        if (!overpriced && !policy.tieBreak)
+            return pin;
+
+        int ownMatchIdx = matchIndex(match(self, dest));
+        bool directChild = isChildren(dest, self);
+        AddressLane d;
+        d.pack(dest);
+
+        size_t pick = best;
+        int pickIdx = bestIdx;
+        bool replaced = false;
+
+        for (size_t i = 0; i < links.size(); i++)
+        {
+            int idx = linkMatchIndex(i, d, dest);
+
+            // must get closer, and our own subtree is only reached through our children
+            if (idx <= ownMatchIdx || (directChild && !linkBelow(i)))
+                continue;
+
+            if (overpriced)
+            {
+                if (cost[i] > policy.maxCost)
+                    continue;
+                if (!replaced || idx > pickIdx || (idx == pickIdx && cost[i] < cost[pick]))
+                {
+                    pick = i;
+                    pickIdx = idx;
+                    replaced = true;
+                }
+            }
+            else if (idx == bestIdx && (uint32_t)cost[i] + policy.tieMargin < cost[pick])
+                pick = i;
+        }
+
+        return links[pick].pin;
+    }
+
+    // connections tied with the one route() forwards to (same matchIndex and length),
+    // in connection order; 0 if route() delivers locally or has no route
+    size_t routeTies(const Address &dest, uint16_t *out, size_t max) const
+    {
+        if (eq(self, dest))
+            return 0;
+
+        int bestIdx;
+        int best = bestLink(dest, bestIdx);
+        if (best < 0)
             return 0;
 
-        // wenn parent nicht vorhanden ist
-        if (bestIdx <= ownMatchIdx)
+        uint8_t pin = decide(links[best], bestIdx, dest);
+        if (pin == 0 || pin == LHRP_PIN_ERROR)
+            return 0;
+
+        size_t bestLen = links[best].address.size();
+        AddressLane d;
+        d.pack(dest);
+
+        size_t n = 0;
+        for (size_t i = 0; i < links.size() && n < max; i++)
+            if (links[i].address.size() == bestLen && linkMatchIndex(i, d, dest) == bestIdx)
+                out[n++] = i;
+        return n;
+    }
+
+    // true if a pocket for every address under `prefix` is delivered here
+    bool inPrefix(const Address &prefix) const
+    {
+        return eq(self, prefix) || isChildren(self, prefix);
+    }
+
+    // subtree multicast over tree edges (parent = deepest ancestor connection,
+    // children = topmost descendant connections): every tree neighbour except
+    // `from` (connection index, -1 = sent here) whose side of the tree holds
+    // addresses under `prefix`, so each node gets exactly one copy
+    size_t multicastTargets(const Address &prefix, int from, uint16_t *out, size_t max) const
+    {
+        int parent = -1;
+        for (size_t i = 0; i < links.size(); i++)
+            if (isChildren(self, links[i].address) &&
+                (parent < 0 || links[i].address.size() > links[parent].address.size()))
+                parent = i;
+
+        size_t n = 0;
+
+        // everything under prefix lies below us unless prefix is above or beside us
+        bool prefixBelow = eq(prefix, self) || isChildren(prefix, self);
+        if (parent >= 0 && parent != from && !prefixBelow && n < max)
+            out[n++] = parent;
+
+        for (size_t i = 0; i < links.size() && n < max; i++)
+        {
+            const Address &a = links[i].address;
+            if ((int)i == from || !isChildren(a, self))
+                continue;
+
+            bool covered = false; // reached through a child closer to us
+            for (size_t j = 0; j < links.size() && !covered; j++)
+                covered = j != i && isChildren(links[j].address, self) && isChildren(a, links[j].address);
+
+            if (!covered && (eq(a, prefix) || isChildren(a, prefix) || isChildren(prefix, a)))
+                out[n++] = i;
+        }
+
+        return n;
+    }
+
+    // index of the connection route() takes (same ordering as routeLinear), connections must not be empty
+    size_t bestConnection(const Address &dest, int &bestIdx) const
+    {
+        size_t best = 0;
+        bestIdx = matchIndex(match(links[0].address, dest));
+        for (size_t i = 1; i < links.size(); i++)
+        {
+            int idx = matchIndex(match(links[i].address, dest));
+            if (betterMatch(idx, links[i].address.size(), bestIdx, links[best].address.size()))
+            {
+                best = i;
+                bestIdx = idx;
+            }
+        }
+        return best;
+    }
+
+    // index of the connection route() takes: lanes or trie once compiled,
+    // bestConnection() before; -1 without connections
+    int bestLink(const Address &dest, int &bestIdx) const
+    {
+        if (links.empty())
+            return -1;
+        if (!compiled())
+            return bestConnection(dest, bestIdx);
+        if (links.size() <= LHRP_LANE_LIMIT)
+            return lanes.best(dest, bestIdx);
+
+        RouteCandidate best;
+        return table.lookup(dest, best, bestIdx) ? best.conn : -1;
+    }
+
+    uint8_t decide(const Connection &best, int bestIdx, const Address &dest) const
+    {
+        switch (decideRoute(isChildren(dest, self), isChildren(best.address, self), bestIdx, matchIndex(match(self, dest))))
+        {
+        case ROUTE_LOCAL:
+            return 0;
+        case ROUTE_NONE:
             return LHRP_PIN_ERROR;
+        default:
+            return best.pin;
+        }
+    }
 
-        return best->pin;
+private:
+    vector<Connection> links;
+    Address self;
+
+    // d = dest packed; the lanes are only current while compiled
+    int linkMatchIndex(size_t i, const AddressLane &d, const Address &dest) const
+    {
+        return compiled() ? lanes.matchIndexAt(i, d, dest.size()) : matchIndex(match(links[i].address, dest));
+    }
+
+    bool linkBelow(size_t i) const
+    {
+        return compiled() ? lanes.below[i] != 0 : isChildren(links[i].address, self);
     }
+    uint32_t compiledGeneration = 0; // generation the table (and lanes) were built for
 };
@@ -1,217 +1,693 @@
 #pragma once
 
 #include <vector>
-#include <Arduino.h>
 #include <algorithm>
 #include <array>
 #include <string.h>
+#include <mutex>
 
 #include <mbedtls/gcm.h>
-#include <esp_system.h>
 
+#include "platform.hpp"
 #include "pocket.hpp"
 
-#define MAX_ADDRESS_DEPTH 15
 #define RAWPACKET_SIZE 250
+#define LHRP_ACK_SIZE 8 // ack top (4) | ack bitmap (4)
+#define LHRP_BEACON_SIZE 4 // beacon seq (2) | rx quality (1) | rssi (1)
+
+// RawPacket::flags (authenticated)
+#define LHRP_FLAG_BATCH 0x01    // rawData holds several sub-records instead of one pocket
+#define LHRP_FLAG_FRAGMENT 0x02 // payload is one fragment of a larger message
+#define LHRP_FLAG_ACK 0x04      // rawData ends with a link ack (LHRP_ACK_SIZE bytes)
+#define LHRP_FLAG_BEACON 0x08   // link-quality beacon for the neighbour, no addresses
+#define LHRP_FLAG_FLOW 0x10     // 2-byte flow id after the addresses (Pocket::flowId)
+#define LHRP_FLAG_MULTICAST 0x20 // destAddress is a prefix: every node under it receives the pocket
+#define LHRP_FLAG_COMPACT 0x40   // src shares a prefix with dest and is sent as suffix only
+#define LHRP_FLAG_COMPRESSED 0x80 // payload is packed by the network's PayloadCodec
+#define LHRP_KNOWN_FLAGS (LHRP_FLAG_BATCH | LHRP_FLAG_FRAGMENT | LHRP_FLAG_ACK | LHRP_FLAG_BEACON | LHRP_FLAG_FLOW | LHRP_FLAG_MULTICAST | LHRP_FLAG_COMPACT | LHRP_FLAG_COMPRESSED)
+#define LHRP_FLOW_SIZE 2
+#define LHRP_POCKET_FLAGS (LHRP_FLAG_FRAGMENT | LHRP_FLAG_MULTICAST | LHRP_FLAG_COMPRESSED) // travel with the pocket end to end
+
+#define LHRP_PREFIX_TRACE 0x10 // compact prefix byte: the pocket ends with a trace area
+#define LHRP_TRACE_RECORD_SIZE 6 // node (2) | queued us (2) | crypto us (2)
+#define LHRP_TRACE_AREA_SIZE (LHRP_TRACE_MAX_HOPS * LHRP_TRACE_RECORD_SIZE + 2) // reserved by the source
+
+#ifndef LHRP_COMPACT_ADDRESSES
+#define LHRP_COMPACT_ADDRESSES 1 // 0 for networks with nodes that do not know LHRP_FLAG_COMPACT
+#endif
 
 /* ============================================================
    Raw packet layout (ESP-NOW safe, PACKED)
    ============================================================ */
 struct __attribute__((packed)) RawPacket
 {
-    uint8_t netId;                                         // 1
-    uint8_t lengths;                                       // 1  (destLen << 4 | srcLen)
-    uint8_t dataLen;                                       // 1  (authenticated!)
-    uint8_t iv[12];                                        // 12
-    uint8_t tag[16];                                       // 16
-    uint8_t rawData[RAWPACKET_SIZE - 1 - 1 - 1 - 12 - 16]; // 219
+    uint8_t netId;                                             // 1
+    uint8_t flags;                                             // 1  (LHRP_FLAG_*)
+    uint8_t lengths;                                           // 1  (destLen << 4 | srcLen sent, see LHRP_FLAG_COMPACT)
+    uint8_t dataLen;                                           // 1  (authenticated!)
+    uint8_t iv[12];                                            // 12
+    uint8_t tag[16];                                           // 16
+    uint8_t rawData[RAWPACKET_SIZE - 1 - 1 - 1 - 1 - 12 - 16]; // 218
 };
 
+#define RAWPACKET_HEADER_SIZE (RAWPACKET_SIZE - sizeof(RawPacket::rawData)) // 32
+
 static_assert(sizeof(RawPacket) == RAWPACKET_SIZE, "RawPacket size mismatch");
+static_assert(sizeof(RawPacket::rawData) - 4 == MAX_POCKET_PAYLOAD, "Pocket payload capacity mismatch");
 
 /* ============================================================
-   AES-GCM helpers (WITH AAD)
+   AES-GCM (WITH AAD), key schedule is kept between packets
    ============================================================ */
-inline bool aesGcmEncrypt(
-    uint8_t *data,
-    size_t len,
-    const uint8_t key[16],
-    uint8_t iv[12],
-    uint8_t tag[16],
-    const uint8_t *aad,
-    size_t aadLen)
+struct AesGcm
 {
+    AesGcm() { mbedtls_gcm_init(&ctx); }
+    ~AesGcm() { mbedtls_gcm_free(&ctx); }
+
+    AesGcm(const AesGcm &) = delete;
+    AesGcm &operator=(const AesGcm &) = delete;
+
+    // rebuilds the key schedule / GHASH tables only if the key changed
+    bool setKey(const std::array<uint8_t, 16> &key)
+    {
+        lock_guard<mutex> guard(lock);
+
+        if (ready && key == currentKey)
+            return true;
+
+        ready = mbedtls_gcm_setkey(&ctx, MBEDTLS_CIPHER_ID_AES, key.data(), 128) == 0;
+        currentKey = key;
+        return ready;
+    }
+
+    bool encrypt(
+        uint8_t *data,
+        size_t len,
+        uint8_t iv[12],
+        uint8_t tag[16],
+        const uint8_t *aad,
+        size_t aadLen)
+    {
+        platformRandom(iv, 12);
+
+        lock_guard<mutex> guard(lock);
+        if (!ready)
+            return false;
+
+        int rc = mbedtls_gcm_crypt_and_tag(
+            &ctx,
+            MBEDTLS_GCM_ENCRYPT,
+            len,
+            iv, 12,
+            aad, aadLen,
+            data, data,
+            16, tag);
+
+        return rc == 0;
+    }
+
+    bool decrypt(
+        uint8_t *data,
+        size_t len,
+        const uint8_t iv[12],
+        const uint8_t tag[16],
+        const uint8_t *aad,
+        size_t aadLen)
+    {
+        lock_guard<mutex> guard(lock);
+        if (!ready)
+            return false;
+
+        int rc = mbedtls_gcm_auth_decrypt(
+            &ctx,
+            len,
+            iv, 12,
+            aad, aadLen,
+            tag, 16,
+            data, data);
+
+        return rc == 0;
+    }
+
+private:
+    // send path and ESP-NOW receive callback share the context
+    mutex lock;
     mbedtls_gcm_context ctx;
-    mbedtls_gcm_init(&ctx);
+    std::array<uint8_t, 16> currentKey{};
+    bool ready = false;
+};
 
-    if (mbedtls_gcm_setkey(&ctx, MBEDTLS_CIPHER_ID_AES, key, 128) != 0)
-        return false;
+/* ============================================================
+   Address block after the seq
+     plain:             | dest | src |
+     LHRP_FLAG_COMPACT: | ext << 4 | common | dest | src[common..] |
+   lengths holds dest length and the length of the src part that is
+   sent; ext holds LHRP_PREFIX_TRACE, the other bits must be 0.
+   Traced pockets always use the compact form
+   ============================================================ */
+inline uint8_t addressCommonPrefix(const Address &dest, const Address &src)
+{
+    size_t n = min(min(dest.size(), src.size()), (size_t)MAX_ADDRESS_DEPTH);
+    uint8_t common = 0;
+    while (common < n && dest[common] == src[common])
+        common++;
+    return common;
+}
 
-    esp_fill_random(iv, 12);
+// bytes the addresses take, common = addressCommonPrefix() (compact pays off from 2 on)
+inline size_t addressBlockSize(uint8_t dstLen, uint8_t srcLen, uint8_t common, bool trace = false)
+{
+    if (trace || (LHRP_COMPACT_ADDRESSES && common >= 2))
+        return 1 + dstLen + srcLen - common;
+    return dstLen + srcLen;
+}
 
-    int rc = mbedtls_gcm_crypt_and_tag(
-        &ctx,
-        MBEDTLS_GCM_ENCRYPT,
-        len,
-        iv, 12,
-        aad, aadLen,
-        data, data,
-        16, tag);
+// plaintext frame, sets lengths and LHRP_FLAG_COMPACT, returns the bytes written at out
+inline size_t writeAddresses(RawPacket &r, uint8_t *out, const Address &dest, const Address &src, bool trace = false)
+{
+    uint8_t dstLen = min((size_t)MAX_ADDRESS_DEPTH, dest.size());
+    uint8_t srcLen = min((size_t)MAX_ADDRESS_DEPTH, src.size());
+    uint8_t common = addressCommonPrefix(dest, src);
+    uint8_t *start = out;
+
+    if (!trace && addressBlockSize(dstLen, srcLen, common) == dstLen + srcLen)
+        common = 0;
+    else
+    {
+        r.flags |= LHRP_FLAG_COMPACT;
+        *out++ = (trace ? LHRP_PREFIX_TRACE : 0) | common;
+    }
+
+    r.lengths = (dstLen << 4) | (srcLen - common);
+    memcpy(out, dest.data(), dstLen);
+    out += dstLen;
+    memcpy(out, src.data() + common, srcLen - common);
+    out += srcLen - common;
+
+    return out - start;
+}
 
-    mbedtls_gcm_free(&ctx);
-    return rc == 0;
+// only valid on an opened packet, returns the offset behind the addresses
+inline size_t readAddresses(const RawPacket &r, Address &dest, Address &src)
+{
+    uint8_t dstLen = r.lengths >> 4;
+    uint8_t srcLen = r.lengths & 0x0F;
+    const uint8_t *in = r.rawData + 4;
+
+    uint8_t common = 0;
+    if (r.flags & LHRP_FLAG_COMPACT)
+        common = *in++ & 0x0F; // checked by openRawPacket
+
+    dest.assign(in, in + dstLen);
+    src.assign(in, in + common);
+    in += dstLen;
+    for (size_t i = 0; i < srcLen; i++)
+        src.push_back(in[i]);
+
+    return in + srcLen - r.rawData;
 }
 
-inline bool aesGcmDecrypt(
-    uint8_t *data,
-    size_t len,
-    const uint8_t key[16],
-    const uint8_t iv[12],
-    const uint8_t tag[16],
-    const uint8_t *aad,
-    size_t aadLen)
+// after decryption: the prefix byte fits the lengths
+inline bool compactAddressesValid(const RawPacket &r)
 {
-    mbedtls_gcm_context ctx;
-    mbedtls_gcm_init(&ctx);
+    if (!(r.flags & LHRP_FLAG_COMPACT))
+        return true;
+
+    uint8_t prefix = r.rawData[4];
+    uint8_t common = prefix & 0x0F;
+    return (prefix & ~(LHRP_PREFIX_TRACE | 0x0F)) == 0 && common <= (r.lengths >> 4) &&
+           common + (r.lengths & 0x0F) <= MAX_ADDRESS_DEPTH;
+}
+
+/* ============================================================
+   Trace area (LHRP_PREFIX_TRACE) at the end of the pocket,
+   in front of an ack trailer:
+     | record * records | records | hops |
+     record: | node | queued us | crypto us | (big-endian)
+   every node adds its record when it opens the frame and fills in
+   the queued time when it seals or delivers it; once the area is
+   full later nodes only count in hops
+   ============================================================ */
+inline bool rawTraced(const RawPacket &r)
+{
+    return (r.flags & LHRP_FLAG_COMPACT) && (r.rawData[4] & LHRP_PREFIX_TRACE);
+}
+
+inline uint16_t traceMicros(uint32_t us)
+{
+    return us < 0xFFFF ? us : 0xFFFF;
+}
+
+inline size_t rawTraceEnd(const RawPacket &r)
+{
+    return r.dataLen - ((r.flags & LHRP_FLAG_ACK) ? LHRP_ACK_SIZE : 0);
+}
+
+// bytes of the area, 0 if the pocket is not traced
+inline size_t rawTraceSize(const RawPacket &r)
+{
+    if (!rawTraced(r))
+        return 0;
+    return r.rawData[rawTraceEnd(r) - 2] * LHRP_TRACE_RECORD_SIZE + 2;
+}
+
+// after decryption: the area fits behind the addresses (and flow id)
+inline bool traceAreaValid(const RawPacket &r)
+{
+    if (!rawTraced(r))
+        return true;
 
-    if (mbedtls_gcm_setkey(&ctx, MBEDTLS_CIPHER_ID_AES, key, 128) != 0)
+    size_t start = 4 + 1 + (r.lengths >> 4) + (r.lengths & 0x0F) + ((r.flags & LHRP_FLAG_FLOW) ? LHRP_FLOW_SIZE : 0);
+    size_t end = rawTraceEnd(r);
+    if (end < start + 2)
         return false;
 
-    int rc = mbedtls_gcm_auth_decrypt(
-        &ctx,
-        len,
-        iv, 12,
-        aad, aadLen,
-        tag, 16,
-        data, data);
+    uint8_t records = r.rawData[end - 2];
+    uint8_t hops = r.rawData[end - 1];
+    return records <= hops && start + rawTraceSize(r) <= end;
+}
+
+// plaintext frame, room is reserved by maxPayloadSizePocket()
+inline void beginTraceArea(RawPacket &r)
+{
+    r.rawData[r.dataLen++] = 0; // records
+    r.rawData[r.dataLen++] = 0; // hops
+}
+
+// opened frame after stripAckTrailer, or plaintext before sealing; the
+// record is left out if an earlier node did not fit or the area is full
+inline void appendTraceHop(RawPacket &r, uint16_t node, uint16_t cryptoUs)
+{
+    uint8_t *tail = r.rawData + r.dataLen - 2;
+    uint8_t records = tail[0];
+    uint8_t hops = tail[1];
+
+    if (records == hops && records < LHRP_TRACE_MAX_HOPS &&
+        (size_t)r.dataLen + LHRP_TRACE_RECORD_SIZE <= sizeof(r.rawData))
+    {
+        uint16_t fields[3] = {node, 0, cryptoUs};
+        for (int i = 0; i < 3; i++)
+        {
+            *tail++ = fields[i] >> 8;
+            *tail++ = fields[i] & 0xFF;
+        }
+        r.dataLen += LHRP_TRACE_RECORD_SIZE;
+        records++;
+    }
+
+    tail[0] = records;
+    tail[1] = hops < 255 ? hops + 1 : hops;
+}
+
+// plaintext frame before the ack trailer and sealing: completes the record of
+// the node that appended last, elapsedUs = since it received (or sent) the frame
+inline void finishTraceHop(RawPacket &r, uint32_t elapsedUs, uint32_t sealUs)
+{
+    uint8_t *tail = r.rawData + r.dataLen - 2;
+    if (tail[0] == 0 || tail[0] != tail[1])
+        return; // not our record
+
+    uint8_t *record = tail - LHRP_TRACE_RECORD_SIZE;
+    uint16_t crypto = (record[4] << 8) | record[5];
+    uint16_t queued = traceMicros(elapsedUs > crypto ? elapsedUs - crypto : 0);
+    crypto = traceMicros(crypto + sealUs);
+
+    record[2] = queued >> 8;
+    record[3] = queued & 0xFF;
+    record[4] = crypto >> 8;
+    record[5] = crypto & 0xFF;
+}
+
+// only valid on an opened packet (after stripAckTrailer)
+inline void readTraceHops(const RawPacket &r, Pocket &p)
+{
+    p.trace = rawTraced(r);
+    p.hops.clear();
+    p.hopCount = 0;
+    if (!p.trace)
+        return;
+
+    const uint8_t *tail = r.rawData + r.dataLen - 2;
+    const uint8_t *in = tail - tail[0] * LHRP_TRACE_RECORD_SIZE;
+    for (; in < tail; in += LHRP_TRACE_RECORD_SIZE)
+        p.hops.push_back({(uint16_t)((in[0] << 8) | in[1]), (uint16_t)((in[2] << 8) | in[3]),
+                          (uint16_t)((in[4] << 8) | in[5])});
+    p.hopCount = tail[1];
+}
+
+// destination side of finishTraceHop(), on the received pocket
+inline void finishTraceHop(Pocket &p, uint32_t elapsedUs)
+{
+    if (p.hops.empty() || p.hops.size() != p.hopCount)
+        return;
 
-    mbedtls_gcm_free(&ctx);
-    return rc == 0;
+    TraceHop &hop = p.hops[p.hops.size() - 1];
+    hop.queuedUs = traceMicros(elapsedUs > hop.cryptoUs ? elapsedUs - hop.cryptoUs : 0);
 }
 
 /* ============================================================
    Max payload calculation
    ============================================================ */
-inline uint8_t maxPayloadSizePocket(const Address &src, const Address &dst)
+inline uint8_t maxPayloadSizePocket(const Address &src, const Address &dst, bool flow = false, bool trace = false)
 {
     uint8_t srcLen = min((size_t)MAX_ADDRESS_DEPTH, src.size());
     uint8_t dstLen = min((size_t)MAX_ADDRESS_DEPTH, dst.size());
+    size_t addresses = addressBlockSize(dstLen, srcLen, addressCommonPrefix(dst, src), trace);
 
-    size_t used = 4 + srcLen + dstLen; // seq + addresses
+    // seq + addresses (+ flow id) (+ trace area)
+    size_t used = 4 + addresses + (flow ? LHRP_FLOW_SIZE : 0) + (trace ? LHRP_TRACE_AREA_SIZE : 0);
     if (used >= sizeof(RawPacket::rawData))
         return 0;
 
     return sizeof(RawPacket::rawData) - used;
 }
 
-/* ============================================================
-   Serialize Pocket (SAFE)
-   ============================================================ */
-inline RawPacket serializePocket(
-    const Pocket &p,
-    uint8_t netId,
-    const std::array<uint8_t, 16> &key,
-    uint32_t seq)
+// on-air length: header + the used part of rawData
+inline size_t rawPacketSize(const RawPacket &r)
 {
-    RawPacket r{};
-    r.netId = netId;
+    return RAWPACKET_HEADER_SIZE + r.dataLen;
+}
 
-    uint8_t srcLen = min((size_t)MAX_ADDRESS_DEPTH, p.srcAddress.size());
-    uint8_t dstLen = min((size_t)MAX_ADDRESS_DEPTH, p.destAddress.size());
-    r.lengths = (dstLen << 4) | srcLen;
+// received length must match the (authenticated) dataLen exactly
+inline bool rawPacketLengthValid(const uint8_t *data, int len)
+{
+    if (len < (int)RAWPACKET_HEADER_SIZE || len > (int)sizeof(RawPacket))
+        return false;
 
-    size_t offset = 0;
+    const RawPacket *r = (const RawPacket *)data;
+    return (size_t)len == rawPacketSize(*r);
+}
 
+/* ============================================================
+   Seal / open a RawPacket in place
+   ============================================================ */
+inline void writeRawSeq(RawPacket &r, uint32_t seq)
+{
     // seq (big-endian)
-    r.rawData[offset++] = (seq >> 24) & 0xFF;
-    r.rawData[offset++] = (seq >> 16) & 0xFF;
-    r.rawData[offset++] = (seq >> 8) & 0xFF;
-    r.rawData[offset++] = seq & 0xFF;
-
-    memcpy(r.rawData + offset, p.destAddress.data(), dstLen);
-    offset += dstLen;
-
-    memcpy(r.rawData + offset, p.srcAddress.data(), srcLen);
-    offset += srcLen;
+    r.rawData[0] = (seq >> 24) & 0xFF;
+    r.rawData[1] = (seq >> 16) & 0xFF;
+    r.rawData[2] = (seq >> 8) & 0xFF;
+    r.rawData[3] = seq & 0xFF;
+}
 
-    size_t maxPayload = sizeof(r.rawData) - offset;
-    size_t payloadLen = min(maxPayload, p.payload.size());
-    memcpy(r.rawData + offset, p.payload.data(), payloadLen);
-    offset += payloadLen;
+inline uint32_t readRawSeq(const RawPacket &r)
+{
+    return (uint32_t(r.rawData[0]) << 24) |
+           (uint32_t(r.rawData[1]) << 16) |
+           (uint32_t(r.rawData[2]) << 8) |
+           uint32_t(r.rawData[3]);
+}
 
-    r.dataLen = offset;
+// sets seq and encrypts rawData[0..dataLen) with a fresh IV
+inline bool sealRawPacket(RawPacket &r, AesGcm &gcm, uint32_t seq)
+{
+    writeRawSeq(r, seq);
 
-    uint8_t aad[3] = {r.netId, r.lengths, r.dataLen};
+    uint8_t aad[4] = {r.netId, r.flags, r.lengths, r.dataLen};
 
-    aesGcmEncrypt(
+    return gcm.encrypt(
         r.rawData,
         r.dataLen,
-        key.data(),
         r.iv,
         r.tag,
         aad,
         sizeof(aad));
-
-    return r;
 }
 
-/* ============================================================
-   Deserialize Pocket (SAFE)
-   ============================================================ */
-inline Pocket deserializePocket(
-    const RawPacket &r,
-    uint8_t expectedNetId,
-    const std::array<uint8_t, 16> &key)
+enum OpenResult
 {
-    Pocket p{};
-    p.errored = true;
+    OPEN_OK,
+    OPEN_NETID,     // other network
+    OPEN_MALFORMED, // unknown flags or lengths that do not fit
+    OPEN_AUTH,      // tag did not verify
+};
 
+// validates the header and decrypts rawData in place
+inline OpenResult openRawPacketChecked(RawPacket &r, uint8_t expectedNetId, AesGcm &gcm)
+{
     if (r.netId != expectedNetId)
-        return p;
+        return OPEN_NETID;
+
+    if (r.flags & ~LHRP_KNOWN_FLAGS)
+        return OPEN_MALFORMED;
 
     if (r.dataLen < 4 || r.dataLen > sizeof(r.rawData))
-        return p;
+        return OPEN_MALFORMED;
 
     uint8_t dstLen = r.lengths >> 4;
     uint8_t srcLen = r.lengths & 0x0F;
 
     if (dstLen > MAX_ADDRESS_DEPTH || srcLen > MAX_ADDRESS_DEPTH)
-        return p;
+        return OPEN_MALFORMED;
 
-    if (4 + dstLen + srcLen > r.dataLen)
-        return p;
+    size_t trailer = (r.flags & LHRP_FLAG_ACK) ? LHRP_ACK_SIZE : 0;
+    size_t flow = (r.flags & LHRP_FLAG_FLOW) ? LHRP_FLOW_SIZE : 0;
+    size_t prefix = (r.flags & LHRP_FLAG_COMPACT) ? 1 : 0;
+    if (4 + prefix + dstLen + srcLen + flow + trailer > r.dataLen)
+        return OPEN_MALFORMED;
 
-    RawPacket tmp = r;
+    uint8_t aad[4] = {r.netId, r.flags, r.lengths, r.dataLen};
 
-    uint8_t aad[3] = {tmp.netId, tmp.lengths, tmp.dataLen};
+    if (!gcm.decrypt(r.rawData, r.dataLen, r.iv, r.tag, aad, sizeof(aad)))
+        return OPEN_AUTH;
 
-    if (!aesGcmDecrypt(
-            tmp.rawData,
-            tmp.dataLen,
-            key.data(),
-            tmp.iv,
-            tmp.tag,
-            aad,
-            sizeof(aad)))
-        return p;
+    return compactAddressesValid(r) && traceAreaValid(r) ? OPEN_OK : OPEN_MALFORMED;
+}
+
+inline bool openRawPacket(RawPacket &r, uint8_t expectedNetId, AesGcm &gcm)
+{
+    return openRawPacketChecked(r, expectedNetId, gcm) == OPEN_OK;
+}
+
+/* ============================================================
+   Link acks (LHRP_FLAG_ACK): appended to any frame for the peer,
+   or sent alone as a frame without addresses and payload
+   ============================================================ */
+// plaintext frame, before sealRawPacket; false if there is no room
+inline bool appendAckTrailer(RawPacket &r, uint32_t top, uint32_t bits)
+{
+    if (r.flags & LHRP_FLAG_ACK || (size_t)r.dataLen + LHRP_ACK_SIZE > sizeof(r.rawData))
+        return false;
+
+    uint8_t *out = r.rawData + r.dataLen;
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] = top >> (24 - 8 * i);
+        out[4 + i] = bits >> (24 - 8 * i);
+    }
+
+    r.dataLen += LHRP_ACK_SIZE;
+    r.flags |= LHRP_FLAG_ACK;
+    return true;
+}
+
+// only valid on an opened packet with LHRP_FLAG_ACK, leaves the frame as it was before appendAckTrailer
+inline void stripAckTrailer(RawPacket &r, uint32_t &top, uint32_t &bits)
+{
+    r.dataLen -= LHRP_ACK_SIZE;
+    r.flags &= ~LHRP_FLAG_ACK;
+
+    const uint8_t *in = r.rawData + r.dataLen;
+    top = 0;
+    bits = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        top = (top << 8) | in[i];
+        bits = (bits << 8) | in[4 + i];
+    }
+}
+
+inline void beginAckPacket(RawPacket &r, uint8_t netId)
+{
+    r.netId = netId;
+    r.flags = 0;
+    r.lengths = 0;
+    r.dataLen = 4; // seq
+}
+
+/* ============================================================
+   Beacons (LHRP_FLAG_BEACON): | beacon seq | rx quality | rssi |
+   rx quality / rssi describe how the sender hears the receiver
+   ============================================================ */
+inline void buildBeaconPacket(RawPacket &r, uint8_t netId, uint16_t beaconSeq, uint8_t rxQuality, int8_t rssi)
+{
+    r.netId = netId;
+    r.flags = LHRP_FLAG_BEACON;
+    r.lengths = 0;
+    r.rawData[4] = beaconSeq >> 8;
+    r.rawData[5] = beaconSeq & 0xFF;
+    r.rawData[6] = rxQuality;
+    r.rawData[7] = (uint8_t)rssi;
+    r.dataLen = 4 + LHRP_BEACON_SIZE;
+}
+
+// only valid on an opened packet (after stripAckTrailer)
+inline bool readBeacon(const RawPacket &r, uint16_t &beaconSeq, uint8_t &rxQuality, int8_t &rssi)
+{
+    if (!(r.flags & LHRP_FLAG_BEACON) || r.lengths != 0 || r.dataLen != 4 + LHRP_BEACON_SIZE)
+        return false;
+
+    beaconSeq = (r.rawData[4] << 8) | r.rawData[5];
+    rxQuality = r.rawData[6];
+    rssi = (int8_t)r.rawData[7];
+    return true;
+}
+
+// after stripAckTrailer: nothing left to deliver or route
+inline bool rawPacketEmpty(const RawPacket &r)
+{
+    return r.dataLen == 4 && r.lengths == 0 && !(r.flags & LHRP_FLAG_BATCH);
+}
+
+// only valid on an opened packet: everything a relay needs for the next hop
+inline void readRawRoute(const RawPacket &r, Address &dest, Address &src, uint16_t &flowId)
+{
+    const uint8_t *in = r.rawData + readAddresses(r, dest, src);
+    flowId = (r.flags & LHRP_FLAG_FLOW) ? (in[0] << 8) | in[1] : 0;
+}
+
+// only valid on an opened packet
+inline void readRawPocket(const RawPacket &r, Pocket &p)
+{
+    p.seq = readRawSeq(r);
+
+    size_t offset = readAddresses(r, p.destAddress, p.srcAddress);
+
+    p.flowId = 0;
+    if (r.flags & LHRP_FLAG_FLOW)
+    {
+        p.flowId = (r.rawData[offset] << 8) | r.rawData[offset + 1];
+        offset += LHRP_FLOW_SIZE;
+    }
+
+    p.payload.assign(r.rawData + offset, r.rawData + r.dataLen - rawTraceSize(r));
+    p.flags = r.flags & LHRP_POCKET_FLAGS;
+    p.errored = false;
+    readTraceHops(r, p);
+}
+
+/* ============================================================
+   Batch frames (LHRP_FLAG_BATCH): several pockets for the same
+   next hop, each as | lengths | payloadLen | dest | src | payload |
+   ============================================================ */
+inline void beginBatchPacket(RawPacket &r, uint8_t netId)
+{
+    r.netId = netId;
+    r.flags = LHRP_FLAG_BATCH;
+    r.lengths = 0;
+    r.dataLen = 4; // seq
+}
+
+// false if the record does not fit anymore
+inline bool appendBatchRecord(RawPacket &r, const Pocket &p)
+{
+    if (p.flags || p.flowId || p.trace)
+        return false; // records carry no flags
 
-    size_t offset = 0;
+    uint8_t srcLen = min((size_t)MAX_ADDRESS_DEPTH, p.srcAddress.size());
+    uint8_t dstLen = min((size_t)MAX_ADDRESS_DEPTH, p.destAddress.size());
+    size_t recordLen = 2 + dstLen + srcLen + p.payload.size();
 
-    p.seq =
-        (uint32_t(tmp.rawData[offset++]) << 24) |
-        (uint32_t(tmp.rawData[offset++]) << 16) |
-        (uint32_t(tmp.rawData[offset++]) << 8) |
-        uint32_t(tmp.rawData[offset++]);
+    if (r.dataLen + recordLen > sizeof(r.rawData))
+        return false;
 
-    for (uint8_t i = 0; i < dstLen; i++)
-        p.destAddress.push_back(tmp.rawData[offset++]);
+    uint8_t *out = r.rawData + r.dataLen;
+    *out++ = (dstLen << 4) | srcLen;
+    *out++ = p.payload.size();
+    memcpy(out, p.destAddress.data(), dstLen);
+    out += dstLen;
+    memcpy(out, p.srcAddress.data(), srcLen);
+    out += srcLen;
+    memcpy(out, p.payload.data(), p.payload.size());
+
+    r.dataLen += recordLen;
+    return true;
+}
 
-    for (uint8_t i = 0; i < srcLen; i++)
-        p.srcAddress.push_back(tmp.rawData[offset++]);
+// only valid on an opened batch packet, offset starts at 4
+inline bool readBatchRecord(const RawPacket &r, size_t &offset, Pocket &p)
+{
+    if (offset + 2 > r.dataLen)
+        return false;
 
-    while (offset < tmp.dataLen)
-        p.payload.push_back(tmp.rawData[offset++]);
+    uint8_t dstLen = r.rawData[offset] >> 4;
+    uint8_t srcLen = r.rawData[offset] & 0x0F;
+    uint8_t payloadLen = r.rawData[offset + 1];
+    const uint8_t *in = r.rawData + offset + 2;
 
+    size_t recordLen = 2 + dstLen + srcLen + payloadLen;
+    if (offset + recordLen > r.dataLen)
+        return false;
+
+    p.seq = readRawSeq(r);
+    p.destAddress.assign(in, in + dstLen);
+    in += dstLen;
+    p.srcAddress.assign(in, in + srcLen);
+    in += srcLen;
+    p.payload.assign(in, in + payloadLen);
+    p.flags = 0;
+    p.flowId = 0;
     p.errored = false;
+
+    offset += recordLen;
+    return true;
+}
+
+/* ============================================================
+   Serialize Pocket (SAFE)
+   ============================================================ */
+// plaintext frame, seq and encryption are added by sealRawPacket
+inline RawPacket buildRawPacket(const Pocket &p, uint8_t netId)
+{
+    RawPacket r{};
+    r.netId = netId;
+    r.flags = (p.flags & LHRP_POCKET_FLAGS) | (p.flowId ? LHRP_FLAG_FLOW : 0);
+
+    size_t offset = 4; // seq
+    offset += writeAddresses(r, r.rawData + offset, p.destAddress, p.srcAddress, p.trace);
+
+    if (p.flowId)
+    {
+        r.rawData[offset++] = p.flowId >> 8;
+        r.rawData[offset++] = p.flowId & 0xFF;
+    }
+
+    size_t maxPayload = sizeof(r.rawData) - offset - (p.trace ? LHRP_TRACE_AREA_SIZE : 0);
+    size_t payloadLen = min(maxPayload, p.payload.size());
+    memcpy(r.rawData + offset, p.payload.data(), payloadLen);
+    offset += payloadLen;
+
+    r.dataLen = offset;
+    if (p.trace)
+        beginTraceArea(r);
+    return r;
+}
+
+inline RawPacket serializePocket(
+    const Pocket &p,
+    uint8_t netId,
+    AesGcm &gcm,
+    uint32_t seq)
+{
+    RawPacket r = buildRawPacket(p, netId);
+    sealRawPacket(r, gcm, seq);
+    return r;
+}
+
+/* ============================================================
+   Deserialize Pocket (SAFE)
+   ============================================================ */
+inline Pocket deserializePocket(
+    const RawPacket &r,
+    uint8_t expectedNetId,
+    AesGcm &gcm)
+{
+    Pocket p{};
+    p.errored = true;
+
+    RawPacket tmp = r;
+    if (!openRawPacket(tmp, expectedNetId, gcm))
+        return p;
+
+    readRawPocket(tmp, p);
     return p;
 }
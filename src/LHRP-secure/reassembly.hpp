@@ -0,0 +1,380 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <string.h>
+
+#include "platform.hpp"
+#include "pocket.hpp"
+#include "protocol.hpp"
+
+#define LHRP_FRAGMENT_HEADER 6              // msgId (2) | index (2) | count (2)
+#define LHRP_REASSEMBLY_SLOTS 4             // concurrent messages being received
+#define LHRP_REASSEMBLY_PER_SOURCE 2        // of those from one source, its oldest is evicted for a new one
+#define LHRP_REASSEMBLY_WINDOW 8            // out-of-order fragments buffered per message
+#define LHRP_REASSEMBLY_TIMEOUT_MS 2000     // idle messages are aborted after this
+
+using namespace std;
+
+// one in-order piece of a fragmented message
+struct StreamChunk
+{
+    const Address &src;
+    uint16_t msgId;
+    uint32_t offset; // of data within the message
+    const uint8_t *data;
+    size_t len;
+    bool last;    // message complete
+    bool aborted; // timed out or evicted, no data
+};
+
+inline void writeFragmentHeader(uint8_t *out, uint16_t msgId, uint16_t index, uint16_t count)
+{
+    out[0] = msgId >> 8;
+    out[1] = msgId & 0xFF;
+    out[2] = index >> 8;
+    out[3] = index & 0xFF;
+    out[4] = count >> 8;
+    out[5] = count & 0xFF;
+}
+
+/* ============================================================
+   Streaming reassembly: fragments are handed out in order as
+   soon as they are contiguous, only gaps are buffered.
+   The callback runs without the lock (it may send, even to
+   ourselves); per message the chunks stay in order, different
+   messages may be handed out from different threads at once.
+   ============================================================ */
+struct Reassembler
+{
+    function<void(const StreamChunk &)> callback;
+
+    void begin()
+    {
+        lock_guard<mutex> guard(lock);
+        slots.assign(LHRP_REASSEMBLY_SLOTS, Slot{});
+    }
+
+    // p is a local pocket with LHRP_FLAG_FRAGMENT; false if the fragment was not
+    // taken (handed out or buffered), e.g. without a callback or as a duplicate
+    bool receive(const Pocket &p)
+    {
+        if (p.payload.size() < LHRP_FRAGMENT_HEADER)
+            return false;
+
+        const uint8_t *h = p.payload.data();
+        uint16_t msgId = (h[0] << 8) | h[1];
+        uint16_t index = (h[2] << 8) | h[3];
+        uint16_t count = (h[4] << 8) | h[5];
+        const uint8_t *data = h + LHRP_FRAGMENT_HEADER;
+        size_t len = p.payload.size() - LHRP_FRAGMENT_HEADER;
+
+        if (count == 0 || index >= count)
+            return false;
+
+        Aborts aborts;
+        Slot *s = nullptr;
+        bool taken;
+        {
+            lock_guard<mutex> guard(lock);
+            if (slots.empty() || !callback)
+                return false;
+
+            uint32_t now = platformMillis();
+            expire(now, aborts);
+            taken = accept(p.srcAddress, msgId, index, count, data, len, now, aborts, s);
+        }
+
+        report(aborts);
+        if (s)
+            drain(*s, data, len);
+        return taken;
+    }
+
+    // false if receive() could not take the fragment now: an earlier one is still
+    // missing (too far ahead) or there is no slot. With link acks it is then not
+    // acknowledged, the previous hop sends it again later.
+    bool fits(const Pocket &p)
+    {
+        if (p.payload.size() < LHRP_FRAGMENT_HEADER)
+            return true; // dropped by receive() anyway
+
+        const uint8_t *h = p.payload.data();
+        uint16_t msgId = (h[0] << 8) | h[1];
+        uint16_t index = (h[2] << 8) | h[3];
+
+        lock_guard<mutex> guard(lock);
+        if (slots.empty() || !callback)
+            return true;
+
+        if (Slot *s = find(p.srcAddress, msgId))
+            return index < s->nextIndex + LHRP_REASSEMBLY_WINDOW;
+
+        if (index >= LHRP_REASSEMBLY_WINDOW)
+            return false; // the start is still on its way
+
+        if (held(p.srcAddress) < LHRP_REASSEMBLY_PER_SOURCE)
+            for (auto &s : slots)
+                if (!s.used)
+                    return true;
+        return victim(p.srcAddress) != nullptr;
+    }
+
+    // aborts idle messages even if no fragment arrives any more (timer)
+    void expire()
+    {
+        Aborts aborts;
+        {
+            lock_guard<mutex> guard(lock);
+            if (slots.empty() || !callback)
+                return;
+            expire(platformMillis(), aborts);
+        }
+        report(aborts);
+    }
+
+private:
+    struct Fragment
+    {
+        uint8_t data[MAX_POCKET_PAYLOAD];
+        uint8_t len = 0;
+        uint16_t index = 0;
+        bool used = false;
+    };
+
+    struct Slot
+    {
+        Address src;
+        uint16_t msgId = 0;
+        uint16_t count = 0;
+        uint16_t nextIndex = 0; // only moves once the chunks before it are handed out
+        uint32_t offset = 0;
+        uint32_t lastActivity = 0;
+        bool used = false;
+        bool busy = false; // a thread is handing out chunks, the slot must not be reused
+        Fragment pending[LHRP_REASSEMBLY_WINDOW];
+    };
+
+    struct Piece
+    {
+        const uint8_t *data;
+        size_t len;
+    };
+
+    // messages given up under the lock, reported after it
+    struct Aborts
+    {
+        struct Entry
+        {
+            Address src;
+            uint16_t msgId;
+            uint32_t offset;
+        };
+
+        Entry entries[LHRP_REASSEMBLY_SLOTS];
+        size_t count = 0;
+    };
+
+    vector<Slot> slots; // empty until begin()
+    mutex lock;
+
+    // lock held; false if the fragment is dropped. `drain` is set if the caller
+    // hands out `data` (and what follows it), it stays nullptr if it was buffered
+    bool accept(const Address &src, uint16_t msgId, uint16_t index, uint16_t count,
+                const uint8_t *data, size_t len, uint32_t now, Aborts &aborts, Slot *&drain)
+    {
+        Slot *s = find(src, msgId);
+        if (!s)
+        {
+            if (index >= LHRP_REASSEMBLY_WINDOW)
+                return false; // start of the message is long gone
+            s = allocate(src, msgId, count, aborts);
+            if (!s)
+                return false;
+        }
+
+        s->lastActivity = now;
+
+        if (index < s->nextIndex || index >= s->nextIndex + LHRP_REASSEMBLY_WINDOW)
+            return false; // duplicate or too far ahead
+
+        if (index == s->nextIndex)
+        {
+            if (s->busy)
+                return false; // duplicate of the chunk being handed out
+            s->busy = true;
+            drain = s;
+            return true;
+        }
+
+        // behind a gap; the window does not move while busy, so no buffer
+        // that is being handed out can be overwritten here
+        Fragment &f = s->pending[index % LHRP_REASSEMBLY_WINDOW];
+        if (f.used)
+            return false; // duplicate
+        f.used = true;
+        f.index = index;
+        f.len = len;
+        memcpy(f.data, data, len);
+        return true;
+    }
+
+    // s is busy: hands out `data` and every fragment that became contiguous, unlocked
+    void drain(Slot &s, const uint8_t *data, size_t len)
+    {
+        Piece run[LHRP_REASSEMBLY_WINDOW];
+        size_t n = 0;
+        run[n++] = {data, len};
+
+        uint16_t first;
+        uint32_t offset;
+        {
+            lock_guard<mutex> guard(lock);
+            collect(s, run, n);
+            first = s.nextIndex;
+            offset = s.offset;
+        }
+
+        for (;;)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                bool last = first + i + 1 == s.count;
+                StreamChunk c{s.src, s.msgId, offset, run[i].data, run[i].len, last, false};
+                offset += run[i].len;
+                callback(c);
+            }
+
+            lock_guard<mutex> guard(lock);
+            for (size_t i = 0; i < n; i++)
+            {
+                Fragment &f = s.pending[(first + i) % LHRP_REASSEMBLY_WINDOW];
+                if (f.used && f.index == first + i)
+                    f.used = false;
+            }
+
+            s.nextIndex = first + n;
+            s.offset = offset;
+            if (s.nextIndex == s.count)
+            {
+                s.used = false;
+                s.busy = false;
+                return;
+            }
+
+            // stored by other threads meanwhile
+            n = 0;
+            collect(s, run, n);
+            if (n == 0)
+            {
+                s.busy = false;
+                return;
+            }
+            first = s.nextIndex;
+        }
+    }
+
+    // lock held: the fragments after run[0..n) that are contiguous with s.nextIndex
+    void collect(Slot &s, Piece *run, size_t &n)
+    {
+        while (n < LHRP_REASSEMBLY_WINDOW)
+        {
+            uint16_t index = s.nextIndex + n;
+            Fragment &f = s.pending[index % LHRP_REASSEMBLY_WINDOW];
+            if (!f.used || f.index != index)
+                break;
+            run[n++] = {f.data, f.len};
+        }
+    }
+
+    void report(const Aborts &aborts)
+    {
+        for (size_t i = 0; i < aborts.count; i++)
+        {
+            const Aborts::Entry &e = aborts.entries[i];
+            StreamChunk c{e.src, e.msgId, e.offset, nullptr, 0, false, true};
+            callback(c);
+        }
+    }
+
+    Slot *find(const Address &src, uint16_t msgId)
+    {
+        for (auto &s : slots)
+            if (s.used && s.msgId == msgId && eq(s.src, src))
+                return &s;
+        return nullptr;
+    }
+
+    size_t held(const Address &src) const
+    {
+        size_t n = 0;
+        for (auto &s : slots)
+            if (s.used && eq(s.src, src))
+                n++;
+        return n;
+    }
+
+    // a source at its quota gives up its own oldest message; otherwise only
+    // sources with more than one message lose one, a single message is never evicted
+    Slot *victim(const Address &src)
+    {
+        bool own = held(src) >= LHRP_REASSEMBLY_PER_SOURCE;
+
+        Slot *oldest = nullptr;
+        for (auto &s : slots)
+        {
+            if (!s.used || s.busy)
+                continue;
+            if (own ? !eq(s.src, src) : held(s.src) < 2)
+                continue;
+            if (!oldest || (int32_t)(s.lastActivity - oldest->lastActivity) < 0)
+                oldest = &s;
+        }
+        return oldest;
+    }
+
+    Slot *allocate(const Address &src, uint16_t msgId, uint16_t count, Aborts &aborts)
+    {
+        Slot *slot = nullptr;
+        if (held(src) < LHRP_REASSEMBLY_PER_SOURCE)
+            for (auto &s : slots)
+                if (!s.used)
+                {
+                    slot = &s;
+                    break;
+                }
+
+        if (!slot)
+        {
+            slot = victim(src);
+            if (!slot)
+                return nullptr;
+            abort(*slot, aborts);
+        }
+
+        slot->used = true;
+        slot->src = src;
+        slot->msgId = msgId;
+        slot->count = count;
+        slot->nextIndex = 0;
+        slot->offset = 0;
+        for (auto &f : slot->pending)
+            f.used = false;
+        return slot;
+    }
+
+    void abort(Slot &s, Aborts &aborts)
+    {
+        s.used = false;
+        if (aborts.count < LHRP_REASSEMBLY_SLOTS)
+            aborts.entries[aborts.count++] = {s.src, s.msgId, s.offset};
+    }
+
+    void expire(uint32_t now, Aborts &aborts)
+    {
+        for (auto &s : slots)
+            if (s.used && !s.busy && now - s.lastActivity >= LHRP_REASSEMBLY_TIMEOUT_MS)
+                abort(s, aborts);
+    }
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef LHRP_REPLAY_WINDOW
+#define LHRP_REPLAY_WINDOW 64 // seqs below the newest one that may still arrive (64 or 128)
+#endif
+
+static_assert(LHRP_REPLAY_WINDOW % 64 == 0, "LHRP_REPLAY_WINDOW must be a multiple of 64");
+
+enum ReplayResult
+{
+    REPLAY_ACCEPTED,
+    REPLAY_DUPLICATE, // inside the window, already seen
+    REPLAY_LATE,      // older than the window
+};
+
+/* ============================================================
+   Anti-replay window (RFC 4303 style): bit i stands for
+   seq `top - i`, frames inside the window are accepted once
+   ============================================================ */
+struct ReplayWindow
+{
+    static const int WORDS = LHRP_REPLAY_WINDOW / 64;
+
+    uint32_t top = 0; // newest accepted seq, persisted as r_<MAC>
+    uint64_t bits[WORDS];
+
+    ReplayWindow() { reset(0); }
+
+    // after a reboot the bitmap is lost: treat the whole window below top as seen
+    void reset(uint32_t seq)
+    {
+        top = seq;
+        memset(bits, 0xFF, sizeof(bits));
+    }
+
+    // what update() would return, without recording the seq
+    ReplayResult check(uint32_t seq) const
+    {
+        int32_t ahead = (int32_t)(seq - top);
+        if (ahead > 0)
+            return REPLAY_ACCEPTED;
+
+        uint32_t behind = (uint32_t)(-(int64_t)ahead);
+        if (behind >= LHRP_REPLAY_WINDOW)
+            return REPLAY_LATE;
+
+        return (bits[behind / 64] >> (behind % 64)) & 1 ? REPLAY_DUPLICATE : REPLAY_ACCEPTED;
+    }
+
+    // 32-bit ack bitmap anchored at `seq` <= top (bit i = seq - i), seqs older than the window as unseen
+    uint32_t ackBits(uint32_t seq) const
+    {
+        uint32_t behind = top - seq;
+        if (behind == 0)
+            return (uint32_t)bits[0];
+
+        uint32_t out = 0;
+        for (int i = 0; i < 32 && behind < LHRP_REPLAY_WINDOW; i++, behind++)
+            out |= (uint32_t)((bits[behind / 64] >> (behind % 64)) & 1) << i;
+        return out;
+    }
+
+    ReplayResult update(uint32_t seq)
+    {
+        int32_t ahead = (int32_t)(seq - top);
+
+        if (ahead > 0)
+        {
+            shift(ahead);
+            top = seq;
+            bits[0] |= 1;
+            return REPLAY_ACCEPTED;
+        }
+
+        uint32_t behind = (uint32_t)(-(int64_t)ahead);
+        if (behind >= LHRP_REPLAY_WINDOW)
+            return REPLAY_LATE;
+
+        uint64_t mask = 1ULL << (behind % 64);
+        uint64_t &word = bits[behind / 64];
+        if (word & mask)
+            return REPLAY_DUPLICATE;
+
+        word |= mask;
+        return REPLAY_ACCEPTED;
+    }
+
+private:
+    // moves every bit n positions towards older seqs
+    void shift(uint32_t n)
+    {
+        if (n >= LHRP_REPLAY_WINDOW)
+        {
+            memset(bits, 0, sizeof(bits));
+            return;
+        }
+
+        int wordShift = n / 64;
+        int bitShift = n % 64;
+
+        for (int i = WORDS - 1; i >= 0; i--)
+        {
+            int src = i - wordShift;
+            uint64_t v = src >= 0 ? bits[src] << bitShift : 0;
+            if (bitShift && src > 0)
+                v |= bits[src - 1] >> (64 - bitShift);
+            bits[i] = v;
+        }
+    }
+};
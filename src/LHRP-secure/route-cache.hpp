@@ -0,0 +1,159 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <string.h>
+
+#include "protocol.hpp"
+#include "raw-packet.hpp"
+
+#define LHRP_ROUTE_CACHE_SIZE 8
+
+using namespace std;
+
+/* ============================================================
+   Next-hop cache (destination -> pin), flushed on Node::compile()
+   and whenever the link costs or the route policy change, bypassed
+   while you / connections changed since the last compile(); with
+   ECMP an entry holds every tied pin, the flow key picks one
+   ============================================================ */
+#define LHRP_ECMP_MAX_PATHS 4
+
+struct RouteCache
+{
+    struct Entry
+    {
+        uint8_t addr[MAX_ADDRESS_DEPTH];
+        uint8_t len;
+        uint8_t pins[LHRP_ECMP_MAX_PATHS];
+        uint8_t pinCount;
+        bool used;
+    };
+
+    array<Entry, LHRP_ROUTE_CACHE_SIZE> entries{};
+    uint32_t generation = 0;
+    uint8_t nextSlot = 0;
+
+    // read without the lock (stats, benches)
+    atomic<uint32_t> hits{0};
+    atomic<uint32_t> misses{0};
+
+    // src / flowId only matter with ECMP
+    uint8_t resolve(const Node &node, const Address &dest, const Address &src = Address(), uint16_t flowId = 0)
+    {
+        lock_guard<mutex> guard(lock);
+
+        // table is stale or destination can not be stored -> no caching
+        if (!node.compiled() || dest.size() > MAX_ADDRESS_DEPTH)
+        {
+            misses.fetch_add(1, memory_order_relaxed);
+            uint8_t pins[LHRP_ECMP_MAX_PATHS];
+            return pick(pins, compute(node, dest, pins), dest, src, flowId);
+        }
+
+        if (generation != node.generation)
+        {
+            clear();
+            generation = node.generation;
+        }
+
+        for (auto &e : entries)
+        {
+            if (e.used && e.len == dest.size() && memcmp(e.addr, dest.data(), e.len) == 0)
+            {
+                hits.fetch_add(1, memory_order_relaxed);
+                return pick(e.pins, e.pinCount, dest, src, flowId);
+            }
+        }
+
+        misses.fetch_add(1, memory_order_relaxed);
+
+        Entry &e = entries[nextSlot];
+        nextSlot = (nextSlot + 1) % LHRP_ROUTE_CACHE_SIZE;
+        memcpy(e.addr, dest.data(), dest.size());
+        e.len = dest.size();
+        e.pinCount = compute(node, dest, e.pins);
+        e.used = true;
+
+        return pick(e.pins, e.pinCount, dest, src, flowId);
+    }
+
+    void clear()
+    {
+        for (auto &e : entries)
+            e.used = false;
+        nextSlot = 0;
+    }
+
+    void setPolicy(const RoutePolicy &p)
+    {
+        lock_guard<mutex> guard(lock);
+        policy = p;
+        clear();
+    }
+
+    // one cost per connection, only used while the policy is enabled
+    void setCosts(const vector<uint16_t> &c)
+    {
+        lock_guard<mutex> guard(lock);
+        costs = c;
+        clear();
+    }
+
+    // spread flows over all connections that tie with the best one
+    void setEcmp(bool on)
+    {
+        lock_guard<mutex> guard(lock);
+        ecmp = on;
+        clear();
+    }
+
+private:
+    mutex lock;
+    RoutePolicy policy;
+    vector<uint16_t> costs;
+    bool ecmp = false;
+
+    bool weighted(const Node &node) const
+    {
+        return policy.enabled() && costs.size() == node.connections().size();
+    }
+
+    // fills pins, returns how many
+    uint8_t compute(const Node &node, const Address &dest, uint8_t *pins) const
+    {
+        pins[0] = weighted(node) ? node.routeWeighted(dest, policy, costs.data()) : node.route(dest);
+        if (!ecmp || pins[0] == 0 || pins[0] == LHRP_PIN_ERROR)
+            return 1;
+
+        uint16_t ties[LHRP_ECMP_MAX_PATHS];
+        size_t n = node.routeTies(dest, ties, LHRP_ECMP_MAX_PATHS);
+
+        uint8_t tied[LHRP_ECMP_MAX_PATHS];
+        uint8_t count = 0;
+        bool chosenTied = false;
+        for (size_t i = 0; i < n; i++)
+        {
+            // links the policy turns away stay out of the set
+            if (weighted(node) && policy.maxCost && costs[ties[i]] > policy.maxCost)
+                continue;
+
+            tied[count++] = node.connections()[ties[i]].pin;
+            chosenTied |= tied[count - 1] == pins[0];
+        }
+
+        // the policy went off the tied set (or emptied it): keep its single choice
+        if (!chosenTied)
+            return 1;
+
+        memcpy(pins, tied, count);
+        return count;
+    }
+
+    static uint8_t pick(const uint8_t *pins, uint8_t count, const Address &dest, const Address &src, uint16_t flowId)
+    {
+        return count == 1 ? pins[0] : pins[flowHash(src, dest, flowId) % count];
+    }
+};
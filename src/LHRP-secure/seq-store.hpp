@@ -0,0 +1,149 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef ARDUINO
+#include <nvs.h>
+#else
+#include <map>
+#include <string>
+#include <functional>
+#include <stdio.h>
+#endif
+
+// writes "<prefix>_<MACHEX>" (14 chars + '\0')
+inline void macToNvsKey(char out[16], char prefix, const uint8_t *mac)
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+    out[0] = prefix;
+    out[1] = '_';
+    for (size_t i = 0; i < 6; i++)
+    {
+        out[2 + i * 2] = hexDigits[(mac[i] >> 4) & 0xF];
+        out[3 + i * 2] = hexDigits[mac[i] & 0xF];
+    }
+    out[14] = '\0';
+}
+
+// the seq (or lease end) that reaches further, across the 32-bit wrap
+inline uint32_t laterSeq(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) > 0 ? a : b;
+}
+
+/* ============================================================
+   Persistent uint32 store for sequence numbers.
+   put() only stages a value, commit() writes all staged values
+   at once. On ESP32 this is NVS (same keys as Preferences),
+   on the host in memory, optionally backed by a file.
+   ============================================================ */
+#ifdef ARDUINO
+
+struct SeqStore
+{
+    bool begin(const char *name)
+    {
+        return nvs_open(name, NVS_READWRITE, &handle) == ESP_OK;
+    }
+
+    uint32_t get(const char *key, uint32_t defaultValue)
+    {
+        uint32_t v = defaultValue;
+        if (nvs_get_u32(handle, key, &v) != ESP_OK)
+            return defaultValue;
+        return v;
+    }
+
+    void put(const char *key, uint32_t value)
+    {
+        nvs_set_u32(handle, key, value);
+    }
+
+    bool commit()
+    {
+        return nvs_commit(handle) == ESP_OK;
+    }
+
+private:
+    nvs_handle_t handle = 0;
+};
+
+#else
+
+struct SeqStore
+{
+    std::map<std::string, uint32_t> committed;
+    std::map<std::string, uint32_t> staged;
+    uint32_t commits = 0;
+    std::string path; // empty = memory only
+    std::function<void()> onCommit; // tests: runs at the end of every commit(), under the node's store lock
+
+    // call before begin(): committed values survive in `file` ("key value" lines)
+    void useFile(const std::string &file) { path = file; }
+
+    bool begin(const char *)
+    {
+        if (path.empty())
+            return true;
+
+        FILE *f = fopen(path.c_str(), "r");
+        if (!f)
+            return true; // first start
+
+        char key[32];
+        unsigned long value;
+        while (fscanf(f, "%31s %lu", key, &value) == 2)
+            committed[key] = value;
+
+        fclose(f);
+        return true;
+    }
+
+    uint32_t get(const char *key, uint32_t defaultValue)
+    {
+        auto it = committed.find(key);
+        return it == committed.end() ? defaultValue : it->second;
+    }
+
+    void put(const char *key, uint32_t value)
+    {
+        staged[key] = value;
+    }
+
+    bool commit()
+    {
+        for (auto &kv : staged)
+            committed[kv.first] = kv.second;
+        staged.clear();
+        commits++;
+        if (onCommit)
+            onCommit();
+        return path.empty() || save();
+    }
+
+    // simulated power loss: everything not committed is gone
+    void crash()
+    {
+        staged.clear();
+    }
+
+private:
+    // write a new file and rename it over the old one: a crash leaves either version
+    bool save()
+    {
+        std::string tmp = path + ".tmp";
+        FILE *f = fopen(tmp.c_str(), "w");
+        if (!f)
+            return false;
+
+        bool ok = true;
+        for (auto &kv : committed)
+            ok = ok && fprintf(f, "%s %lu\n", kv.first.c_str(), (unsigned long)kv.second) > 0;
+
+        ok = fclose(f) == 0 && ok;
+        return ok && rename(tmp.c_str(), path.c_str()) == 0;
+    }
+};
+
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+using namespace std;
+
+/* ============================================================
+   Lock-free single-producer / single-consumer ring.
+   Slots are written and read in place:
+     producer: reserve() -> fill -> commit()
+     consumer: peek()    -> use  -> pop()
+   ============================================================ */
+template <typename T, size_t N>
+struct SpscRing
+{
+    static_assert((N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+    // next free slot, nullptr (and one more drop) when full
+    T *reserve()
+    {
+        uint32_t h = head.load(memory_order_relaxed);
+        if (h - tail.load(memory_order_acquire) == N)
+        {
+            drops.fetch_add(1, memory_order_relaxed);
+            return nullptr;
+        }
+        return &slots[h & (N - 1)];
+    }
+
+    void commit()
+    {
+        head.store(head.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+
+    // oldest slot, nullptr when empty
+    T *peek()
+    {
+        uint32_t t = tail.load(memory_order_relaxed);
+        if (t == head.load(memory_order_acquire))
+            return nullptr;
+        return &slots[t & (N - 1)];
+    }
+
+    void pop()
+    {
+        tail.store(tail.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+
+    uint32_t depth() const
+    {
+        return head.load(memory_order_relaxed) - tail.load(memory_order_relaxed);
+    }
+
+    uint32_t dropped() const
+    {
+        return drops.load(memory_order_relaxed);
+    }
+
+    static constexpr size_t capacity() { return N; }
+
+private:
+    T slots[N];
+    atomic<uint32_t> head{0};
+    atomic<uint32_t> tail{0};
+    atomic<uint32_t> drops{0};
+};
@@ -0,0 +1,346 @@
+#pragma once
+
+#include <array>
+#include <initializer_list>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "protocol.hpp"
+
+#ifndef LHRP_TOPOLOGY_MAX_LINKS
+#define LHRP_TOPOLOGY_MAX_LINKS 8 // neighbours per node
+#endif
+
+#define LHRP_TOPOLOGY_LOCAL -1   // next hop: deliver here
+#define LHRP_TOPOLOGY_NO_ROUTE -2 // next hop: LHRP_PIN_ERROR
+
+using namespace std;
+
+/* ============================================================
+   Compile-time network description
+     constexpr auto net = makeTopology(
+         topologyNode({mac}, {address}, {neighbour indices}), ...);
+     LHRP_CHECK_TOPOLOGY(net);
+   makeTopology() resolves every node's peers into a table, the whole
+   object is constexpr and ends up in flash (.rodata)
+   ============================================================ */
+struct TopologyAddress
+{
+    uint8_t len = 0;
+    uint8_t bytes[MAX_ADDRESS_DEPTH] = {};
+
+    Address toAddress() const
+    {
+        Address a;
+        a.assign(bytes, bytes + len);
+        return a;
+    }
+};
+
+struct TopologyNode
+{
+    array<uint8_t, 6> mac = {};
+    TopologyAddress address;
+    uint8_t links[LHRP_TOPOLOGY_MAX_LINKS] = {}; // indices into the topology, order = pin - 1
+    uint8_t linkCount = 0;
+    bool overflow = false; // address or adjacency list did not fit
+};
+
+struct TopologyPeer
+{
+    array<uint8_t, 6> mac = {};
+    TopologyAddress address;
+};
+
+// everything LHRP_Node_Secure needs: own identity plus the direct neighbours
+struct TopologyTable
+{
+    TopologyPeer self;
+    TopologyPeer peers[LHRP_TOPOLOGY_MAX_LINKS];
+    uint8_t peerCount = 0;
+};
+
+struct TopologyMacEntry
+{
+    array<uint8_t, 6> mac = {};
+    uint8_t node = 0;
+};
+
+template <size_t N>
+struct Topology
+{
+    static_assert(N > 0 && N < 256, "a topology holds 1..255 nodes");
+
+    array<TopologyNode, N> nodes = {};
+    array<TopologyTable, N> tables = {};
+    array<TopologyMacEntry, N> byMac = {}; // sorted by mac
+
+    static constexpr size_t size() { return N; }
+
+    Address address(size_t node) const { return nodes[node].address.toAddress(); }
+};
+
+// ------------------------
+constexpr TopologyNode topologyNode(const array<uint8_t, 6> &mac, initializer_list<uint8_t> address, initializer_list<uint8_t> links)
+{
+    TopologyNode n;
+    n.mac = mac;
+    n.overflow = address.size() > MAX_ADDRESS_DEPTH || links.size() > LHRP_TOPOLOGY_MAX_LINKS;
+
+    for (uint8_t b : address)
+        if (n.address.len < MAX_ADDRESS_DEPTH)
+            n.address.bytes[n.address.len++] = b;
+
+    for (uint8_t l : links)
+        if (n.linkCount < LHRP_TOPOLOGY_MAX_LINKS)
+            n.links[n.linkCount++] = l;
+
+    return n;
+}
+
+constexpr int compareMac(const array<uint8_t, 6> &a, const array<uint8_t, 6> &b)
+{
+    for (size_t i = 0; i < 6; i++)
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    return 0;
+}
+
+template <typename... Nodes>
+constexpr Topology<sizeof...(Nodes)> makeTopology(const Nodes &...list)
+{
+    constexpr size_t N = sizeof...(Nodes);
+    Topology<N> t;
+    const TopologyNode nodes[N] = {list...};
+
+    for (size_t i = 0; i < N; i++)
+    {
+        t.nodes[i] = nodes[i];
+
+        TopologyTable &table = t.tables[i];
+        table.self = {nodes[i].mac, nodes[i].address};
+        for (size_t l = 0; l < nodes[i].linkCount; l++)
+            if (nodes[i].links[l] < N) // checked by LHRP_CHECK_TOPOLOGY
+                table.peers[table.peerCount++] = {nodes[nodes[i].links[l]].mac, nodes[nodes[i].links[l]].address};
+
+        // insertion sort, N is small
+        size_t j = i;
+        for (; j > 0 && compareMac(t.byMac[j - 1].mac, nodes[i].mac) > 0; j--)
+            t.byMac[j] = t.byMac[j - 1];
+        t.byMac[j] = {nodes[i].mac, (uint8_t)i};
+    }
+
+    return t;
+}
+
+// node index of mac, -1 if the device is not part of the topology
+template <size_t N>
+constexpr int topologyFind(const Topology<N> &t, const array<uint8_t, 6> &mac)
+{
+    size_t lo = 0, hi = N;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        int c = compareMac(t.byMac[mid].mac, mac);
+        if (c == 0)
+            return t.byMac[mid].node;
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return -1;
+}
+
+/* ============================================================
+   Checks (constexpr, used by LHRP_CHECK_TOPOLOGY)
+   ============================================================ */
+constexpr bool topologyEq(const TopologyAddress &a, const TopologyAddress &b)
+{
+    return a.len == b.len && match(a.bytes, a.len, b.bytes, b.len).negative == 0;
+}
+
+constexpr bool topologyIsChild(const TopologyAddress &other, const TopologyAddress &you)
+{
+    return isChildren(other.bytes, other.len, you.bytes, you.len);
+}
+
+constexpr int topologyMatchIndex(const TopologyAddress &connection, const TopologyAddress &dest)
+{
+    return matchIndex(match(connection.bytes, connection.len, dest.bytes, dest.len));
+}
+
+// next node index for dest: Node::routeLinear()'s pick and Node::decide(),
+// both built from the rules in protocol.hpp (betterMatch, decideRoute)
+template <size_t N>
+constexpr int topologyNextHop(const Topology<N> &t, size_t at, const TopologyAddress &dest)
+{
+    const TopologyNode &node = t.nodes[at];
+    if (topologyEq(node.address, dest))
+        return LHRP_TOPOLOGY_LOCAL;
+    if (node.linkCount == 0)
+        return LHRP_TOPOLOGY_NO_ROUTE;
+
+    size_t best = 0;
+    int bestIdx = topologyMatchIndex(t.nodes[node.links[0]].address, dest);
+    for (size_t l = 1; l < node.linkCount; l++)
+    {
+        const TopologyAddress &a = t.nodes[node.links[l]].address;
+        int idx = topologyMatchIndex(a, dest);
+        if (betterMatch(idx, a.len, bestIdx, t.nodes[node.links[best]].address.len))
+        {
+            best = l;
+            bestIdx = idx;
+        }
+    }
+
+    const TopologyAddress &bestAddress = t.nodes[node.links[best]].address;
+    switch (decideRoute(topologyIsChild(dest, node.address), topologyIsChild(bestAddress, node.address),
+                        bestIdx, topologyMatchIndex(node.address, dest)))
+    {
+    case ROUTE_LOCAL:
+        return LHRP_TOPOLOGY_LOCAL;
+    case ROUTE_NONE:
+        return LHRP_TOPOLOGY_NO_ROUTE;
+    default:
+        return node.links[best];
+    }
+}
+
+template <size_t N>
+constexpr bool topologyFits(const Topology<N> &t)
+{
+    for (size_t i = 0; i < N; i++)
+        if (t.nodes[i].overflow)
+            return false;
+    return true;
+}
+
+// every link points to another node, is listed on both ends and only once
+template <size_t N>
+constexpr bool topologyLinksValid(const Topology<N> &t)
+{
+    for (size_t i = 0; i < N; i++)
+        for (size_t l = 0; l < t.nodes[i].linkCount; l++)
+        {
+            size_t other = t.nodes[i].links[l];
+            if (other >= N || other == i)
+                return false;
+
+            size_t back = 0, same = 0;
+            for (size_t k = 0; k < t.nodes[other].linkCount; k++)
+                back += t.nodes[other].links[k] == i;
+            for (size_t k = 0; k < t.nodes[i].linkCount; k++)
+                same += t.nodes[i].links[k] == other;
+            if (back != 1 || same != 1)
+                return false;
+        }
+    return true;
+}
+
+template <size_t N>
+constexpr bool topologyUniqueMacs(const Topology<N> &t)
+{
+    for (size_t i = 1; i < N; i++)
+        if (compareMac(t.byMac[i - 1].mac, t.byMac[i].mac) == 0)
+            return false;
+    return true;
+}
+
+template <size_t N>
+constexpr bool topologyUniqueAddresses(const Topology<N> &t)
+{
+    for (size_t i = 0; i < N; i++)
+        for (size_t j = i + 1; j < N; j++)
+            if (topologyEq(t.nodes[i].address, t.nodes[j].address))
+                return false;
+    return true;
+}
+
+// every node can be reached over links from node 0
+template <size_t N>
+constexpr bool topologyConnected(const Topology<N> &t)
+{
+    bool seen[N] = {};
+    size_t queue[N] = {};
+    size_t head = 0, tail = 0;
+
+    seen[0] = true;
+    queue[tail++] = 0;
+    while (head < tail)
+    {
+        const TopologyNode &node = t.nodes[queue[head++]];
+        for (size_t l = 0; l < node.linkCount; l++)
+            if (node.links[l] < N && !seen[node.links[l]])
+            {
+                seen[node.links[l]] = true;
+                queue[tail++] = node.links[l];
+            }
+    }
+    return tail == N;
+}
+
+// the hop-by-hop decisions from `from` end at `to`
+template <size_t N>
+constexpr bool topologyRouteArrives(const Topology<N> &t, size_t from, size_t to)
+{
+    size_t at = from;
+    for (size_t hops = 0; hops <= N; hops++)
+    {
+        int next = topologyNextHop(t, at, t.nodes[to].address);
+        if (next == LHRP_TOPOLOGY_LOCAL)
+            return at == to;
+        if (next == LHRP_TOPOLOGY_NO_ROUTE)
+            return false;
+        at = next;
+    }
+    return false; // circles, see topologyLoopFree
+}
+
+// no pocket circles (links must be valid, that has its own check);
+// decide() only forwards to a higher matchIndex, this guards changes to it
+template <size_t N>
+constexpr bool topologyLoopFree(const Topology<N> &t)
+{
+    if (!topologyLinksValid(t))
+        return true;
+
+    for (size_t from = 0; from < N; from++)
+        for (size_t to = 0; to < N; to++)
+        {
+            size_t at = from;
+            for (size_t hops = 0;; hops++)
+            {
+                int next = topologyNextHop(t, at, t.nodes[to].address);
+                if (next < 0)
+                    break;
+                if (hops == N)
+                    return false;
+                at = next;
+            }
+        }
+    return true;
+}
+
+// every pocket arrives at its destination
+template <size_t N>
+constexpr bool topologyRoutable(const Topology<N> &t)
+{
+    if (!topologyLinksValid(t))
+        return true;
+
+    for (size_t from = 0; from < N; from++)
+        for (size_t to = 0; to < N; to++)
+            if (!topologyRouteArrives(t, from, to))
+                return false;
+    return true;
+}
+
+#define LHRP_CHECK_TOPOLOGY(t)                                                                                           \
+    static_assert(topologyFits(t), #t ": address longer than MAX_ADDRESS_DEPTH or more than LHRP_TOPOLOGY_MAX_LINKS links"); \
+    static_assert(topologyLinksValid(t), #t ": link to an unknown node, to itself, twice or only in one direction");        \
+    static_assert(topologyUniqueMacs(t), #t ": duplicate MAC");                                                             \
+    static_assert(topologyUniqueAddresses(t), #t ": duplicate address");                                                    \
+    static_assert(topologyConnected(t), #t ": unreachable node");                                                           \
+    static_assert(topologyLoopFree(t), #t ": routing loop");                                                                \
+    static_assert(topologyRoutable(t), #t ": a pocket ends up at the wrong node or without a route")
@@ -0,0 +1,131 @@
+#pragma once
+
+#ifndef ARDUINO
+
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+#include "platform.hpp"
+
+using namespace std;
+
+// one direction of a link between two radios
+struct VirtualLink
+{
+    uint32_t latencyUs = 1000;
+    float loss = 0;           // 0..1, per frame
+    uint32_t bytesPerSec = 0; // 0 = unlimited, otherwise frames queue behind each other
+    int8_t rssi = -50;        // reported to the receiver with every frame
+};
+
+struct VirtualMediumStats
+{
+    uint64_t sent;        // frames handed to the medium
+    uint64_t delivered;
+    uint64_t lost;        // dropped by VirtualLink::loss
+    uint64_t unreachable; // no radio with that MAC on the same channel
+};
+
+struct VirtualMedium;
+
+// host backend of Radio, created by VirtualMedium::attach()
+struct VirtualRadio : Radio
+{
+    array<uint8_t, 6> mac;
+
+    bool begin(uint8_t channel, ReceiveFn receive, SentFn sent, void *arg) override;
+    bool addPeer(const uint8_t mac[6], uint8_t channel) override;
+    bool send(const uint8_t mac[6], const uint8_t *data, size_t len) override;
+
+private:
+    friend struct VirtualMedium;
+
+    VirtualMedium *medium = nullptr;
+    ReceiveFn receiveFn = nullptr;
+    SentFn sentFn = nullptr;
+    void *receiveArg = nullptr;
+    uint8_t channel = 0;
+};
+
+/* ============================================================
+   In-process radio medium: frames between attached radios are
+   delivered by one thread after latency + serialization time,
+   or dropped with the configured loss rate
+   ============================================================ */
+struct VirtualMedium
+{
+    explicit VirtualMedium(uint32_t seed = 1);
+    ~VirtualMedium();
+
+    VirtualMedium(const VirtualMedium &) = delete;
+    VirtualMedium &operator=(const VirtualMedium &) = delete;
+
+    // the radio lives as long as the medium
+    VirtualRadio &attach(const array<uint8_t, 6> &mac);
+
+    void setDefaultLink(const VirtualLink &link);
+    void setLink(const array<uint8_t, 6> &from, const array<uint8_t, 6> &to, const VirtualLink &link);
+
+    void start();
+    void stop();
+
+    // true once no frame is queued or being delivered
+    bool waitIdle(uint32_t timeoutMs);
+
+    VirtualMediumStats stats();
+
+private:
+    friend struct VirtualRadio;
+
+    struct Frame
+    {
+        uint64_t dueUs;
+        uint64_t order; // FIFO among frames due at the same time
+        VirtualRadio *to;
+        uint8_t from[6];
+        int8_t rssi;
+        uint8_t len;
+        uint8_t data[250];
+    };
+
+    struct Later
+    {
+        bool operator()(const Frame &a, const Frame &b) const
+        {
+            return a.dueUs != b.dueUs ? a.dueUs > b.dueUs : a.order > b.order;
+        }
+    };
+
+    struct LinkState
+    {
+        VirtualLink config;
+        uint64_t busyUntilUs = 0;
+    };
+
+    mutex lock;
+    condition_variable wake;
+    condition_variable idle;
+    priority_queue<Frame, vector<Frame>, Later> queue;
+    map<uint64_t, unique_ptr<VirtualRadio>> radios;
+    map<pair<uint64_t, uint64_t>, LinkState> links;
+    VirtualLink defaultLink;
+    mt19937 rng;
+    uint64_t nextOrder = 0;
+    uint32_t delivering = 0;
+    VirtualMediumStats counters{};
+    thread deliveryThread;
+    bool running = false;
+
+    bool transmit(VirtualRadio &from, const uint8_t to[6], const uint8_t *data, size_t len);
+    LinkState &linkState(uint64_t from, uint64_t to);
+    void deliveryLoop();
+};
+
+#endif
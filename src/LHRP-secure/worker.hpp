@@ -0,0 +1,161 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#else
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#endif
+
+#define LHRP_WAIT_FOREVER 0
+
+/* ============================================================
+   Background task: calls run(arg) after every notify() and,
+   if periodMs != LHRP_WAIT_FOREVER, at least every periodMs.
+   FreeRTOS task on ESP32, std::thread on the host.
+   ============================================================ */
+struct Worker
+{
+    typedef void (*Fn)(void *arg);
+
+    Worker() {}
+    Worker(const Worker &) = delete;
+    Worker &operator=(const Worker &) = delete;
+    ~Worker() { stop(); }
+
+#ifdef ARDUINO
+    // core < 0: no affinity
+    bool start(const char *name, Fn fn, void *arg, uint32_t periodMs, int core = -1, uint32_t stack = 4096, int priority = 1)
+    {
+        if (task)
+            return true;
+
+        run = fn;
+        runArg = arg;
+        period = periodMs == LHRP_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(periodMs);
+        stopping = false;
+        done = xSemaphoreCreateBinary();
+
+        BaseType_t rc = xTaskCreatePinnedToCore(main, name, stack, this, priority, &task,
+                                                core < 0 ? tskNO_AFFINITY : core);
+        if (rc != pdPASS)
+            task = nullptr;
+        return task != nullptr;
+    }
+
+    void notify()
+    {
+        if (task)
+            xTaskNotifyGive(task);
+    }
+
+    void stop()
+    {
+        if (!task)
+            return;
+
+        stopping = true;
+        xTaskNotifyGive(task);
+        xSemaphoreTake(done, portMAX_DELAY);
+        vSemaphoreDelete(done);
+        task = nullptr;
+    }
+
+    bool running() const { return task != nullptr; }
+
+private:
+    TaskHandle_t task = nullptr;
+    SemaphoreHandle_t done = nullptr;
+    TickType_t period = portMAX_DELAY;
+    volatile bool stopping = false;
+    Fn run = nullptr;
+    void *runArg = nullptr;
+
+    static void main(void *arg)
+    {
+        Worker *self = (Worker *)arg;
+        for (;;)
+        {
+            ulTaskNotifyTake(pdTRUE, self->period);
+            if (self->stopping)
+                break;
+            self->run(self->runArg);
+        }
+
+        xSemaphoreGive(self->done);
+        vTaskDelete(nullptr);
+    }
+#else
+    // core is ignored on the host
+    bool start(const char *, Fn fn, void *arg, uint32_t periodMs, int = -1, uint32_t = 0, int = 0)
+    {
+        if (thread.joinable())
+            return true;
+
+        run = fn;
+        runArg = arg;
+        period = periodMs;
+        stopping = false;
+        thread = std::thread([this]()
+                             {
+            std::unique_lock<std::mutex> lock(waitLock);
+            for (;;)
+            {
+                auto wake = [this]() { return notified || stopping; };
+                if (period == LHRP_WAIT_FOREVER)
+                    cv.wait(lock, wake);
+                else
+                    cv.wait_for(lock, std::chrono::milliseconds(period), wake);
+
+                if (stopping)
+                    break;
+                notified = false;
+
+                lock.unlock();
+                run(runArg);
+                lock.lock();
+            } });
+        return true;
+    }
+
+    void notify()
+    {
+        {
+            std::lock_guard<std::mutex> guard(waitLock);
+            notified = true;
+        }
+        cv.notify_one();
+    }
+
+    void stop()
+    {
+        if (!thread.joinable())
+            return;
+
+        {
+            std::lock_guard<std::mutex> guard(waitLock);
+            stopping = true;
+        }
+        cv.notify_one();
+        thread.join();
+    }
+
+    bool running() const { return thread.joinable(); }
+
+private:
+    std::thread thread;
+    std::mutex waitLock;
+    std::condition_variable cv;
+    bool notified = false;
+    bool stopping = false;
+    uint32_t period = LHRP_WAIT_FOREVER;
+    Fn run = nullptr;
+    void *runArg = nullptr;
+#endif
+};
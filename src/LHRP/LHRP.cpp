@@ -16,16 +16,18 @@ LHRP_Node::LHRP_Node(initializer_list<LHRP_Peer> list)
 
         if (first)
         {
-            node.you = p.address;
+            node.setYou(p.address);
             first = false;
             ownMac = p.mac;
         }
         else
         {
-            node.connections.push_back({.address = p.address, .pin = ++pin});
+            node.addConnection({.address = p.address, .pin = ++pin});
             peers.push_back(p);
         }
     }
+
+    node.compile();
 }
 
 bool LHRP_Node::begin()
@@ -59,6 +61,10 @@ bool LHRP_Node::addPeer(const array<uint8_t, 6> &mac)
 
 bool LHRP_Node::send(const Pocket &p)
 {
+    // address or payload overflowed its FixedVector: never send a cut-off pocket
+    if (p.address.truncated || p.payload.truncated)
+        return false;
+
     // The routing logic (node.send) will determine the next hop pin.
     uint8_t pin = node.send(p);
 
@@ -75,7 +81,7 @@ bool LHRP_Node::send(const Pocket &p)
     esp_err_t err = esp_now_send(
         peers[pin - 1].mac.data(),
         (uint8_t *)&raw,
-        sizeof(RawPacket));
+        rawPacketSize(raw));
 
     return err == ESP_OK;
 }
@@ -94,11 +100,11 @@ void LHRP_Node::onReceive(
     const uint8_t *data,
     int len)
 {
-    if (len != sizeof(RawPacket))
+    if (!rawPacketLengthValid(data, len))
         return;
 
     RawPacket raw;
-    memcpy(&raw, data, sizeof(RawPacket));
+    memcpy(&raw, data, len);
 
     Pocket p = deserializePocket(raw);
 
@@ -1,22 +1,22 @@
 #pragma once
 
 #include <vector>
+#include <string.h>
 #include <Arduino.h>
+#include "../LHRP-common/fixed-vector.hpp"
+
+#define MAX_ADDRESS_DEPTH 8
+#define MAX_PAYLOAD 200
 
 using namespace std;
 
-struct Address : public vector<uint16_t>
+struct Address : public FixedVector<uint16_t, MAX_ADDRESS_DEPTH>
 {
-    // inherit vector constructors
-    using vector<uint16_t>::vector;
-
-    // initializer_list constructor
-    Address(std::initializer_list<uint16_t> init)
-        : vector<uint16_t>(init) {}
+    using FixedVector<uint16_t, MAX_ADDRESS_DEPTH>::FixedVector;
 };
 
 struct Pocket
 {
     Address address;
-    vector<uint8_t> payload;
+    FixedVector<uint8_t, MAX_PAYLOAD> payload;
 };
@@ -3,6 +3,7 @@
 #include <vector>
 #include <algorithm>
 #include "pocket.hpp"
+#include "../LHRP-common/route-trie.hpp"
 
 using namespace std;
 
@@ -54,40 +55,112 @@ struct Connection
     uint8_t pin;
 };
 
+typedef RouteTrie<Address> RoutingTable;
+
 struct Node
 {
-    vector<Connection> connections;
-    Address you;
+    RoutingTable table;
+    uint32_t generation = 0; // bumped on every compile() and every change of you / connections
+
+    const Address &you() const { return self; }
+    const vector<Connection> &connections() const { return links; }
+
+    // every change makes the compiled table stale: route() falls back to
+    // routeLinear() until the next compile()
+    void setYou(const Address &a)
+    {
+        self = a;
+        generation++;
+    }
+
+    void addConnection(const Connection &c)
+    {
+        links.push_back(c);
+        generation++;
+    }
+
+    void setConnection(size_t i, const Connection &c)
+    {
+        links[i] = c;
+        generation++;
+    }
+
+    void clearConnections()
+    {
+        links.clear();
+        generation++;
+    }
+
+    bool compiled() const { return compiledGeneration == generation; }
+
+    // must be called after connections or you changed
+    void compile()
+    {
+        table.build(links);
+        compiledGeneration = ++generation;
+    }
 
     uint8_t send(const Pocket &p)
     {
-        if (connections.empty())
+        return route(p.address);
+    }
+
+    uint8_t route(const Address &dest) const
+    {
+        // not compiled (or you / connections changed afterwards)
+        if (!compiled())
+            return routeLinear(dest);
+
+        if (links.empty())
             return 0;
-        if (eq(you, p.address))
+        if (eq(self, dest))
             return 0;
 
-        Connection best = connections[0];
-        int bestIdx = matchIndex(match(best.address, p.address));
-        size_t bestLen = best.address.size();
+        RouteCandidate best;
+        int bestIdx;
+        table.lookup(dest, best, bestIdx);
+
+        return decide(links[best.conn], dest);
+    }
+
+    uint8_t routeLinear(const Address &dest) const
+    {
+        if (links.empty())
+            return 0;
+        if (eq(self, dest))
+            return 0;
 
-        bool directChild = isChildren(p.address, you);
+        const Connection *best = &links[0];
+        int bestIdx = matchIndex(match(best->address, dest));
+        size_t bestLen = best->address.size();
 
-        for (size_t i = 1; i < connections.size(); i++)
+        for (size_t i = 1; i < links.size(); i++)
         {
-            int idx = matchIndex(match(connections[i].address, p.address));
-            size_t len = connections[i].address.size();
+            int idx = matchIndex(match(links[i].address, dest));
+            size_t len = links[i].address.size();
 
             if (idx > bestIdx || (idx == bestIdx && len > bestLen))
             {
-                best = connections[i];
+                best = &links[i];
                 bestIdx = idx;
                 bestLen = len;
             }
         }
 
-        if (directChild && !isChildren(best.address, you))
+        return decide(*best, dest);
+    }
+
+    uint8_t decide(const Connection &best, const Address &dest) const
+    {
+        bool directChild = isChildren(dest, self);
+        if (directChild && !isChildren(best.address, self))
             return 0;
 
         return best.pin;
     }
+
+private:
+    vector<Connection> links;
+    Address self;
+    uint32_t compiledGeneration = 0; // generation the table was built for
 };
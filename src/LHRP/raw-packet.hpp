@@ -4,28 +4,46 @@
 #include <string.h>
 #include "pocket.hpp"
 
-#define MAX_ADDRESS_DEPTH 8
-#define MAX_PAYLOAD 200
+#define RAWPACKET_HEADER_SIZE 2
 
-struct RawPacket
+// only rawPacketSize() bytes go on air: header, addressLen * 2 address bytes, payload
+struct __attribute__((packed)) RawPacket
 {
     uint8_t addressLen;
-    uint16_t address[MAX_ADDRESS_DEPTH];
-
     uint8_t payloadLen;
-    uint8_t payload[MAX_PAYLOAD];
+    uint8_t data[MAX_ADDRESS_DEPTH * 2 + MAX_PAYLOAD]; // address (big-endian uint16), payload
 };
 
+inline size_t rawPacketSize(const RawPacket &r)
+{
+    return RAWPACKET_HEADER_SIZE + r.addressLen * 2 + r.payloadLen;
+}
+
+inline bool rawPacketLengthValid(const uint8_t *data, int len)
+{
+    if (len < RAWPACKET_HEADER_SIZE || len > (int)sizeof(RawPacket))
+        return false;
+
+    const RawPacket *r = (const RawPacket *)data;
+    if (r->addressLen > MAX_ADDRESS_DEPTH || r->payloadLen > MAX_PAYLOAD)
+        return false;
+
+    return (size_t)len == rawPacketSize(*r);
+}
+
 inline RawPacket serializePocket(const Pocket &p)
 {
     RawPacket r{};
     r.addressLen = min((size_t)MAX_ADDRESS_DEPTH, p.address.size());
 
     for (size_t i = 0; i < r.addressLen; i++)
-        r.address[i] = p.address[i];
+    {
+        r.data[i * 2] = p.address[i] >> 8;
+        r.data[i * 2 + 1] = p.address[i] & 0xFF;
+    }
 
     r.payloadLen = min((size_t)MAX_PAYLOAD, p.payload.size());
-    memcpy(r.payload, p.payload.data(), r.payloadLen);
+    memcpy(r.data + r.addressLen * 2, p.payload.data(), r.payloadLen);
 
     return r;
 }
@@ -35,10 +53,10 @@ inline Pocket deserializePocket(const RawPacket &r)
     Pocket p;
 
     for (uint8_t i = 0; i < r.addressLen; i++)
-        p.address.push_back(r.address[i]);
+        p.address.push_back((uint16_t(r.data[i * 2]) << 8) | r.data[i * 2 + 1]);
 
-    for (uint8_t i = 0; i < r.payloadLen; i++)
-        p.payload.push_back(r.payload[i]);
+    const uint8_t *payload = r.data + r.addressLen * 2;
+    p.payload.assign(payload, payload + r.payloadLen);
 
     return p;
 }
@@ -65,7 +65,7 @@ void setup()
   blink();
 
   // Node info
-  Serial.println("Node Addresssize: " + String(net.node.you.size()));
+  Serial.println("Node Addresssize: " + String(net.node.you().size()));
 
   // Print ESP32 MAC
   Serial.print("MAC Address: {");
@@ -102,6 +102,10 @@ void setup()
                 Serial.println("LED brightness set to " + String(pocket.payload[0]));
         } });
 
+  // the joystick pockets share the first hop: send them as one frame
+  if (isSender())
+    net.useBatching(5);
+
   Serial.println(net.begin() ? "LHRP Node Started!" : "LHRP Node Failed to Start!");
 }
 
@@ -148,28 +152,22 @@ void loop()
 
   // --- Send to NODE 1 (button toggle) ---
   {
-    Address destAddress = CVG.node1;
-    std::vector<uint8_t> payload(net.maxPayloadSize(destAddress), 0);
-    if (!payload.empty())
-      payload[0] = toggleValue;
+    Address destAddress = CVG.address(0);
+    std::vector<uint8_t> payload = {toggleValue}; // only the used bytes go on air
     Serial.println(net.send(destAddress, payload) ? "Send Toggle" : "Error Toggle");
   }
 
   // --- Send to NODE 2 (X-axis brightness) ---
   {
-    Address destAddress = CVG.node2;
-    std::vector<uint8_t> payload(net.maxPayloadSize(destAddress), 0);
-    if (!payload.empty())
-      payload[0] = xValue;
+    Address destAddress = CVG.address(1);
+    std::vector<uint8_t> payload = {xValue};
     Serial.println(net.send(destAddress, payload) ? "Send X" : "Error X");
   }
 
   // --- Send to NODE 3 (Y-axis brightness) ---
   {
-    Address destAddress = CVG.node3;
-    std::vector<uint8_t> payload(net.maxPayloadSize(destAddress), 0);
-    if (!payload.empty())
-      payload[0] = yValue;
+    Address destAddress = CVG.address(2);
+    std::vector<uint8_t> payload = {yValue};
     Serial.println(net.send(destAddress, payload) ? "Send Y" : "Error Y");
   }
 
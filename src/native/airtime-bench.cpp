@@ -0,0 +1,197 @@
+// Variable-length frames vs. the full 250-byte RawPacket on air (host only, `pio run -e airtime-bench`)
+//
+//   airtime-bench [pockets] [bytesPerSec] [hops]
+//
+// a line of `hops` + 1 nodes on links limited to bytesPerSec (default
+// 125000, the 1 Mbit/s ESP-NOW rate); the first node sends `pockets` pockets
+// per payload size to the last, once with the frames as the node builds them
+// and once padded to RAWPACKET_SIZE on every hop (the fixed length before).
+// Reports bytes and airtime per frame and the delivered pockets/s.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+
+#include "../LHRP-secure/LHRP.hpp"
+#include "../LHRP-secure/virtual-radio.hpp"
+
+using namespace std;
+
+static array<uint8_t, 6> nodeMac(uint32_t i)
+{
+    return {0x02, 0x00, (uint8_t)(i >> 24), (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+}
+
+// counts what goes on air; with `pad` every frame leaves as RAWPACKET_SIZE
+// bytes and the padding is cut off again before the node sees it
+struct AirRadio : Radio
+{
+    Radio *inner = nullptr;
+    bool pad = false;
+    atomic<uint64_t> bytes{0};
+
+    bool begin(uint8_t channel, ReceiveFn receive, SentFn sent, void *arg) override
+    {
+        receiveFn = receive;
+        sentFn = sent;
+        nodeArg = arg;
+        return inner->begin(channel, onReceive, onSent, this);
+    }
+
+    bool addPeer(const uint8_t mac[6], uint8_t channel) override { return inner->addPeer(mac, channel); }
+
+    bool send(const uint8_t mac[6], const uint8_t *data, size_t len) override
+    {
+        if (!pad)
+        {
+            bytes += len;
+            return inner->send(mac, data, len);
+        }
+
+        uint8_t frame[RAWPACKET_SIZE] = {};
+        memcpy(frame, data, len);
+        bytes += sizeof(frame);
+        return inner->send(mac, frame, sizeof(frame));
+    }
+
+private:
+    ReceiveFn receiveFn = nullptr;
+    SentFn sentFn = nullptr;
+    void *nodeArg = nullptr;
+
+    static void onReceive(void *arg, const uint8_t *mac, const uint8_t *data, int len, int8_t rssi)
+    {
+        AirRadio *r = (AirRadio *)arg;
+        if (r->pad && len == RAWPACKET_SIZE)
+            len = min<size_t>(len, rawPacketSize(*(const RawPacket *)data));
+        r->receiveFn(r->nodeArg, mac, data, len, rssi);
+    }
+
+    static void onSent(void *arg, const uint8_t *mac, bool ok)
+    {
+        AirRadio *r = (AirRadio *)arg;
+        if (r->sentFn)
+            r->sentFn(r->nodeArg, mac, ok);
+    }
+};
+
+struct Result
+{
+    uint32_t delivered;
+    uint64_t frames;
+    uint64_t bytes;
+    uint32_t elapsedMs;
+};
+
+static Result run(bool pad, uint32_t hops, uint32_t pockets, size_t payload, uint32_t bytesPerSec)
+{
+    uint32_t nodeCount = hops + 1;
+    vector<Address> addresses(nodeCount);
+    addresses[0] = {1};
+    for (uint32_t i = 1; i < nodeCount; i++)
+    {
+        addresses[i] = addresses[i - 1];
+        addresses[i].push_back(1);
+    }
+
+    VirtualMedium medium(1);
+    VirtualLink link;
+    link.latencyUs = 100;
+    link.bytesPerSec = bytesPerSec;
+    medium.setDefaultLink(link);
+
+    array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+    vector<unique_ptr<AirRadio>> radios;
+    vector<unique_ptr<LHRP_Node_Secure>> nodes;
+    atomic<uint32_t> delivered{0};
+    atomic<uint32_t> lastDelivery{0};
+
+    for (uint32_t i = 0; i < nodeCount; i++)
+    {
+        vector<LHRP_Peer> peers;
+        peers.push_back({nodeMac(i), addresses[i]});
+        if (i > 0)
+            peers.push_back({nodeMac(i - 1), addresses[i - 1]});
+        if (i + 1 < nodeCount)
+            peers.push_back({nodeMac(i + 1), addresses[i + 1]});
+
+        AirRadio *radio = new AirRadio;
+        radios.emplace_back(radio);
+        radio->inner = &medium.attach(nodeMac(i));
+        radio->pad = pad;
+
+        LHRP_Node_Secure *n = new LHRP_Node_Secure(111, key, peers);
+        nodes.emplace_back(n);
+        n->useRadio(*radio);
+        n->onPocketReceive([&](const Pocket &)
+                           {
+            delivered++;
+            lastDelivery = platformMillis(); });
+
+        if (!n->begin())
+        {
+            fprintf(stderr, "node %u failed to start\n", i);
+            exit(1);
+        }
+    }
+
+    medium.start();
+
+    vector<uint8_t> data(payload);
+    uint32_t start = platformMillis();
+    for (uint32_t i = 0; i < pockets; i++)
+        nodes[0]->send(addresses[nodeCount - 1], data);
+
+    // frames queue behind each other on the limited links, no loss: idle = done
+    medium.waitIdle(60000);
+    medium.stop();
+
+    Result r{};
+    r.delivered = delivered;
+    r.frames = medium.stats().sent;
+    for (auto &radio : radios)
+        r.bytes += radio->bytes;
+    r.elapsedMs = max<uint32_t>(lastDelivery.load() - start, 1);
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t pockets = argc > 1 ? atoi(argv[1]) : 500;
+    uint32_t bytesPerSec = argc > 2 ? atoi(argv[2]) : 125000;
+    uint32_t hops = argc > 3 ? atoi(argv[3]) : 2;
+
+    if (pockets < 1 || bytesPerSec < 1 || hops < 1 || hops + 1 > MAX_ADDRESS_DEPTH)
+        return 1;
+
+    printf("pockets %u, %u bytes/s per link, %u hops\n", pockets, bytesPerSec, hops);
+    printf("%-8s %-9s %9s %11s %13s %11s %9s\n", "payload", "mode", "delivered", "bytes/frame",
+           "airtime us", "pockets/s", "speedup");
+
+    Address longest;
+    for (uint32_t i = 0; i <= hops; i++)
+        longest.push_back(1);
+    size_t maxPayload = maxPayloadSizePocket({1}, longest);
+
+    for (size_t payload : {(size_t)8, (size_t)32, (size_t)64, (size_t)128, maxPayload})
+    {
+        double base = 0;
+        for (bool pad : {true, false})
+        {
+            Result r = run(pad, hops, pockets, payload, bytesPerSec);
+            double perFrame = r.frames ? (double)r.bytes / r.frames : 0;
+            double rate = r.delivered * 1000.0 / r.elapsedMs;
+            if (pad)
+                base = rate;
+
+            printf("%-8zu %-9s %8.1f%% %11.1f %13.0f %11.0f %8.2fx\n", payload, pad ? "padded" : "variable",
+                   100.0 * r.delivered / pockets, perFrame, perFrame * 1e6 / bytesPerSec, rate, rate / base);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,174 @@
+// Payload codec throughput and gain on synthetic sensor traces (host only, `pio run -e codec-bench`)
+//
+//   codec-bench [payloads] [budget]
+//
+// every trace is a stream of records (random walk readings); payloads are
+// filled with whole records up to `budget` bytes (default 210, the
+// maxPayloadSize of a two-level tree). Reports MB/s for compress / decompress, the
+// size ratio, how often "not smaller" sends the raw bytes, and the bytes
+// per frame on air with and without compression.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <functional>
+
+#include "../LHRP-secure/pocket.hpp"
+#include "../LHRP-secure/compression.hpp"
+
+using namespace std;
+
+typedef function<vector<uint8_t>(mt19937 &, uint32_t)> RecordFn;
+
+struct Walk
+{
+    double value, step, lo, hi;
+
+    double next(mt19937 &rng)
+    {
+        value += uniform_real_distribution<double>(-step, step)(rng);
+        value = min(hi, max(lo, value));
+        return value;
+    }
+};
+
+static vector<uint8_t> text(const char *fmt, ...)
+{
+    char buf[160];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    return vector<uint8_t>(buf, buf + n);
+}
+
+struct Trace
+{
+    const char *name;
+    RecordFn record;
+};
+
+static double seconds(chrono::steady_clock::time_point since)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - since).count();
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t payloads = argc > 1 ? atoi(argv[1]) : 20000;
+    size_t budget = argc > 2 ? atoi(argv[2]) : 210;
+
+    if (budget < 16 || budget > MAX_POCKET_PAYLOAD)
+        return 1;
+
+    Walk temp{21.5, 0.05, -20, 50}, hum{45, 0.2, 0, 100}, press{1013, 0.1, 950, 1050}, bat{3.9, 0.002, 3.0, 4.2};
+    auto reset = [&]
+    { temp.value = 21.5, hum.value = 45, press.value = 1013, bat.value = 3.9; };
+
+    vector<Trace> traces = {
+        {"json", [&](mt19937 &rng, uint32_t t)
+         { return text("{\"id\":12,\"ts\":%u,\"t\":%.2f,\"h\":%.1f,\"p\":%.1f,\"v\":%.2f}",
+                       t, temp.next(rng), hum.next(rng), press.next(rng), bat.next(rng)); }},
+        {"csv", [&](mt19937 &rng, uint32_t t)
+         { return text("%u,%.2f,%.1f,%.1f,%.2f\n", t, temp.next(rng), hum.next(rng), press.next(rng), bat.next(rng)); }},
+        {"binary", [&](mt19937 &rng, uint32_t t)
+         {
+             // | ts (4) | temp * 100 (2) | hum * 10 (2) | press * 10 (2) | mV (2) |
+             uint16_t v[4] = {(uint16_t)(int16_t)(temp.next(rng) * 100), (uint16_t)(hum.next(rng) * 10),
+                              (uint16_t)(press.next(rng) * 10), (uint16_t)(bat.next(rng) * 1000)};
+             vector<uint8_t> r(12);
+             memcpy(r.data(), &t, 4);
+             memcpy(r.data() + 4, v, 8);
+             return r; }},
+        {"random", [&](mt19937 &rng, uint32_t)
+         {
+             vector<uint8_t> r(16);
+             for (auto &b : r)
+                 b = rng();
+             return r; }},
+    };
+
+    LzCodec codec;
+    vector<uint8_t> out(256), back(256);
+
+    printf("payloads %u, budget %zu bytes\n", payloads, budget);
+    printf("%-8s %8s %8s %7s %8s | %12s %12s | %14s\n", "trace", "in B", "out B", "ratio", "skipped",
+           "comp MB/s", "decomp MB/s", "air B/frame");
+
+    for (Trace &trace : traces)
+    {
+        mt19937 rng(7);
+        reset();
+        uint32_t t = 1712345678;
+
+        // fill payloads with whole records
+        vector<vector<uint8_t>> inputs;
+        vector<uint8_t> pending;
+        while (inputs.size() < payloads)
+        {
+            vector<uint8_t> r = trace.record(rng, t);
+            t += 10;
+            if (pending.size() + r.size() > budget)
+            {
+                inputs.push_back(pending);
+                pending.clear();
+            }
+            pending.insert(pending.end(), r.begin(), r.end());
+        }
+
+        uint64_t inBytes = 0, sentBytes = 0, packedIn = 0;
+        uint32_t skipped = 0;
+        vector<size_t> sizes(inputs.size());
+
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < inputs.size(); i++)
+            sizes[i] = codec.compress(inputs[i].data(), inputs[i].size(), out.data(), inputs[i].size() - 1);
+        double compressSec = seconds(start);
+
+        for (size_t i = 0; i < inputs.size(); i++)
+        {
+            inBytes += inputs[i].size();
+            sentBytes += sizes[i] ? sizes[i] : inputs[i].size();
+            skipped += sizes[i] == 0;
+        }
+
+        // decompress timing on the packed ones (codec keeps no state for it)
+        vector<vector<uint8_t>> packed;
+        for (size_t i = 0; i < inputs.size(); i++)
+            if (sizes[i])
+            {
+                size_t n = codec.compress(inputs[i].data(), inputs[i].size(), out.data(), inputs[i].size() - 1);
+                packed.emplace_back(out.begin(), out.begin() + n);
+                packedIn += inputs[i].size();
+            }
+
+        start = chrono::steady_clock::now();
+        size_t check = 0;
+        for (auto &p : packed)
+            check += codec.decompress(p.data(), p.size(), back.data(), back.size());
+        double decompressSec = seconds(start);
+        if (check != packedIn)
+        {
+            fprintf(stderr, "%s: round trip failed\n", trace.name);
+            return 1;
+        }
+
+        // on air: header (32) + seq (4) + addresses (4, two-level tree) plus the payload
+        double overhead = 40;
+        double airRaw = overhead + (double)inBytes / inputs.size();
+        double airPacked = overhead + (double)sentBytes / inputs.size();
+
+        printf("%-8s %8.1f %8.1f %7.3f %7.1f%% | %12.1f %12.1f | %6.1f -> %5.1f\n", trace.name,
+               (double)inBytes / inputs.size(), (double)sentBytes / inputs.size(), (double)sentBytes / inBytes,
+               100.0 * skipped / inputs.size(),
+               inBytes / compressSec / 1e6, packedIn ? packedIn / decompressSec / 1e6 : 0.0,
+               airRaw, airPacked);
+    }
+
+    return 0;
+}
@@ -0,0 +1,200 @@
+// Goodput and latency over a lossy line of relays (host only, `pio run -e loss-bench`)
+//
+//   loss-bench [nodes] [pockets] [loss] [latencyUs]
+//
+// node 0 - node 1 - ... - node n-1; the last node sends `pockets` pockets to
+// node 0, once without link acks, once with useReliability() and once with
+// useReliability() plus usePipeline(). A refused send() (window full) is
+// retried after 1 ms; with link acks only frames given up after
+// LHRP_MAX_RETRIES (column "expired") may be missing.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+
+#include "../LHRP-secure/LHRP.hpp"
+#include "../LHRP-secure/virtual-radio.hpp"
+
+using namespace std;
+
+static array<uint8_t, 6> nodeMac(uint32_t i)
+{
+    return {0x02, 0x00, (uint8_t)(i >> 24), (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+}
+
+enum Mode
+{
+    MODE_PLAIN,
+    MODE_RELIABLE,
+    MODE_RELIABLE_PIPELINE,
+};
+
+static const char *modeNames[] = {"plain", "acks", "acks+pipeline"};
+
+struct Result
+{
+    uint32_t delivered;
+    uint32_t retries;   // send() refused and repeated
+    uint32_t elapsedMs; // first send() to last delivery
+    uint64_t frames;    // on air, all links
+    uint32_t retransmits;
+    uint32_t expired;
+    uint32_t backpressure; // frames refused by the relays
+    vector<uint32_t> latencyUs;
+};
+
+static Result run(Mode mode, uint32_t nodeCount, uint32_t pockets, float loss, uint32_t latencyUs)
+{
+    vector<Address> addresses(nodeCount);
+    addresses[0] = {1};
+    for (uint32_t i = 1; i < nodeCount; i++)
+    {
+        addresses[i] = addresses[i - 1];
+        addresses[i].push_back(1);
+    }
+
+    VirtualMedium medium(1);
+    VirtualLink link;
+    link.latencyUs = latencyUs;
+    link.loss = loss;
+    medium.setDefaultLink(link);
+
+    array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+
+    Result r{};
+    mutex resultLock;
+    atomic<uint32_t> lastDelivery{0};
+
+    vector<unique_ptr<LHRP_Node_Secure>> nodes;
+    for (uint32_t i = 0; i < nodeCount; i++)
+    {
+        vector<LHRP_Peer> peers;
+        peers.push_back({nodeMac(i), addresses[i]});
+        if (i > 0)
+            peers.push_back({nodeMac(i - 1), addresses[i - 1]});
+        if (i + 1 < nodeCount)
+            peers.push_back({nodeMac(i + 1), addresses[i + 1]});
+
+        LHRP_Node_Secure *n = new LHRP_Node_Secure(111, key, peers);
+        nodes.emplace_back(n);
+
+        n->useRadio(medium.attach(nodeMac(i)));
+        if (mode != MODE_PLAIN)
+            n->useReliability();
+        if (mode == MODE_RELIABLE_PIPELINE)
+            n->usePipeline(-1);
+
+        n->onPocketReceive([&](const Pocket &p)
+                           {
+            uint32_t sentAt;
+            memcpy(&sentAt, p.payload.data(), 4);
+            uint32_t now = platformMicros();
+
+            lock_guard<mutex> guard(resultLock);
+            r.delivered++;
+            r.latencyUs.push_back(now - sentAt);
+            lastDelivery = platformMillis(); });
+
+        if (!n->begin())
+        {
+            fprintf(stderr, "node %u failed to start\n", i);
+            exit(1);
+        }
+    }
+
+    medium.start();
+
+    LHRP_Node_Secure &sender = *nodes[nodeCount - 1];
+    uint32_t start = platformMillis();
+
+    for (uint32_t i = 0; i < pockets; i++)
+    {
+        vector<uint8_t> payload(32);
+        for (;;)
+        {
+            uint32_t now = platformMicros();
+            memcpy(payload.data(), &now, 4);
+            if (sender.send(addresses[0], payload) || mode == MODE_PLAIN)
+                break;
+
+            r.retries++;
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+
+    // retransmissions come from the link timers: wait until nothing arrives for a while
+    uint32_t quietSince = platformMillis();
+    uint32_t seen = 0;
+    while (platformMillis() - quietSince < 2 * LHRP_RTO_MAX_MS)
+    {
+        medium.waitIdle(1000);
+        this_thread::sleep_for(chrono::milliseconds(10));
+
+        lock_guard<mutex> guard(resultLock);
+        if (r.delivered == pockets)
+            break;
+        if (r.delivered != seen)
+        {
+            seen = r.delivered;
+            quietSince = platformMillis();
+        }
+    }
+
+    medium.stop();
+
+    r.elapsedMs = max<uint32_t>(lastDelivery.load() - start, 1);
+    r.frames = medium.stats().sent;
+    for (uint32_t i = 0; i < nodeCount; i++)
+    {
+        for (size_t pin = 1; pin <= nodes[i]->node.connections().size(); pin++)
+        {
+            LHRP_LinkStats s = nodes[i]->linkStats(pin);
+            r.retransmits += s.retransmits;
+            r.expired += s.expired;
+        }
+        if (i != nodeCount - 1)
+            r.backpressure += nodes[i]->metrics().drops[LHRP_DROP_BACKPRESSURE].load();
+    }
+
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t nodeCount = argc > 1 ? atoi(argv[1]) : 4;
+    uint32_t pockets = argc > 2 ? atoi(argv[2]) : 500;
+    float loss = argc > 3 ? atof(argv[3]) : 0.1f;
+    uint32_t latencyUs = argc > 4 ? atoi(argv[4]) : 1000;
+
+    if (nodeCount < 2 || pockets < 1)
+        return 1;
+
+    printf("nodes %u, pockets %u, loss %.3f, latency %u us\n", nodeCount, pockets, loss, latencyUs);
+    printf("%-14s %9s %8s %9s %9s %9s %9s %9s | %9s %9s %9s\n", "mode", "delivered", "retries",
+           "pockets/s", "frames", "retrans", "expired", "refused", "p50 us", "p99 us", "max us");
+
+    for (Mode mode : {MODE_PLAIN, MODE_RELIABLE, MODE_RELIABLE_PIPELINE})
+    {
+        Result r = run(mode, nodeCount, pockets, loss, latencyUs);
+
+        sort(r.latencyUs.begin(), r.latencyUs.end());
+        auto quantile = [&](int q) -> uint32_t
+        {
+            if (r.latencyUs.empty())
+                return 0;
+            return r.latencyUs[min(r.latencyUs.size() - 1, r.latencyUs.size() * q / 100)];
+        };
+
+        printf("%-14s %8.2f%% %8u %9.0f %9llu %9u %9u %9u | %9u %9u %9u\n", modeNames[mode],
+               100.0 * r.delivered / pockets, r.retries, r.delivered * 1000.0 / r.elapsedMs,
+               (unsigned long long)r.frames, r.retransmits, r.expired, r.backpressure,
+               quantile(50), quantile(99), r.latencyUs.empty() ? 0 : r.latencyUs.back());
+    }
+
+    return 0;
+}
@@ -0,0 +1,361 @@
+// Microbenchmarks for the LHRP-secure hot paths (host only, `pio run -e micro-bench`)
+//
+//   micro-bench [--filter text] [--min-ms N] [--json out.json] [--baseline base.json] [--threshold pct]
+//
+// Every case reports ns/op and heap allocations/op. --json saves the results,
+// --baseline compares against an earlier file and exits with 1 if a case got
+// slower than --threshold percent (default 10) or allocates more.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <new>
+#include <functional>
+
+#include "../LHRP-secure/protocol.hpp"
+#include "../LHRP-secure/raw-packet.hpp"
+#include "../LHRP-secure/seq-store.hpp"
+#include "../LHRP-secure/metrics.hpp"
+
+using namespace std;
+
+// ------------------------
+// allocation counting: every operator new of the process goes through here
+static thread_local uint64_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// keeps the compiler from dropping a result
+template <typename T>
+static inline void keep(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// ------------------------
+struct Result
+{
+    string name;
+    double ns;
+    double allocs;
+};
+
+struct Bench
+{
+    string filter;
+    uint32_t minMs = 200;
+    vector<Result> results;
+
+    // runs fn in growing batches until minMs have passed
+    void run(const string &name, const function<void(uint64_t)> &fn)
+    {
+        if (!filter.empty() && name.find(filter) == string::npos)
+            return;
+
+        fn(16); // warm up, lazy allocations
+
+        uint64_t iterations = 64;
+        while (true)
+        {
+            uint64_t before = allocations;
+            auto t0 = chrono::steady_clock::now();
+            fn(iterations);
+            auto t1 = chrono::steady_clock::now();
+            uint64_t allocated = allocations - before;
+
+            double ns = chrono::duration<double, nano>(t1 - t0).count();
+            if (ns >= minMs * 1e6 || iterations >= (1ull << 34))
+            {
+                results.push_back({name, ns / iterations, (double)allocated / iterations});
+                printf("%-44s %12.1f ns/op %8.2f allocs/op\n", name.c_str(), ns / iterations, (double)allocated / iterations);
+                return;
+            }
+
+            iterations *= ns < minMs * 1e5 ? 10 : 2;
+        }
+    }
+};
+
+// address of `depth` bytes below {1, 2, 3, ...}
+static Address makeAddress(size_t depth, uint8_t last = 0)
+{
+    Address a;
+    for (size_t i = 0; i < depth; i++)
+        a.push_back(i + 1);
+    if (last && depth)
+        a[depth - 1] = last;
+    return a;
+}
+
+// node at depth 2 with a parent, children and siblings' subtrees
+static Node makeNode(size_t connections, size_t destDepth)
+{
+    Node node;
+    node.setYou(makeAddress(2));
+    node.addConnection({.address = makeAddress(1), .pin = 1});
+    for (size_t i = 1; i < connections; i++)
+    {
+        Address a = makeAddress(min<size_t>(3 + i % max<size_t>(destDepth - 2, 1), MAX_ADDRESS_DEPTH));
+        a[2] = 10 + i % 200; // different child subtree per connection
+        node.addConnection({.address = a, .pin = (uint8_t)(i + 1)});
+    }
+    node.compile();
+    return node;
+}
+
+// ------------------------
+static void protocolCases(Bench &b)
+{
+    for (size_t depth : {1, 4, 8, 15})
+    {
+        Address conn = makeAddress(depth);
+        Address dest = makeAddress(depth, 99); // differs in the last byte
+        string d = "/depth:" + to_string(depth);
+
+        b.run("match" + d, [&](uint64_t n)
+              { for (uint64_t i = 0; i < n; i++) keep(match(conn, dest)); });
+
+        Match m = match(conn, dest);
+        b.run("matchIndex" + d, [&](uint64_t n)
+              { for (uint64_t i = 0; i < n; i++) { keep(m); keep(matchIndex(m)); } });
+
+        Address parent = makeAddress(depth > 1 ? depth - 1 : 0);
+        b.run("isChildren" + d, [&](uint64_t n)
+              { for (uint64_t i = 0; i < n; i++) keep(isChildren(dest, parent)); });
+    }
+
+    for (size_t connections : {2, 8, 32, 128})
+        for (size_t depth : {4, 8, 15})
+        {
+            Node node = makeNode(connections, depth);
+            Pocket p{};
+            p.destAddress = makeAddress(depth);
+            p.destAddress[2] = 10 + (connections - 1) % 200;
+
+            string suffix = "/conns:" + to_string(connections) + "/depth:" + to_string(depth);
+            b.run("Node::send" + suffix, [&](uint64_t n)
+                  { for (uint64_t i = 0; i < n; i++) { keep(p); keep(node.send(p)); } });
+            b.run("Node::routeLanes" + suffix, [&](uint64_t n)
+                  { for (uint64_t i = 0; i < n; i++) { keep(p); keep(node.routeLanes(p.destAddress)); } });
+            b.run("Node::routeLinear" + suffix, [&](uint64_t n)
+                  { for (uint64_t i = 0; i < n; i++) { keep(p); keep(node.routeLinear(p.destAddress)); } });
+        }
+}
+
+static void packetCases(Bench &b)
+{
+    AesGcm gcm;
+    array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+    gcm.setKey(key);
+
+    for (size_t depth : {1, 4, 15})
+        for (size_t payload : {1, 32, 128, 180})
+        {
+            Pocket p{};
+            p.srcAddress = makeAddress(depth);
+            p.destAddress = makeAddress(depth, 7);
+            p.payload.resize(min<size_t>(payload, maxPayloadSizePocket(p.srcAddress, p.destAddress)));
+
+            string suffix = "/depth:" + to_string(depth) + "/payload:" + to_string(p.payload.size());
+            uint32_t seq = 1;
+
+            b.run("serializePocket" + suffix, [&](uint64_t n)
+                  { for (uint64_t i = 0; i < n; i++) keep(serializePocket(p, 1, gcm, seq++)); });
+
+            RawPacket raw = serializePocket(p, 1, gcm, seq++);
+            b.run("deserializePocket" + suffix, [&](uint64_t n)
+                  { for (uint64_t i = 0; i < n; i++) keep(deserializePocket(raw, 1, gcm)); });
+        }
+
+    for (size_t len : {16, 64, 218})
+    {
+        uint8_t data[218] = {};
+        uint8_t iv[12], tag[16];
+        uint8_t aad[4] = {1, 2, 3, 4};
+        string suffix = "/bytes:" + to_string(len);
+
+        b.run("AesGcm::encrypt" + suffix, [&](uint64_t n)
+              { for (uint64_t i = 0; i < n; i++) keep(gcm.encrypt(data, len, iv, tag, aad, sizeof(aad))); });
+
+        gcm.encrypt(data, len, iv, tag, aad, sizeof(aad));
+        uint8_t sealed[218];
+        memcpy(sealed, data, len);
+        b.run("AesGcm::decrypt" + suffix, [&](uint64_t n)
+              { for (uint64_t i = 0; i < n; i++) { memcpy(data, sealed, len); keep(gcm.decrypt(data, len, iv, tag, aad, sizeof(aad))); } });
+    }
+
+    // whole frames with the node's key schedule, and with a fresh context per
+    // frame (init + setkey + free, what every frame paid before AesGcm kept it)
+    for (size_t payload : {16, 64, 180})
+    {
+        Pocket p{};
+        p.srcAddress = makeAddress(4);
+        p.destAddress = makeAddress(4, 7);
+        p.payload.resize(min<size_t>(payload, maxPayloadSizePocket(p.srcAddress, p.destAddress)));
+
+        RawPacket plain = buildRawPacket(p, 1);
+        RawPacket sealed = plain;
+        uint32_t seq = 1;
+        sealRawPacket(sealed, gcm, seq++);
+
+        string suffix = "/payload:" + to_string(p.payload.size());
+
+        b.run("sealRawPacket" + suffix, [&](uint64_t n)
+              { for (uint64_t i = 0; i < n; i++) { RawPacket r = plain; keep(sealRawPacket(r, gcm, seq++)); keep(r); } });
+        b.run("sealRawPacket+setKey" + suffix, [&](uint64_t n)
+              { for (uint64_t i = 0; i < n; i++) { AesGcm fresh; fresh.setKey(key); RawPacket r = plain; keep(sealRawPacket(r, fresh, seq++)); keep(r); } });
+        b.run("openRawPacket" + suffix, [&](uint64_t n)
+              { for (uint64_t i = 0; i < n; i++) { RawPacket r = sealed; keep(openRawPacket(r, 1, gcm)); keep(r); } });
+        b.run("openRawPacket+setKey" + suffix, [&](uint64_t n)
+              { for (uint64_t i = 0; i < n; i++) { AesGcm fresh; fresh.setKey(key); RawPacket r = sealed; keep(openRawPacket(r, 1, fresh)); keep(r); } });
+    }
+
+    uint8_t mac[6] = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF};
+    char key16[16];
+    b.run("macToNvsKey", [&](uint64_t n)
+          { for (uint64_t i = 0; i < n; i++) { keep(mac); macToNvsKey(key16, 'r', mac); keep(key16); } });
+}
+
+// what one frame costs in counters, compare with deserializePocket
+static void metricsCases(Bench &b)
+{
+    LHRP_Metrics m(8);
+    uint32_t t = 0;
+
+    b.run("LHRP_Metrics::relayed frame", [&](uint64_t n)
+          {
+        for (uint64_t i = 0; i < n; i++)
+        {
+            m.count(m.rx);
+            m.received(i & 7, 120);
+            m.sent((i + 1) & 7, 120);
+            m.relayed(t, t + (i & 1023));
+            t += 3;
+        } });
+
+    b.run("LHRP_Metrics::drop", [&](uint64_t n)
+          { for (uint64_t i = 0; i < n; i++) m.drop((LHRP_DropReason)(i % LHRP_DROP_REASONS)); });
+
+    for (size_t peers : {2, 8, 32})
+    {
+        LHRP_Metrics snap(peers);
+        vector<uint8_t> out(metricsSnapshotSize(peers));
+        b.run("writeMetricsSnapshot/peers:" + to_string(peers), [&](uint64_t n)
+              { for (uint64_t i = 0; i < n; i++) keep(writeMetricsSnapshot(snap, out.data(), out.size())); });
+    }
+    keep(m.forwarded.load());
+}
+
+// ------------------------
+static bool saveJson(const string &path, const vector<Result> &results)
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+
+    fprintf(f, "[\n");
+    for (size_t i = 0; i < results.size(); i++)
+        fprintf(f, "  {\"name\": \"%s\", \"ns\": %.3f, \"allocs\": %.3f}%s\n",
+                results[i].name.c_str(), results[i].ns, results[i].allocs, i + 1 < results.size() ? "," : "");
+    fprintf(f, "]\n");
+    return fclose(f) == 0;
+}
+
+// reads what saveJson() wrote (one result per line)
+static map<string, Result> loadJson(const string &path)
+{
+    map<string, Result> out;
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f)
+        return out;
+
+    char line[512], name[256];
+    double ns, allocs;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, " {\"name\": \"%255[^\"]\", \"ns\": %lf, \"allocs\": %lf", name, &ns, &allocs) == 3)
+            out[name] = {name, ns, allocs};
+
+    fclose(f);
+    return out;
+}
+
+int main(int argc, char **argv)
+{
+    Bench b;
+    string jsonPath, baselinePath;
+    double threshold = 10;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        string arg = argv[i];
+        if (arg == "--filter")
+            b.filter = argv[i + 1];
+        else if (arg == "--min-ms")
+            b.minMs = atoi(argv[i + 1]);
+        else if (arg == "--json")
+            jsonPath = argv[i + 1];
+        else if (arg == "--baseline")
+            baselinePath = argv[i + 1];
+        else if (arg == "--threshold")
+            threshold = atof(argv[i + 1]);
+        else
+        {
+            fprintf(stderr, "unknown argument %s\n", arg.c_str());
+            return 2;
+        }
+    }
+
+    protocolCases(b);
+    packetCases(b);
+    metricsCases(b);
+
+    if (!jsonPath.empty() && !saveJson(jsonPath, b.results))
+    {
+        fprintf(stderr, "cannot write %s\n", jsonPath.c_str());
+        return 2;
+    }
+
+    if (baselinePath.empty())
+        return 0;
+
+    map<string, Result> baseline = loadJson(baselinePath);
+    if (baseline.empty())
+    {
+        fprintf(stderr, "cannot read %s\n", baselinePath.c_str());
+        return 2;
+    }
+
+    int regressions = 0;
+    printf("\n%-44s %12s %12s %8s\n", "vs. baseline", "before", "now", "change");
+    for (auto &r : b.results)
+    {
+        auto it = baseline.find(r.name);
+        if (it == baseline.end())
+            continue;
+
+        double change = (r.ns / it->second.ns - 1) * 100;
+        bool slower = change > threshold;
+        bool allocates = r.allocs > it->second.allocs + 0.005;
+        if (slower || allocates)
+            regressions++;
+
+        printf("%-44s %9.1f ns %9.1f ns %+7.1f%%%s\n", r.name.c_str(), it->second.ns, r.ns, change,
+               allocates ? "  MORE ALLOCS" : slower ? "  SLOWER" : "");
+    }
+
+    printf("%d regression(s)\n", regressions);
+    return regressions ? 1 : 0;
+}
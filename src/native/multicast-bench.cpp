@@ -0,0 +1,150 @@
+// Subtree multicast vs. unicast fan-out on one VirtualMedium (host only, `pio run -e multicast-bench`)
+//
+//   multicast-bench [nodes] [fanout] [rounds]
+//
+// same tree as scale-sim; the last node sends to the subtrees along the
+// leftmost branch, once as one multicast and once as a unicast per member,
+// and reports the frames on air and at the sender for both.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+#include "../LHRP-secure/LHRP.hpp"
+#include "../LHRP-secure/virtual-radio.hpp"
+
+using namespace std;
+
+static array<uint8_t, 6> nodeMac(uint32_t i)
+{
+    return {0x02, 0x00, (uint8_t)(i >> 24), (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+}
+
+struct Cost
+{
+    uint64_t frames;    // on air, all links
+    uint64_t atSender;  // leaving the sender
+    uint64_t delivered; // pockets handed to onPocketReceive
+};
+
+int main(int argc, char **argv)
+{
+    uint32_t nodeCount = argc > 1 ? atoi(argv[1]) : 341;
+    uint32_t fanout = argc > 2 ? atoi(argv[2]) : 4;
+    uint32_t rounds = argc > 3 ? atoi(argv[3]) : 10;
+
+    if (nodeCount < 2 || fanout < 1)
+        return 1;
+
+    vector<Address> addresses(nodeCount);
+    addresses[0] = {1};
+    for (uint32_t i = 1; i < nodeCount; i++)
+    {
+        uint32_t parent = (i - 1) / fanout;
+        addresses[i] = addresses[parent];
+        addresses[i].push_back((i - 1) % fanout + 1);
+        if (addresses[i].size() > MAX_ADDRESS_DEPTH)
+        {
+            fprintf(stderr, "tree deeper than MAX_ADDRESS_DEPTH, raise fanout\n");
+            return 1;
+        }
+    }
+
+    VirtualMedium medium(1);
+    VirtualLink link;
+    link.latencyUs = 100;
+    medium.setDefaultLink(link);
+
+    array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+    atomic<uint64_t> delivered{0};
+
+    vector<unique_ptr<LHRP_Node_Secure>> nodes;
+    nodes.reserve(nodeCount);
+
+    for (uint32_t i = 0; i < nodeCount; i++)
+    {
+        vector<LHRP_Peer> peers;
+        peers.push_back({nodeMac(i), addresses[i]});
+        if (i > 0)
+            peers.push_back({nodeMac((i - 1) / fanout), addresses[(i - 1) / fanout]});
+        for (uint32_t c = i * fanout + 1; c <= i * fanout + fanout && c < nodeCount; c++)
+            peers.push_back({nodeMac(c), addresses[c]});
+
+        LHRP_Node_Secure *n = new LHRP_Node_Secure(111, key, peers);
+        nodes.emplace_back(n);
+
+        n->useRadio(medium.attach(nodeMac(i)));
+        n->onPocketReceive([&](const Pocket &)
+                           { delivered.fetch_add(1, memory_order_relaxed); });
+
+        if (!n->begin())
+        {
+            fprintf(stderr, "node %u failed to start\n", i);
+            return 1;
+        }
+    }
+
+    medium.start();
+
+    uint32_t sender = nodeCount - 1;
+    size_t senderPins = nodes[sender]->node.connections().size();
+    vector<uint8_t> payload(32, 0xA5);
+
+    auto measure = [&](auto sendRound) -> Cost
+    {
+        medium.waitIdle(60000);
+        uint64_t frames = medium.stats().sent;
+        uint64_t atSender = 0;
+        for (size_t pin = 1; pin <= senderPins; pin++)
+            atSender += nodes[sender]->txCount(pin);
+        uint64_t d = delivered.load();
+
+        for (uint32_t r = 0; r < rounds; r++)
+        {
+            sendRound();
+            medium.waitIdle(60000);
+        }
+
+        Cost c{medium.stats().sent - frames, 0, delivered.load() - d};
+        for (size_t pin = 1; pin <= senderPins; pin++)
+            c.atSender += nodes[sender]->txCount(pin);
+        c.atSender -= atSender;
+        return c;
+    };
+
+    printf("nodes %u, fanout %u, rounds %u, sender %u\n", nodeCount, fanout, rounds, sender);
+    printf("%-10s %8s | %10s %10s %10s | %10s %10s %10s | %6s\n", "prefix", "members",
+           "uc frames", "uc sender", "uc deliv", "mc frames", "mc sender", "mc deliv", "saved");
+
+    // prefixes along the leftmost branch: node 0, 1, fanout + 1, ...
+    for (uint32_t p = 0; p < nodeCount; p = p * fanout + 1)
+    {
+        const Address &prefix = addresses[p];
+
+        vector<uint32_t> members;
+        for (uint32_t i = 0; i < nodeCount; i++)
+            if (i != sender && (eq(addresses[i], prefix) || isChildren(addresses[i], prefix)))
+                members.push_back(i);
+
+        Cost uc = measure([&]
+                          {
+            for (uint32_t m : members)
+                nodes[sender]->send(addresses[m], payload); });
+        Cost mc = measure([&]
+                          { nodes[sender]->sendMulticast(prefix, payload); });
+
+        char name[3 * MAX_ADDRESS_DEPTH + 1] = {};
+        for (size_t i = 0, o = 0; i < prefix.size(); i++)
+            o += snprintf(name + o, sizeof(name) - o, i ? ".%u" : "%u", prefix[i]);
+
+        printf("%-10s %8zu | %10llu %10llu %10llu | %10llu %10llu %10llu | %5.1fx\n", name, members.size(),
+               (unsigned long long)uc.frames, (unsigned long long)uc.atSender, (unsigned long long)uc.delivered,
+               (unsigned long long)mc.frames, (unsigned long long)mc.atSender, (unsigned long long)mc.delivered,
+               mc.frames ? (double)uc.frames / mc.frames : 0.0);
+    }
+
+    medium.stop();
+    return 0;
+}
@@ -0,0 +1,177 @@
+// Relay throughput: in-place forwarding vs. the Pocket round trip (host only, `pio run -e relay-bench`)
+//
+//   relay-bench [frames] [depth]
+//
+// one relay between A (address depth `depth` - 1) and B (depth + 1), packets/s
+// for three ways to pass a sealed frame from A on to B:
+//   in place  open, read the route, reseal the same RawPacket (the relay path)
+//   pocket    deserializePocket() + serializePocket(), the path before in-place forwarding
+//   node      LHRP_Node_Secure::onRadioReceive() to Radio::send() on a relay node
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+
+#include "../LHRP-secure/LHRP.hpp"
+
+using namespace std;
+
+// keeps the compiler from dropping a result
+template <typename T>
+static inline void keep(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// keeps the last frame sent
+struct CaptureRadio : Radio
+{
+    ReceiveFn receiveFn = nullptr;
+    void *receiveArg = nullptr;
+    uint8_t frame[RAWPACKET_SIZE];
+    size_t frameLen = 0;
+    uint64_t sent = 0;
+
+    bool begin(uint8_t channel, ReceiveFn receive, SentFn sent, void *arg) override
+    {
+        receiveFn = receive;
+        receiveArg = arg;
+        return true;
+    }
+
+    bool addPeer(const uint8_t mac[6], uint8_t channel) override { return true; }
+
+    bool send(const uint8_t mac[6], const uint8_t *data, size_t len) override
+    {
+        memcpy(frame, data, len);
+        frameLen = len;
+        sent++;
+        return true;
+    }
+};
+
+struct Frame
+{
+    uint8_t data[RAWPACKET_SIZE];
+    size_t len;
+};
+
+static const array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+static const array<uint8_t, 6> macA = {0x02, 0, 0, 0, 0, 1};
+static const array<uint8_t, 6> macR = {0x02, 0, 0, 0, 0, 2};
+static const array<uint8_t, 6> macB = {0x02, 0, 0, 0, 0, 3};
+
+static Address makeAddress(size_t depth)
+{
+    Address a;
+    for (size_t i = 0; i < depth; i++)
+        a.push_back(1);
+    return a;
+}
+
+template <typename Fn>
+static double perSecond(size_t n, Fn fn)
+{
+    auto t0 = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++)
+        fn(i);
+    auto t1 = chrono::steady_clock::now();
+    return n / chrono::duration<double>(t1 - t0).count();
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = argc > 1 ? atol(argv[1]) : 200000;
+    size_t depth = argc > 2 ? atoi(argv[2]) : 4;
+    if (count < 1 || depth < 2 || depth + 1 > MAX_ADDRESS_DEPTH)
+        return 1;
+
+    Address addrA = makeAddress(depth - 1), addrR = makeAddress(depth), addrB = makeAddress(depth + 1);
+
+    Node route;
+    route.setYou(addrR);
+    route.addConnection({.address = addrA, .pin = 1});
+    route.addConnection({.address = addrB, .pin = 2});
+    route.compile();
+
+    AesGcm gcm;
+    gcm.setKey(key);
+
+    printf("frames %zu, relay depth %zu\n", count, depth);
+    printf("%-8s %14s %14s %14s\n", "payload", "in place/s", "pocket/s", "node/s");
+
+    for (size_t payload : {16, 64, 160})
+    {
+        // the frames A sends, every one with its own seq (the relay node checks replay)
+        CaptureRadio radioA, radioR;
+        LHRP_Node_Secure a(1, key, {{macA, addrA}, {macR, addrR}});
+        LHRP_Node_Secure r(1, key, {{macR, addrR}, {macA, addrA}, {macB, addrB}});
+        a.useRadio(radioA);
+        r.useRadio(radioR);
+        if (!a.begin() || !r.begin())
+        {
+            fprintf(stderr, "nodes failed to start\n");
+            return 1;
+        }
+
+        vector<uint8_t> data(min<size_t>(payload, maxPayloadSizePocket(addrA, addrB)));
+        vector<Frame> frames(count);
+        for (Frame &f : frames)
+        {
+            a.send(addrB, data);
+            memcpy(f.data, radioA.frame, radioA.frameLen);
+            f.len = radioA.frameLen;
+        }
+
+        uint32_t seq = 1;
+        int errors = 0;
+
+        double inPlace = perSecond(count, [&](size_t i)
+                                   {
+            RawPacket raw;
+            memcpy(&raw, frames[i].data, frames[i].len);
+            if (openRawPacketChecked(raw, 1, gcm) != OPEN_OK)
+            {
+                errors++;
+                return;
+            }
+
+            Address dest, src;
+            uint16_t flowId;
+            readRawRoute(raw, dest, src, flowId);
+            keep(route.route(dest));
+            sealRawPacket(raw, gcm, seq++);
+            keep(raw); });
+
+        double viaPocket = perSecond(count, [&](size_t i)
+                                     {
+            RawPacket raw;
+            memcpy(&raw, frames[i].data, frames[i].len);
+            Pocket p = deserializePocket(raw, 1, gcm);
+            if (p.errored)
+            {
+                errors++;
+                return;
+            }
+
+            keep(route.route(p.destAddress));
+            RawPacket out = serializePocket(p, 1, gcm, seq++);
+            keep(out); });
+
+        double node = perSecond(count, [&](size_t i)
+                                { radioR.receiveFn(radioR.receiveArg, macA.data(), frames[i].data, frames[i].len, 0); });
+
+        if (errors || radioR.sent != count)
+        {
+            fprintf(stderr, "payload %zu: %d frames did not open, relay sent %llu of %zu\n",
+                    payload, errors, (unsigned long long)radioR.sent, count);
+            return 1;
+        }
+
+        printf("%-8zu %14.0f %14.0f %14.0f\n", data.size(), inPlace, viaPocket, node);
+    }
+
+    return 0;
+}
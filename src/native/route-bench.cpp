@@ -0,0 +1,586 @@
+// Native port of docs/sim.html: LHRP routing (the real Node::send) against
+// BFS, Dijkstra and A* on seeded random trees with extra links (host only)
+//
+//   route-bench [--nodes N] [--extra N] [--depth N] [--trials N] [--max-hops N]
+//               [--seed N] [--threads N] [--algs lhrp,bfs,dijkstra,astar] [--csv]
+//
+// With the same seed the graph and the trial pairs are the ones sim.html draws
+// (mulberry32, same call order). Trials run in parallel, results are JSON or CSV.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "../LHRP-secure/protocol.hpp"
+
+using namespace std;
+
+enum Algorithm
+{
+    ALG_LHRP,
+    ALG_BFS,
+    ALG_DIJKSTRA,
+    ALG_ASTAR,
+    ALG_COUNT
+};
+
+static const char *algorithmNames[ALG_COUNT] = {"lhrp", "bfs", "dijkstra", "astar"};
+
+// ------------------------
+// mulberry32, bit-identical to mkRNG() in sim.html
+struct Mulberry32
+{
+    uint32_t t;
+
+    explicit Mulberry32(uint32_t seed) : t(seed) {}
+
+    double next()
+    {
+        t += 0x6D2B79F5;
+        uint32_t r = (t ^ (t >> 15)) * (1 | t);
+        r ^= r + (r ^ (r >> 7)) * (61 | r);
+        return (double)(r ^ (r >> 14)) / 4294967296.0;
+    }
+
+    uint32_t below(uint32_t n) { return (uint32_t)floor(next() * n); }
+};
+
+// ------------------------
+struct Graph
+{
+    vector<Address> addresses;
+    vector<int32_t> parent;
+    vector<vector<uint32_t>> adj; // parent, children, extra links (sim.html order)
+    vector<Node> nodes;           // compiled, connection pin i + 1 = adj[id][i]
+};
+
+// k-th available node in id order, like nodes.filter(...)[k] in sim.html
+struct AvailableSet
+{
+    vector<uint32_t> tree; // Fenwick tree over node ids
+    uint32_t count = 0;
+
+    explicit AvailableSet(uint32_t n) : tree(n + 1, 0) {}
+
+    void add(uint32_t id, int delta)
+    {
+        count += delta;
+        for (uint32_t i = id + 1; i < tree.size(); i += i & -i)
+            tree[i] += delta;
+    }
+
+    uint32_t kth(uint32_t k) const
+    {
+        uint32_t pos = 0;
+        uint32_t step = 1;
+        while (step * 2 < tree.size())
+            step *= 2;
+
+        for (; step; step /= 2)
+            if (pos + step < tree.size() && tree[pos + step] <= k)
+            {
+                pos += step;
+                k -= tree[pos];
+            }
+        return pos;
+    }
+};
+
+static bool buildGraph(Graph &g, uint32_t nodeCount, uint32_t extraCount, uint32_t maxDepth, Mulberry32 &rng)
+{
+    vector<vector<uint32_t>> children(1);
+    vector<vector<uint32_t>> extra(1);
+    g.addresses = {Address{0}};
+    g.parent = {-1};
+
+    AvailableSet available(nodeCount);
+    if (maxDepth > 1)
+        available.add(0, 1);
+
+    for (uint32_t i = 1; i < nodeCount; i++)
+    {
+        if (!available.count)
+            break;
+
+        uint32_t p = available.kth(rng.below(available.count));
+        Address a = g.addresses[p];
+        a.push_back(children[p].size());
+
+        children[p].push_back(i);
+        if (children[p].size() == 4)
+            available.add(p, -1);
+
+        g.addresses.push_back(a);
+        g.parent.push_back(p);
+        children.emplace_back();
+        extra.emplace_back();
+        if (a.size() < maxDepth)
+            available.add(i, 1);
+    }
+
+    uint32_t n = g.addresses.size();
+    uint32_t attempts = 0;
+    for (uint32_t i = 0; i < extraCount && attempts < extraCount * 400; i++)
+    {
+        attempts++;
+        uint32_t a = rng.below(n);
+        uint32_t b = rng.below(n);
+        if (a == b)
+            continue;
+        if (g.parent[a] == (int32_t)b || g.parent[b] == (int32_t)a)
+            continue;
+        if (find(children[a].begin(), children[a].end(), b) != children[a].end() ||
+            find(children[b].begin(), children[b].end(), a) != children[b].end())
+            continue;
+        if (find(extra[a].begin(), extra[a].end(), b) != extra[a].end())
+            continue;
+        if (abs((int)g.addresses[a].size() - (int)g.addresses[b].size()) < 2)
+            continue;
+        extra[a].push_back(b);
+        extra[b].push_back(a);
+    }
+
+    g.adj.assign(n, {});
+    g.nodes.assign(n, Node{});
+    for (uint32_t id = 0; id < n; id++)
+    {
+        vector<uint32_t> &adj = g.adj[id];
+        if (g.parent[id] >= 0)
+            adj.push_back(g.parent[id]);
+        adj.insert(adj.end(), children[id].begin(), children[id].end());
+        adj.insert(adj.end(), extra[id].begin(), extra[id].end());
+
+        if (adj.size() >= LHRP_PIN_ERROR)
+            return false; // pins are 8 bit
+
+        Node &node = g.nodes[id];
+        node.setYou(g.addresses[id]);
+        for (size_t i = 0; i < adj.size(); i++)
+            node.addConnection({.address = g.addresses[adj[i]], .pin = (uint8_t)(i + 1)});
+        node.compile();
+    }
+
+    return true;
+}
+
+// ------------------------
+struct TrialResult
+{
+    bool success;
+    uint32_t hops;
+    uint32_t ops;
+};
+
+// per-thread search state, reset in O(1) with an epoch instead of O(nodes)
+struct Search
+{
+    vector<uint32_t> seen;
+    vector<uint32_t> dist;
+    vector<int32_t> prev;
+    vector<uint32_t> fifo;
+    uint32_t epoch = 0;
+
+    explicit Search(size_t n) : seen(n, 0), dist(n), prev(n) { fifo.reserve(n); }
+
+    void reset() { epoch++; }
+    bool visited(uint32_t v) const { return seen[v] == epoch; }
+
+    uint32_t distance(uint32_t v) const { return visited(v) ? dist[v] : UINT32_MAX; }
+    void set(uint32_t v, uint32_t d, int32_t from)
+    {
+        seen[v] = epoch;
+        dist[v] = d;
+        prev[v] = from;
+    }
+
+    uint32_t pathLength(uint32_t start, uint32_t goal) const
+    {
+        uint32_t hops = 0;
+        for (uint32_t cur = goal; cur != start; cur = prev[cur])
+            hops++;
+        return hops;
+    }
+};
+
+static TrialResult runBfs(const Graph &g, Search &s, uint32_t start, uint32_t goal)
+{
+    s.reset();
+    s.fifo.clear();
+    s.fifo.push_back(start);
+    s.set(start, 0, -1);
+
+    uint32_t ops = 0;
+    for (size_t head = 0; head < s.fifo.size(); head++)
+    {
+        uint32_t u = s.fifo[head];
+        if (u == goal)
+            break;
+        for (uint32_t v : g.adj[u])
+        {
+            ops++;
+            if (!s.visited(v))
+            {
+                s.set(v, s.dist[u] + 1, u);
+                s.fifo.push_back(v);
+            }
+        }
+    }
+
+    if (!s.visited(goal))
+        return {false, 0, ops};
+    return {true, s.pathLength(start, goal), ops};
+}
+
+static uint32_t prefixLength(const Address &a, const Address &b)
+{
+    uint32_t m = min(a.size(), b.size());
+    uint32_t i = 0;
+    while (i < m && a[i] == b[i])
+        i++;
+    return i;
+}
+
+// Dijkstra with unit weights, A* with the prefix heuristic of sim.html;
+// a binary heap instead of MinPQ's sort-on-push (ties may pop in another order)
+static TrialResult runBestFirst(const Graph &g, Search &s, uint32_t start, uint32_t goal, bool astar)
+{
+    typedef pair<uint32_t, uint32_t> Entry; // priority, node
+    priority_queue<Entry, vector<Entry>, greater<Entry>> open;
+
+    const Address &goalAddr = g.addresses[goal];
+    auto heuristic = [&](uint32_t u) -> uint32_t
+    {
+        if (!astar)
+            return 0;
+        return goalAddr.size() - prefixLength(g.addresses[u], goalAddr);
+    };
+
+    s.reset();
+    s.set(start, 0, -1);
+    open.push({heuristic(start), start});
+
+    uint32_t ops = 0;
+    while (!open.empty())
+    {
+        uint32_t u = open.top().second;
+        open.pop();
+        if (u == goal)
+            break;
+
+        for (uint32_t v : g.adj[u])
+        {
+            ops++;
+            uint32_t d = s.dist[u] + 1;
+            if (d < s.distance(v))
+            {
+                s.set(v, d, u);
+                open.push({d + heuristic(v), v});
+            }
+        }
+    }
+
+    if (!s.visited(goal))
+        return {false, 0, ops};
+    return {true, s.pathLength(start, goal), ops};
+}
+
+// hop by hop with Node::send, like lhrpRoute() in sim.html
+static TrialResult runLhrp(const Graph &g, Search &s, uint32_t start, uint32_t goal, uint32_t maxHops)
+{
+    Pocket p{};
+    p.destAddress = g.addresses[goal];
+
+    s.reset();
+    uint32_t current = start;
+    uint32_t hops = 0;
+    uint32_t ops = 0;
+
+    while (current != goal)
+    {
+        if (s.visited(current))
+            return {false, 0, ops};
+        s.set(current, 0, -1);
+
+        const Node &node = g.nodes[current];
+        uint8_t pin = node.send(p);
+        ops += node.connections().size();
+
+        if (pin == 0 || pin == LHRP_PIN_ERROR)
+            return {false, 0, ops};
+
+        current = g.adj[current][pin - 1];
+        if (++hops > maxHops)
+            return {false, 0, ops};
+    }
+
+    return {true, hops, ops};
+}
+
+// ------------------------
+struct Collector
+{
+    uint64_t successes = 0;
+    uint64_t failures = 0;
+    uint64_t hopSum = 0;
+    uint64_t opsSum = 0;
+    uint64_t opsOnSuccessSum = 0;
+    vector<uint64_t> hopHistogram; // index = hops
+
+    // against BFS (optimal), only where both succeeded
+    uint64_t stretchTrials = 0;
+    double stretchSum = 0;
+    double stretchMax = 0;
+    uint64_t optimal = 0;
+
+    void add(const TrialResult &r)
+    {
+        opsSum += r.ops;
+        if (!r.success)
+        {
+            failures++;
+            return;
+        }
+
+        successes++;
+        hopSum += r.hops;
+        opsOnSuccessSum += r.ops;
+        if (hopHistogram.size() <= r.hops)
+            hopHistogram.resize(r.hops + 1);
+        hopHistogram[r.hops]++;
+    }
+
+    void addStretch(uint32_t hops, uint32_t optimalHops)
+    {
+        double stretch = optimalHops ? (double)hops / optimalHops : 1;
+        stretchTrials++;
+        stretchSum += stretch;
+        stretchMax = max(stretchMax, stretch);
+        if (hops == optimalHops)
+            optimal++;
+    }
+
+    void merge(const Collector &o)
+    {
+        successes += o.successes;
+        failures += o.failures;
+        hopSum += o.hopSum;
+        opsSum += o.opsSum;
+        opsOnSuccessSum += o.opsOnSuccessSum;
+        if (hopHistogram.size() < o.hopHistogram.size())
+            hopHistogram.resize(o.hopHistogram.size());
+        for (size_t i = 0; i < o.hopHistogram.size(); i++)
+            hopHistogram[i] += o.hopHistogram[i];
+        stretchTrials += o.stretchTrials;
+        stretchSum += o.stretchSum;
+        stretchMax = max(stretchMax, o.stretchMax);
+        optimal += o.optimal;
+    }
+
+    double hopPercentile(double q) const
+    {
+        uint64_t target = (uint64_t)ceil(q * successes);
+        uint64_t seen = 0;
+        for (size_t h = 0; h < hopHistogram.size(); h++)
+        {
+            seen += hopHistogram[h];
+            if (seen >= max<uint64_t>(target, 1))
+                return h;
+        }
+        return 0;
+    }
+};
+
+struct Trial
+{
+    uint32_t start;
+    uint32_t goal;
+};
+
+// ------------------------
+int main(int argc, char **argv)
+{
+    uint32_t nodeCount = 200, extra = 60, depth = 6, trials = 2000, maxHops = 300, seed = 1;
+    uint32_t threads = max(1u, thread::hardware_concurrency());
+    bool enabled[ALG_COUNT] = {true, true, true, true};
+    bool csv = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : "";
+
+        if (arg == "--csv")
+            csv = true;
+        else if (arg == "--nodes")
+            nodeCount = max(2, atoi(value)), i++;
+        else if (arg == "--extra")
+            extra = max(0, atoi(value)), i++;
+        else if (arg == "--depth")
+            depth = max(1, min(MAX_ADDRESS_DEPTH, atoi(value))), i++;
+        else if (arg == "--trials")
+            trials = max(1, atoi(value)), i++;
+        else if (arg == "--max-hops")
+            maxHops = max(1, atoi(value)), i++;
+        else if (arg == "--seed")
+            seed = strtoul(value, nullptr, 10), i++;
+        else if (arg == "--threads")
+            threads = max(1, atoi(value)), i++;
+        else if (arg == "--algs")
+        {
+            string list = string(",") + value + ",";
+            for (int a = 0; a < ALG_COUNT; a++)
+                enabled[a] = list.find(string(",") + algorithmNames[a] + ",") != string::npos;
+            i++;
+        }
+        else
+        {
+            fprintf(stderr, "unknown argument %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    auto t0 = chrono::steady_clock::now();
+
+    Mulberry32 rng(seed);
+    Graph g;
+    if (!buildGraph(g, nodeCount, extra, depth, rng))
+    {
+        fprintf(stderr, "a node has more than %d links\n", LHRP_PIN_ERROR - 1);
+        return 1;
+    }
+
+    uint32_t n = g.addresses.size();
+    vector<Trial> pairs(trials);
+    for (uint32_t i = 0; i < trials; i++)
+    {
+        uint32_t a, b;
+        do
+        {
+            a = rng.below(n);
+            b = rng.below(n);
+        } while (a == b);
+        pairs[i] = {a, b};
+    }
+
+    auto t1 = chrono::steady_clock::now();
+
+    // stretch is measured against BFS: without bfs in --algs it is not reported
+    vector<Collector> results(threads * ALG_COUNT);
+    vector<thread> workers;
+
+    for (uint32_t t = 0; t < threads; t++)
+        workers.emplace_back([&, t]
+                             {
+            Search s(n);
+            Collector *c = &results[t * ALG_COUNT];
+
+            for (uint32_t i = t; i < trials; i += threads)
+            {
+                uint32_t a = pairs[i].start, b = pairs[i].goal;
+
+                TrialResult bfs{false, 0, 0};
+                if (enabled[ALG_BFS])
+                {
+                    bfs = runBfs(g, s, a, b);
+                    c[ALG_BFS].add(bfs);
+                }
+
+                if (enabled[ALG_DIJKSTRA])
+                    c[ALG_DIJKSTRA].add(runBestFirst(g, s, a, b, false));
+                if (enabled[ALG_ASTAR])
+                {
+                    TrialResult r = runBestFirst(g, s, a, b, true);
+                    c[ALG_ASTAR].add(r);
+                    if (r.success && bfs.success)
+                        c[ALG_ASTAR].addStretch(r.hops, bfs.hops);
+                }
+                if (enabled[ALG_LHRP])
+                {
+                    TrialResult r = runLhrp(g, s, a, b, maxHops);
+                    c[ALG_LHRP].add(r);
+                    if (r.success && bfs.success)
+                        c[ALG_LHRP].addStretch(r.hops, bfs.hops);
+                }
+            } });
+
+    for (auto &w : workers)
+        w.join();
+
+    auto t2 = chrono::steady_clock::now();
+
+    Collector total[ALG_COUNT];
+    for (uint32_t t = 0; t < threads; t++)
+        for (int a = 0; a < ALG_COUNT; a++)
+            total[a].merge(results[t * ALG_COUNT + a]);
+
+    size_t degreeSum = 0, minDegree = SIZE_MAX, maxDegree = 0;
+    for (auto &adj : g.adj)
+    {
+        degreeSum += adj.size();
+        minDegree = min(minDegree, adj.size());
+        maxDegree = max(maxDegree, adj.size());
+    }
+
+    double buildSeconds = chrono::duration<double>(t1 - t0).count();
+    double runSeconds = chrono::duration<double>(t2 - t1).count();
+
+    if (csv)
+    {
+        printf("algorithm,nodes,extraEdges,maxDepth,trials,threads,successRate,avgHop,medianHop,p90Hop,avgOps,avgOpsOnSuccess,avgStretch,maxStretch,optimalRate,trialsPerSecond\n");
+        for (int a = 0; a < ALG_COUNT; a++)
+        {
+            if (!enabled[a])
+                continue;
+            const Collector &c = total[a];
+            double ok = c.successes ? c.successes : 1;
+            char stretch[64] = ",,"; // empty without bfs
+            if (enabled[ALG_BFS])
+                snprintf(stretch, sizeof(stretch), "%.4f,%.3f,%.6f",
+                         c.stretchTrials ? c.stretchSum / c.stretchTrials : 1.0, c.stretchTrials ? c.stretchMax : 1.0,
+                         c.stretchTrials ? (double)c.optimal / c.stretchTrials : 1.0);
+
+            printf("%s,%u,%u,%u,%u,%u,%.6f,%.3f,%.0f,%.0f,%.3f,%.3f,%s,%.0f\n",
+                   algorithmNames[a], n, extra, depth, trials, threads,
+                   (double)c.successes / trials, c.hopSum / ok, c.hopPercentile(0.5), c.hopPercentile(0.9),
+                   (double)c.opsSum / trials, c.opsOnSuccessSum / ok, stretch, trials / runSeconds);
+        }
+        return 0;
+    }
+
+    printf("{\n");
+    printf("  \"network\": {\"nodes\": %u, \"extraEdges\": %u, \"maxDepth\": %u, \"avgDegree\": %.3f, \"minDegree\": %zu, \"maxDegree\": %zu},\n",
+           n, extra, depth, (double)degreeSum / n, minDegree, maxDegree);
+    printf("  \"trials\": %u,\n  \"seed\": %u,\n  \"threads\": %u,\n", trials, seed, threads);
+    printf("  \"algorithms\": {");
+
+    bool first = true;
+    for (int a = 0; a < ALG_COUNT; a++)
+    {
+        if (!enabled[a])
+            continue;
+        const Collector &c = total[a];
+        double ok = c.successes ? c.successes : 1;
+
+        printf("%s\n    \"%s\": {\"successRate\": %.6f, \"avgHop\": %.3f, \"medianHop\": %.0f, \"p90Hop\": %.0f, \"avgOps\": %.3f, \"avgOpsOnSuccess\": %.3f",
+               first ? "" : ",", algorithmNames[a], (double)c.successes / trials, c.hopSum / ok,
+               c.hopPercentile(0.5), c.hopPercentile(0.9), (double)c.opsSum / trials, c.opsOnSuccessSum / ok);
+        if (a != ALG_BFS && enabled[ALG_BFS])
+            printf(", \"avgStretch\": %.4f, \"maxStretch\": %.3f, \"optimalRate\": %.6f",
+                   c.stretchTrials ? c.stretchSum / c.stretchTrials : 1.0, c.stretchTrials ? c.stretchMax : 1.0,
+                   c.stretchTrials ? (double)c.optimal / c.stretchTrials : 1.0);
+        printf("}");
+        first = false;
+    }
+
+    printf("\n  },\n");
+    printf("  \"build_seconds\": %.3f,\n  \"duration_seconds\": %.3f,\n  \"trials_per_second\": %.0f\n}\n",
+           buildSeconds, runSeconds, trials / runSeconds);
+    return 0;
+}
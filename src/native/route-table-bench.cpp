@@ -0,0 +1,99 @@
+// Compiled routing table vs. the linear connection scan (host only, `pio run -e route-table-bench`)
+//
+//   route-table-bench [lookups] [seed]
+//
+// one node at depth 2 with 10, 100 and 1000 connections (parent, children
+// and random addresses that share prefixes), random destinations around
+// them; reports lookups/s of Node::route() (compiled trie) and of
+// Node::routeLinear() and exits with 1 if the two ever pick different pins.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <chrono>
+#include <random>
+
+#include "../LHRP-secure/protocol.hpp"
+
+using namespace std;
+
+// keeps the compiler from dropping a result
+template <typename T>
+static inline void keep(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static Address randomAddress(mt19937 &rng, size_t minDepth)
+{
+    Address a;
+    size_t depth = minDepth + rng() % (MAX_ADDRESS_DEPTH / 2);
+    for (size_t i = 0; i < depth; i++)
+        a.push_back(1 + rng() % 4); // few values per level: long shared prefixes
+    return a;
+}
+
+static Node makeNode(size_t connections, mt19937 &rng)
+{
+    Node node;
+    node.setYou({1, 1});
+    node.addConnection({.address = {1}, .pin = 1});
+    for (size_t i = 1; i < connections; i++)
+    {
+        Address a = i % 4 ? randomAddress(rng, 1) : Address{1, 1, (uint8_t)(i / 4 + 1)};
+        node.addConnection({.address = a, .pin = (uint8_t)(i % 254 + 1)});
+    }
+    node.compile();
+    return node;
+}
+
+static double lookupsPerSec(const vector<Address> &dests, size_t lookups, uint8_t (*route)(const Node &, const Address &), const Node &node)
+{
+    auto t0 = chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; i++)
+        keep(route(node, dests[i % dests.size()]));
+    auto t1 = chrono::steady_clock::now();
+    return lookups / chrono::duration<double>(t1 - t0).count();
+}
+
+int main(int argc, char **argv)
+{
+    size_t lookups = argc > 1 ? atol(argv[1]) : 2000000;
+    uint32_t seed = argc > 2 ? atoi(argv[2]) : 1;
+    mt19937 rng(seed);
+
+    printf("%-12s %16s %16s %9s\n", "connections", "trie lookups/s", "linear lookups/s", "speedup");
+
+    int mismatches = 0;
+    for (size_t connections : {10, 100, 1000})
+    {
+        Node node = makeNode(connections, rng);
+
+        // around the connections: the same address, one level below or a sibling
+        vector<Address> dests;
+        for (size_t i = 0; i < 4096; i++)
+        {
+            Address d = node.connections()[rng() % connections].address;
+            if (rng() % 2)
+                d.push_back(1 + rng() % 4);
+            else if (rng() % 2 && d.size() > 0)
+                d[d.size() - 1] = 1 + rng() % 4;
+            dests.push_back(d);
+        }
+
+        for (const Address &d : dests)
+            mismatches += node.route(d) != node.routeLinear(d);
+
+        double trie = lookupsPerSec(dests, lookups, [](const Node &n, const Address &d)
+                                    { return n.route(d); }, node);
+        // fewer rounds: the scan grows with the connections
+        double linear = lookupsPerSec(dests, lookups / (connections / 10), [](const Node &n, const Address &d)
+                                      { return n.routeLinear(d); }, node);
+
+        printf("%-12zu %16.0f %16.0f %8.1fx\n", connections, trie, linear, trie / linear);
+    }
+
+    if (mismatches)
+        fprintf(stderr, "route() and routeLinear() disagree on %d destinations\n", mismatches);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,168 @@
+// Many LHRP_Node_Secure instances on one VirtualMedium (host only, `pio run -e native`)
+//
+//   scale-sim [nodes] [fanout] [pockets] [loss] [latencyUs] [bytesPerSec] [storeDir]
+//
+// builds a tree (node i hangs below node (i - 1) / fanout), sends `pockets`
+// pockets between random nodes and reports delivery, throughput and latency.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <random>
+
+#include "../LHRP-secure/LHRP.hpp"
+#include "../LHRP-secure/virtual-radio.hpp"
+
+using namespace std;
+
+#ifndef PIO_UNIT_TESTING // pio test -e native links the tests instead
+
+static array<uint8_t, 6> nodeMac(uint32_t i)
+{
+    return {0x02, 0x00, (uint8_t)(i >> 24), (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t nodeCount = argc > 1 ? atoi(argv[1]) : 1000;
+    uint32_t fanout = argc > 2 ? atoi(argv[2]) : 4;
+    uint32_t pockets = argc > 3 ? atoi(argv[3]) : 20000;
+    float loss = argc > 4 ? atof(argv[4]) : 0;
+    uint32_t latencyUs = argc > 5 ? atoi(argv[5]) : 1000;
+    uint32_t bytesPerSec = argc > 6 ? atoi(argv[6]) : 0;
+    string storeDir = argc > 7 ? argv[7] : "";
+
+    if (nodeCount < 2 || fanout < 1)
+        return 1;
+
+    // addresses: child k of a node gets the parent address + {k + 1}
+    vector<Address> addresses(nodeCount);
+    addresses[0] = {1};
+    for (uint32_t i = 1; i < nodeCount; i++)
+    {
+        uint32_t parent = (i - 1) / fanout;
+        addresses[i] = addresses[parent];
+        addresses[i].push_back((i - 1) % fanout + 1);
+        if (addresses[i].size() > MAX_ADDRESS_DEPTH)
+        {
+            fprintf(stderr, "tree deeper than MAX_ADDRESS_DEPTH, raise fanout\n");
+            return 1;
+        }
+    }
+
+    VirtualMedium medium(1);
+    VirtualLink link;
+    link.latencyUs = latencyUs;
+    link.loss = loss;
+    link.bytesPerSec = bytesPerSec;
+    medium.setDefaultLink(link);
+
+    array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+
+    atomic<uint64_t> delivered{0};
+    atomic<uint64_t> latencySumUs{0};
+    vector<atomic<uint32_t>> histogram(32); // log2 buckets of latency in us
+    for (auto &h : histogram)
+        h = 0;
+
+    vector<unique_ptr<LHRP_Node_Secure>> nodes;
+    nodes.reserve(nodeCount);
+
+    for (uint32_t i = 0; i < nodeCount; i++)
+    {
+        vector<LHRP_Peer> peers;
+        peers.push_back({nodeMac(i), addresses[i]});
+        if (i > 0)
+            peers.push_back({nodeMac((i - 1) / fanout), addresses[(i - 1) / fanout]});
+        for (uint32_t c = i * fanout + 1; c <= i * fanout + fanout && c < nodeCount; c++)
+            peers.push_back({nodeMac(c), addresses[c]});
+
+        LHRP_Node_Secure *n = new LHRP_Node_Secure(111, key, peers);
+        nodes.emplace_back(n);
+
+        n->useRadio(medium.attach(nodeMac(i)));
+        if (!storeDir.empty())
+            n->store.useFile(storeDir + "/node-" + to_string(i) + ".seq");
+
+        n->onPocketReceive([&](const Pocket &p)
+                           {
+            uint32_t sentAt;
+            memcpy(&sentAt, p.payload.data(), 4);
+            uint32_t us = platformMicros() - sentAt;
+
+            delivered.fetch_add(1, memory_order_relaxed);
+            latencySumUs.fetch_add(us, memory_order_relaxed);
+            int bucket = 0;
+            while ((1u << bucket) < us && bucket < 31)
+                bucket++;
+            histogram[bucket].fetch_add(1, memory_order_relaxed); });
+
+        if (!n->begin())
+        {
+            fprintf(stderr, "node %u failed to start\n", i);
+            return 1;
+        }
+    }
+
+    medium.start();
+
+    mt19937 rng(42);
+    uint32_t refused = 0;
+    uint32_t start = platformMillis();
+
+    for (uint32_t i = 0; i < pockets; i++)
+    {
+        uint32_t from = rng() % nodeCount;
+        uint32_t to = rng() % nodeCount;
+        while (to == from)
+            to = rng() % nodeCount;
+
+        vector<uint8_t> payload(32);
+        uint32_t now = platformMicros();
+        memcpy(payload.data(), &now, 4);
+
+        if (!nodes[from]->send(addresses[to], payload))
+            refused++;
+    }
+
+    medium.waitIdle(60000);
+    uint32_t elapsedMs = max<uint32_t>(platformMillis() - start, 1);
+    medium.stop();
+
+    VirtualMediumStats m = medium.stats();
+    uint64_t d = delivered.load();
+
+    printf("nodes %u, fanout %u, pockets %u, loss %.3f, latency %u us\n", nodeCount, fanout, pockets, loss, latencyUs);
+    printf("delivered %llu (%.2f%%), refused %u, %.0f pockets/s\n",
+           (unsigned long long)d, 100.0 * d / pockets, refused, d * 1000.0 / elapsedMs);
+    printf("frames sent %llu, delivered %llu, lost %llu, unreachable %llu\n",
+           (unsigned long long)m.sent, (unsigned long long)m.delivered,
+           (unsigned long long)m.lost, (unsigned long long)m.unreachable);
+
+    if (d)
+    {
+        printf("latency mean %llu us\n", (unsigned long long)(latencySumUs.load() / d));
+        uint64_t seen = 0;
+        for (int q : {50, 90, 99})
+        {
+            seen = 0;
+            for (int b = 0; b < 32; b++)
+            {
+                seen += histogram[b];
+                if (seen * 100 >= d * q)
+                {
+                    printf("latency p%d <= %u us\n", q, 1u << b);
+                    break;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,179 @@
+// No heap allocation on the packet path once begin() returned
+// (`pio test -e native`)
+
+#include <unity.h>
+#include <stdlib.h>
+#include <new>
+
+#include "LHRP-secure/LHRP.hpp"
+
+using namespace std;
+
+// ------------------------
+// allocation counting, only on the thread inside measure()
+static thread_local bool counting = false;
+static thread_local uint64_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    if (counting)
+        allocations++;
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+template <typename Fn>
+static uint64_t measure(Fn fn)
+{
+    allocations = 0;
+    counting = true;
+    fn();
+    counting = false;
+    return allocations;
+}
+
+// keeps the last frame sent, the test hands it to the next node itself
+struct CaptureRadio : Radio
+{
+    ReceiveFn receiveFn = nullptr;
+    void *receiveArg = nullptr;
+    uint8_t frame[RAWPACKET_SIZE];
+    size_t frameLen = 0;
+    uint8_t to[6];
+
+    bool begin(uint8_t channel, ReceiveFn receive, SentFn sent, void *arg) override
+    {
+        receiveFn = receive;
+        receiveArg = arg;
+        return true;
+    }
+
+    bool addPeer(const uint8_t mac[6], uint8_t channel) override { return true; }
+
+    bool send(const uint8_t mac[6], const uint8_t *data, size_t len) override
+    {
+        memcpy(to, mac, 6);
+        memcpy(frame, data, len);
+        frameLen = len;
+        return true;
+    }
+
+    // the frame this radio sent last arrives at `next`
+    void deliver(CaptureRadio &next, const uint8_t mac[6])
+    {
+        size_t len = frameLen;
+        frameLen = 0;
+        next.receiveFn(next.receiveArg, mac, frame, len, 0);
+    }
+};
+
+static const array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+static const array<uint8_t, 6> macA = {0x02, 0, 0, 0, 0, 1};
+static const array<uint8_t, 6> macR = {0x02, 0, 0, 0, 0, 2};
+static const array<uint8_t, 6> macB = {0x02, 0, 0, 0, 0, 3};
+
+// A {1} - R {1, 1} - B {1, 1, 1}
+struct Line
+{
+    CaptureRadio radioA, radioR, radioB;
+    LHRP_Node_Secure a{1, key, {{macA, {1}}, {macR, {1, 1}}}};
+    LHRP_Node_Secure r{1, key, {{macR, {1, 1}}, {macA, {1}}, {macB, {1, 1, 1}}}};
+    LHRP_Node_Secure b{1, key, {{macB, {1, 1, 1}}, {macR, {1, 1}}}};
+    uint32_t atR = 0, atB = 0;
+
+    Line()
+    {
+        a.useRadio(radioA);
+        r.useRadio(radioR);
+        b.useRadio(radioB);
+        r.onPocketReceive([this](const Pocket &)
+                          { atR++; });
+        b.onPocketReceive([this](const Pocket &)
+                          { atB++; });
+    }
+
+    bool begin() { return a.begin() && r.begin() && b.begin(); }
+};
+
+static vector<uint8_t> payload(size_t n)
+{
+    vector<uint8_t> p(n);
+    for (size_t i = 0; i < n; i++)
+        p[i] = i;
+    return p;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_counter_sees_allocations()
+{
+    // the nodes' tables live on the heap
+    TEST_ASSERT_TRUE(measure([]
+                             { Line line; }) > 0);
+}
+
+void test_relay_and_deliver_without_allocation()
+{
+    Line line;
+    TEST_ASSERT_TRUE(line.begin());
+    vector<uint8_t> data = payload(64);
+
+    // first frames: lazily built state is allowed
+    for (int i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_TRUE(line.a.send({1, 1, 1}, data));
+        line.radioA.deliver(line.radioR, macA.data());
+        line.radioR.deliver(line.radioB, macR.data());
+    }
+    TEST_ASSERT_EQUAL_UINT32(4, line.atB);
+
+    for (int i = 0; i < 200; i++)
+    {
+        TEST_ASSERT_TRUE(line.a.send({1, 1, 1}, data));
+
+        // receive, open, route and reseal for the next hop
+        TEST_ASSERT_EQUAL_UINT32(0, measure([&]
+                                            { line.radioA.deliver(line.radioR, macA.data()); }));
+        TEST_ASSERT_EQUAL_size_t(0, line.radioA.frameLen);
+        TEST_ASSERT_TRUE(line.radioR.frameLen > 0);
+        TEST_ASSERT_EQUAL_UINT8(macB[5], line.radioR.to[5]);
+
+        // receive and hand to onPocketReceive
+        TEST_ASSERT_EQUAL_UINT32(0, measure([&]
+                                            { line.radioR.deliver(line.radioB, macR.data()); }));
+    }
+    TEST_ASSERT_EQUAL_UINT32(204, line.atB);
+    TEST_ASSERT_EQUAL_UINT32(0, line.atR);
+}
+
+void test_local_delivery_without_allocation()
+{
+    Line line;
+    TEST_ASSERT_TRUE(line.begin());
+    vector<uint8_t> data = payload(16);
+
+    TEST_ASSERT_TRUE(line.a.send({1, 1}, data));
+    line.radioA.deliver(line.radioR, macA.data());
+
+    for (int i = 0; i < 200; i++)
+    {
+        TEST_ASSERT_TRUE(line.a.send({1, 1}, data));
+        TEST_ASSERT_EQUAL_UINT32(0, measure([&]
+                                            { line.radioA.deliver(line.radioR, macA.data()); }));
+    }
+    TEST_ASSERT_EQUAL_UINT32(201, line.atR);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_counter_sees_allocations);
+    RUN_TEST(test_relay_and_deliver_without_allocation);
+    RUN_TEST(test_local_delivery_without_allocation);
+    return UNITY_END();
+}
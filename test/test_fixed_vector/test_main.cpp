@@ -0,0 +1,113 @@
+// FixedVector reports what it drops beyond its capacity, and send() refuses
+// a pocket whose address or payload was cut off (`pio test -e native`)
+
+#include <unity.h>
+
+#include "LHRP-secure/LHRP.hpp"
+
+using namespace std;
+
+static const array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+static const array<uint8_t, 6> macA = {2, 0, 0, 0, 0, 1}, macB = {2, 0, 0, 0, 0, 2};
+
+// counts the frames sent
+struct CountRadio : Radio
+{
+    int frames = 0;
+
+    bool begin(uint8_t channel, ReceiveFn receive, SentFn sent, void *arg) override { return true; }
+    bool addPeer(const uint8_t mac[6], uint8_t channel) override { return true; }
+
+    bool send(const uint8_t mac[6], const uint8_t *data, size_t len) override
+    {
+        frames++;
+        return true;
+    }
+};
+
+void setUp() {}
+void tearDown() {}
+
+void test_push_back_and_resize_report_overflow()
+{
+    FixedVector<uint8_t, 4> v;
+    for (uint8_t i = 0; i < 4; i++)
+        TEST_ASSERT_TRUE(v.push_back(i));
+    TEST_ASSERT_FALSE(v.truncated);
+
+    TEST_ASSERT_FALSE(v.push_back(4));
+    TEST_ASSERT_TRUE(v.truncated);
+    TEST_ASSERT_EQUAL(4, v.size());
+
+    // stays set until the contents are replaced
+    FixedVector<uint8_t, 4> copy = v;
+    TEST_ASSERT_TRUE(copy.truncated);
+    v.clear();
+    TEST_ASSERT_FALSE(v.truncated);
+
+    TEST_ASSERT_FALSE(v.resize(5));
+    TEST_ASSERT_TRUE(v.truncated);
+    TEST_ASSERT_EQUAL(4, v.size());
+    TEST_ASSERT_TRUE(v.resize(2));
+    TEST_ASSERT_FALSE(v.truncated);
+}
+
+void test_construction_reports_overflow()
+{
+    uint8_t bytes[6] = {1, 2, 3, 4, 5, 6};
+    FixedVector<uint8_t, 4> v;
+    TEST_ASSERT_FALSE(v.assign(bytes, bytes + 6));
+    TEST_ASSERT_TRUE(v.truncated);
+    TEST_ASSERT_TRUE(v.assign(bytes, bytes + 4));
+    TEST_ASSERT_FALSE(v.truncated);
+
+    TEST_ASSERT_TRUE((FixedVector<uint8_t, 4>{1, 2, 3, 4, 5}).truncated);
+    TEST_ASSERT_TRUE((FixedVector<uint8_t, 4>(vector<uint8_t>(5))).truncated);
+    TEST_ASSERT_TRUE((FixedVector<uint8_t, 4>(5, 0)).truncated);
+    TEST_ASSERT_FALSE((FixedVector<uint8_t, 4>(vector<uint8_t>(4))).truncated);
+}
+
+void test_send_refuses_cut_off_pocket()
+{
+    CountRadio radio;
+    LHRP_Node_Secure a(1, key, {{macA, {1}}, {macB, {1, 1}}});
+    a.useRadio(radio);
+    TEST_ASSERT_TRUE(a.begin());
+
+    Pocket p{};
+    p.destAddress = {1, 1};
+    p.srcAddress = a.node.you();
+    p.payload = vector<uint8_t>(MAX_POCKET_PAYLOAD + 1, 7);
+    TEST_ASSERT_FALSE(a.send(p));
+
+    // a destination deeper than MAX_ADDRESS_DEPTH would be routed to its cut-off prefix
+    p.payload = {1, 2, 3};
+    p.destAddress = Address(MAX_ADDRESS_DEPTH + 1, 1);
+    TEST_ASSERT_FALSE(a.send(p));
+
+    // local delivery is refused just as well
+    int delivered = 0;
+    a.onPocketReceive([&](const Pocket &)
+                      { delivered++; });
+    p.destAddress = a.node.you();
+    p.payload.resize(MAX_POCKET_PAYLOAD + 1);
+    TEST_ASSERT_FALSE(a.send(p));
+
+    TEST_ASSERT_EQUAL_UINT32(3, a.metrics().drops[LHRP_DROP_TRUNCATED].load());
+    TEST_ASSERT_EQUAL(0, radio.frames);
+    TEST_ASSERT_EQUAL(0, delivered);
+
+    p.destAddress = {1, 1};
+    p.payload = {1, 2, 3};
+    TEST_ASSERT_TRUE(a.send(p));
+    TEST_ASSERT_EQUAL(1, radio.frames);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_push_back_and_resize_report_overflow);
+    RUN_TEST(test_construction_reports_overflow);
+    RUN_TEST(test_send_refuses_cut_off_pocket);
+    return UNITY_END();
+}
@@ -0,0 +1,131 @@
+// Address headers: plain and compact (LHRP_FLAG_COMPACT) forms round-trip for every
+// dest / src depth up to MAX_ADDRESS_DEPTH, and a compact prefix byte that does
+// not fit the lengths is refused after decryption (`pio test -e native`)
+
+#include <unity.h>
+
+#include "LHRP-secure/raw-packet.hpp"
+
+using namespace std;
+
+static const array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+static AesGcm gcm;
+
+// dest and src share the first `common` bytes and differ right after
+static void makeAddresses(uint8_t dstLen, uint8_t srcLen, uint8_t common, Address &dest, Address &src)
+{
+    dest.clear();
+    src.clear();
+    for (uint8_t i = 0; i < dstLen; i++)
+        dest.push_back(i < common ? i + 1 : 0x40 + i);
+    for (uint8_t i = 0; i < srcLen; i++)
+        src.push_back(i < common ? i + 1 : 0x80 + i);
+}
+
+template <typename A, typename B>
+static bool same(const A &a, const B &b)
+{
+    return a.size() == b.size() && equal(a.begin(), a.end(), b.begin());
+}
+
+// seal and open again, as the next hop does
+static OpenResult roundTrip(RawPacket &r, uint32_t seq)
+{
+    TEST_ASSERT_TRUE(sealRawPacket(r, gcm, seq));
+    return openRawPacketChecked(r, 1, gcm);
+}
+
+static void checkRoundTrip(uint8_t dstLen, uint8_t srcLen, uint8_t common, bool trace)
+{
+    Pocket p{};
+    makeAddresses(dstLen, srcLen, common, p.destAddress, p.srcAddress);
+    TEST_ASSERT_EQUAL_UINT8(common, addressCommonPrefix(p.destAddress, p.srcAddress));
+    p.trace = trace;
+
+    // the whole room, so a wrong addressBlockSize() would cut the payload
+    uint8_t room = maxPayloadSizePocket(p.srcAddress, p.destAddress, false, trace);
+    TEST_ASSERT_TRUE(room > 0);
+    for (uint8_t i = 0; i < room; i++)
+        p.payload.push_back(i);
+
+    RawPacket r = buildRawPacket(p, 1);
+    bool compact = trace || (LHRP_COMPACT_ADDRESSES && common >= 2);
+    TEST_ASSERT_EQUAL(compact, (r.flags & LHRP_FLAG_COMPACT) != 0);
+    TEST_ASSERT_EQUAL(4 + addressBlockSize(dstLen, srcLen, common, trace) + room + (trace ? 2 : 0),
+                      r.dataLen); // the hops add their trace records later
+
+    uint32_t seq = (dstLen << 8) | srcLen;
+    TEST_ASSERT_EQUAL(OPEN_OK, roundTrip(r, seq));
+
+    Pocket out{};
+    readRawPocket(r, out);
+    TEST_ASSERT_EQUAL_UINT32(seq, out.seq);
+    TEST_ASSERT_TRUE(same(out.destAddress, p.destAddress));
+    TEST_ASSERT_TRUE(same(out.srcAddress, p.srcAddress));
+    TEST_ASSERT_TRUE(same(out.payload, p.payload));
+    TEST_ASSERT_EQUAL(trace, out.trace);
+}
+
+void setUp()
+{
+    TEST_ASSERT_TRUE(gcm.setKey(key));
+}
+
+void tearDown() {}
+
+void test_plain_and_compact_round_trip()
+{
+    for (uint8_t dstLen = 0; dstLen <= MAX_ADDRESS_DEPTH; dstLen++)
+        for (uint8_t srcLen = 0; srcLen <= MAX_ADDRESS_DEPTH; srcLen++)
+            for (uint8_t common = 0; common <= min(dstLen, srcLen); common++)
+                checkRoundTrip(dstLen, srcLen, common, false);
+}
+
+// traced pockets carry the prefix byte even without a common prefix
+void test_traced_round_trip()
+{
+    for (uint8_t dstLen = 0; dstLen <= MAX_ADDRESS_DEPTH; dstLen++)
+        for (uint8_t srcLen = 0; srcLen <= MAX_ADDRESS_DEPTH; srcLen++)
+            for (uint8_t common = 0; common <= min(dstLen, srcLen); common++)
+                checkRoundTrip(dstLen, srcLen, common, true);
+}
+
+// a compact frame with the prefix byte replaced, sealed with the right key:
+// only the check after decryption can catch it
+static OpenResult openWithPrefix(uint8_t dstLen, uint8_t srcLen, uint8_t common, uint8_t prefix)
+{
+    Pocket p{};
+    makeAddresses(dstLen, srcLen, common, p.destAddress, p.srcAddress);
+    p.payload = {1, 2, 3};
+
+    RawPacket r = buildRawPacket(p, 1);
+    TEST_ASSERT_TRUE(r.flags & LHRP_FLAG_COMPACT);
+    TEST_ASSERT_EQUAL_UINT8(common, r.rawData[4]);
+    r.rawData[4] = prefix;
+    return roundTrip(r, 7);
+}
+
+void test_malformed_compact_prefix_is_refused()
+{
+    TEST_ASSERT_EQUAL(OPEN_OK, openWithPrefix(3, 3, 2, 2));
+
+    // unknown ext bit
+    TEST_ASSERT_EQUAL(OPEN_MALFORMED, openWithPrefix(3, 3, 2, 0x20 | 2));
+    TEST_ASSERT_EQUAL(OPEN_MALFORMED, openWithPrefix(3, 3, 2, 0x80 | 2));
+
+    // more in common than dest has
+    TEST_ASSERT_EQUAL(OPEN_MALFORMED, openWithPrefix(3, 3, 2, 4));
+
+    // the src the prefix rebuilds is deeper than MAX_ADDRESS_DEPTH
+    TEST_ASSERT_EQUAL(OPEN_OK, openWithPrefix(MAX_ADDRESS_DEPTH, MAX_ADDRESS_DEPTH, MAX_ADDRESS_DEPTH - 1, MAX_ADDRESS_DEPTH - 1));
+    TEST_ASSERT_EQUAL(OPEN_MALFORMED, openWithPrefix(MAX_ADDRESS_DEPTH, MAX_ADDRESS_DEPTH, MAX_ADDRESS_DEPTH - 1, MAX_ADDRESS_DEPTH));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_plain_and_compact_round_trip);
+    RUN_TEST(test_traced_round_trip);
+    RUN_TEST(test_malformed_compact_prefix_is_refused);
+    return UNITY_END();
+}
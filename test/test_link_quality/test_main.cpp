@@ -0,0 +1,254 @@
+// Link costs from beacons: lossy beacons make a link expensive, the route moves
+// to the better link as far as RoutePolicy allows, and routeWeighted() picks
+// the same on the compiled lanes / trie as before compile() (`pio test -e native`)
+
+#include <unity.h>
+#include <random>
+#include <atomic>
+
+#include "LHRP-secure/LHRP.hpp"
+
+using namespace std;
+
+#define BEACON_MS 20 // worker period (real time) for the cost hand-over
+
+static const array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+static const array<uint8_t, 6> macA = {2, 0, 0, 0, 0, 1}, macB = {2, 0, 0, 0, 0, 2}, macC = {2, 0, 0, 0, 0, 3};
+
+static atomic<uint64_t> clockUs;
+static uint64_t fixedClock() { return clockUs; } // neighbours stay alive, no beacon budget
+
+static mt19937 rng;
+
+// only takes the receive callback, beacons of the node under test go nowhere
+struct InjectRadio : Radio
+{
+    ReceiveFn receiveFn = nullptr;
+    void *receiveArg = nullptr;
+
+    bool begin(uint8_t channel, ReceiveFn receive, SentFn sent, void *arg) override
+    {
+        receiveFn = receive;
+        receiveArg = arg;
+        return true;
+    }
+
+    bool addPeer(const uint8_t mac[6], uint8_t channel) override { return true; }
+    bool send(const uint8_t mac[6], const uint8_t *data, size_t len) override { return true; }
+};
+
+// a neighbour's beacons as they arrive; every lost one is a gap in beaconSeq
+struct BeaconSource
+{
+    array<uint8_t, 6> mac;
+    uint32_t seq = 0;
+    uint16_t beaconSeq = 0;
+
+    void send(InjectRadio &radio, int count, int lostEvery)
+    {
+        AesGcm gcm;
+        TEST_ASSERT_TRUE(gcm.setKey(key));
+
+        for (int i = 0; i < count; i++)
+        {
+            beaconSeq++;
+            if (lostEvery && beaconSeq % lostEvery == 0)
+                beaconSeq++;
+
+            RawPacket raw;
+            buildBeaconPacket(raw, 1, beaconSeq, 255, -50);
+            TEST_ASSERT_TRUE(sealRawPacket(raw, gcm, ++seq));
+            radio.receiveFn(radio.receiveArg, mac.data(), (const uint8_t *)&raw, rawPacketSize(raw), -50);
+        }
+    }
+};
+
+// A at {2}; B {1, 1} and C {1, 2} both lead towards {1, 3} (same matchIndex),
+// only B towards {1, 1, 7}
+struct Triangle
+{
+    InjectRadio radio;
+    LHRP_Node_Secure a{1, key, {{macA, {2}}, {macB, {1, 1}}, {macC, {1, 2}}}};
+    BeaconSource b{macB}, c{macC};
+
+    explicit Triangle(const RoutePolicy &policy)
+    {
+        a.useRadio(radio);
+        a.useBeacons(BEACON_MS);
+        a.useRoutePolicy(policy);
+        TEST_ASSERT_TRUE(a.begin());
+    }
+
+    // the beacon task hands new costs over, wait for the route it leads to
+    bool routesTo(const Address &dest, uint8_t pin)
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            if (a.routes.resolve(a.node, dest) == pin)
+                return true;
+            platformSleep(BEACON_MS / 2);
+        }
+        return false;
+    }
+};
+
+void setUp()
+{
+    rng.seed(1);
+    clockUs = 1000000;
+    platformUseClock(fixedClock);
+}
+
+void tearDown()
+{
+    platformUseClock(nullptr);
+}
+
+void test_lossy_beacons_cost_more()
+{
+    LinkQuality good, lossy;
+    uint16_t seq = 0;
+    for (int i = 0; i < 64; i++)
+    {
+        good.onBeacon(i + 1, 255, -50);
+        lossy.onBeacon(seq += 2, 255, -50); // every other one lost
+    }
+
+    TEST_ASSERT_EQUAL_UINT8(255, good.rxQuality);
+    TEST_ASSERT_TRUE(lossy.rxQuality > 100 && lossy.rxQuality < 160);
+    TEST_ASSERT_EQUAL_UINT16(LHRP_COST_PERFECT, good.cost(0, 0, LHRP_MIN_RSSI));
+    TEST_ASSERT_TRUE(lossy.cost(0, 0, LHRP_MIN_RSSI) > LHRP_COST_PERFECT * 3 / 2);
+}
+
+// tie on the prefix: the cheaper link by more than tieMargin wins, and back
+void test_tie_follows_the_better_link()
+{
+    RoutePolicy policy;
+    policy.tieBreak = true;
+    Triangle t(policy);
+    Address dest = {1, 3};
+
+    t.b.send(t.radio, 40, 0);
+    t.c.send(t.radio, 40, 0);
+    TEST_ASSERT_TRUE(t.routesTo(dest, 1)); // equal costs: the prefix choice
+
+    t.b.send(t.radio, 40, 2);
+    TEST_ASSERT_TRUE(t.routesTo(dest, 2));
+    TEST_ASSERT_TRUE(t.a.neighborStats(1).cost > t.a.neighborStats(2).cost + policy.tieMargin);
+
+    // the pocket really leaves over C
+    uint32_t sentC = t.a.txCount(2);
+    TEST_ASSERT_TRUE(t.a.send(dest, {1, 2, 3}));
+    TEST_ASSERT_EQUAL_UINT32(sentC + 1, t.a.txCount(2));
+
+    // B recovers, C gets worse
+    t.b.send(t.radio, 80, 0);
+    t.c.send(t.radio, 80, 2);
+    TEST_ASSERT_TRUE(t.routesTo(dest, 1));
+
+    // the better prefix is no tie: B's loss does not move {1, 1, 7}
+    t.b.send(t.radio, 40, 2);
+    t.c.send(t.radio, 80, 0);
+    TEST_ASSERT_TRUE(t.routesTo(dest, 2));
+    TEST_ASSERT_EQUAL_UINT8(1, t.a.routes.resolve(t.a.node, {1, 1, 7}));
+}
+
+// within tieMargin the prefix choice stays
+void test_tie_margin_keeps_the_route()
+{
+    RoutePolicy policy;
+    policy.tieBreak = true;
+    policy.tieMargin = 200;
+    Triangle t(policy);
+
+    t.b.send(t.radio, 40, 2);
+    t.c.send(t.radio, 40, 0);
+    platformSleep(4 * BEACON_MS);
+    TEST_ASSERT_TRUE(t.a.neighborStats(1).cost > t.a.neighborStats(2).cost);
+    TEST_ASSERT_EQUAL_UINT8(1, t.a.routes.resolve(t.a.node, {1, 3}));
+}
+
+// above maxCost a worse prefix over a cheaper link is taken
+void test_max_cost_overrides_the_prefix()
+{
+    RoutePolicy policy;
+    policy.maxCost = LHRP_COST_PERFECT * 3 / 2;
+    Triangle t(policy);
+    Address dest = {1, 1, 7};
+
+    t.b.send(t.radio, 40, 0);
+    t.c.send(t.radio, 40, 0);
+    TEST_ASSERT_TRUE(t.routesTo(dest, 1));
+
+    t.b.send(t.radio, 60, 2);
+    TEST_ASSERT_TRUE(t.routesTo(dest, 2));
+    TEST_ASSERT_TRUE(t.a.neighborStats(1).cost > policy.maxCost);
+
+    // policy off: back to the prefix, whatever the costs
+    t.a.useRoutePolicy(RoutePolicy{});
+    TEST_ASSERT_EQUAL_UINT8(1, t.a.routes.resolve(t.a.node, dest));
+}
+
+static Address randomAddress(size_t maxDepth)
+{
+    Address a;
+    size_t depth = rng() % (maxDepth + 1);
+    for (size_t i = 0; i < depth; i++)
+        a.push_back(1 + rng() % 3);
+    return a;
+}
+
+// the compiled path (lanes, or trie above LHRP_LANE_LIMIT) against the plain scan
+static void checkWeightedAgainstLinear(size_t minConnections, size_t maxConnections)
+{
+    for (int round = 0; round < 200; round++)
+    {
+        Node linear;
+        linear.setYou(randomAddress(4));
+        size_t connections = minConnections + rng() % (maxConnections - minConnections + 1);
+        vector<uint16_t> cost;
+        for (size_t i = 0; i < connections; i++)
+        {
+            linear.addConnection({.address = randomAddress(6), .pin = (uint8_t)(i + 1)});
+            cost.push_back(LHRP_COST_PERFECT + rng() % 64);
+        }
+
+        Node compiled = linear;
+        compiled.compile();
+        TEST_ASSERT_FALSE(linear.compiled());
+
+        RoutePolicy policy;
+        policy.tieBreak = rng() % 2;
+        policy.maxCost = rng() % 2 ? LHRP_COST_PERFECT + rng() % 64 : 0;
+
+        for (int i = 0; i < 100; i++)
+        {
+            Address dest = randomAddress(7);
+            TEST_ASSERT_EQUAL_UINT8(linear.routeWeighted(dest, policy, cost.data()),
+                                    compiled.routeWeighted(dest, policy, cost.data()));
+
+            uint16_t tiesLinear[8], tiesCompiled[8];
+            size_t n = linear.routeTies(dest, tiesLinear, 8);
+            TEST_ASSERT_EQUAL(n, compiled.routeTies(dest, tiesCompiled, 8));
+            for (size_t k = 0; k < n; k++)
+                TEST_ASSERT_EQUAL_UINT16(tiesLinear[k], tiesCompiled[k]);
+        }
+    }
+}
+
+void test_weighted_compiled_matches_linear()
+{
+    checkWeightedAgainstLinear(1, LHRP_LANE_LIMIT);
+    checkWeightedAgainstLinear(LHRP_LANE_LIMIT + 1, 100);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_lossy_beacons_cost_more);
+    RUN_TEST(test_tie_follows_the_better_link);
+    RUN_TEST(test_tie_margin_keeps_the_route);
+    RUN_TEST(test_max_cost_overrides_the_prefix);
+    RUN_TEST(test_weighted_compiled_matches_linear);
+    return UNITY_END();
+}
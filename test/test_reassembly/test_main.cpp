@@ -0,0 +1,368 @@
+// Reassembler: in-order streaming, gaps, per-source slots, eviction, timeouts,
+// and a whole message over lossy relays (`pio test -e native`)
+
+#include <unity.h>
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <memory>
+
+#include "LHRP-secure/LHRP.hpp"
+#include "LHRP-secure/raw-packet.hpp"
+#include "LHRP-secure/reassembly.hpp"
+#include "LHRP-secure/virtual-radio.hpp"
+
+using namespace std;
+
+static Reassembler r;
+static vector<string> log_; // "src:msgId:offset:len[:last]" or "src:msgId:aborted@offset"
+static vector<uint8_t> data_;
+static uint64_t clockUs;
+
+static uint64_t testClock() { return clockUs; }
+
+static Pocket fragment(uint8_t src, uint16_t msgId, uint16_t index, uint16_t count, uint8_t len = 10)
+{
+    Pocket p{};
+    p.srcAddress = {1, src};
+    p.destAddress = {1};
+    p.flags = LHRP_FLAG_FRAGMENT;
+    p.payload.resize(LHRP_FRAGMENT_HEADER + len);
+    writeFragmentHeader(p.payload.data(), msgId, index, count);
+    for (uint8_t i = 0; i < len; i++)
+        p.payload[LHRP_FRAGMENT_HEADER + i] = index * len + i;
+    return p;
+}
+
+static string entry(const StreamChunk &c)
+{
+    char buf[64];
+    if (c.aborted)
+        snprintf(buf, sizeof(buf), "%u:%u:aborted@%u", c.src[c.src.size() - 1], c.msgId, c.offset);
+    else
+        snprintf(buf, sizeof(buf), "%u:%u:%u:%u%s", c.src[c.src.size() - 1], c.msgId, c.offset, (unsigned)c.len, c.last ? ":last" : "");
+    return buf;
+}
+
+void setUp(void)
+{
+    clockUs = 1000000;
+    platformUseClock(testClock);
+    log_.clear();
+    data_.clear();
+    r.callback = [](const StreamChunk &c)
+    {
+        log_.push_back(entry(c));
+        if (!c.aborted)
+            data_.insert(data_.end(), c.data, c.data + c.len);
+    };
+    r.begin();
+}
+
+void tearDown(void)
+{
+    platformUseClock(nullptr);
+}
+
+static void test_in_order_stream(void)
+{
+    for (uint16_t i = 0; i < 3; i++)
+        r.receive(fragment(2, 7, i, 3));
+
+    TEST_ASSERT_EQUAL(3, log_.size());
+    TEST_ASSERT_TRUE(log_[0] == "2:7:0:10");
+    TEST_ASSERT_TRUE(log_[2] == "2:7:20:10:last");
+    for (size_t i = 0; i < data_.size(); i++)
+        TEST_ASSERT_EQUAL(i, data_[i]);
+}
+
+static void test_gap_is_buffered_and_drained(void)
+{
+    r.receive(fragment(2, 7, 2, 4));
+    r.receive(fragment(2, 7, 1, 4));
+    TEST_ASSERT_EQUAL(0, log_.size());
+
+    r.receive(fragment(2, 7, 0, 4));
+    TEST_ASSERT_EQUAL(3, log_.size());
+
+    r.receive(fragment(2, 7, 3, 4));
+    TEST_ASSERT_EQUAL(4, log_.size());
+    TEST_ASSERT_TRUE(log_[3] == "2:7:30:10:last");
+    for (size_t i = 0; i < data_.size(); i++)
+        TEST_ASSERT_EQUAL(i, data_[i]);
+}
+
+static void test_duplicates_and_too_far_ahead_are_dropped(void)
+{
+    TEST_ASSERT_TRUE(r.receive(fragment(2, 7, 0, 20)));
+    TEST_ASSERT_FALSE(r.receive(fragment(2, 7, 0, 20)));
+    TEST_ASSERT_EQUAL(1, log_.size());
+
+    TEST_ASSERT_TRUE(r.receive(fragment(2, 7, 2, 20))); // buffered behind the gap
+    TEST_ASSERT_FALSE(r.receive(fragment(2, 7, 2, 20)));
+
+    TEST_ASSERT_FALSE(r.fits(fragment(2, 7, 1 + LHRP_REASSEMBLY_WINDOW, 20)));
+    TEST_ASSERT_FALSE(r.receive(fragment(2, 7, 1 + LHRP_REASSEMBLY_WINDOW, 20)));
+    TEST_ASSERT_TRUE(r.fits(fragment(2, 7, LHRP_REASSEMBLY_WINDOW, 20)));
+
+    // a new message can not start far ahead: its start is still on the way
+    TEST_ASSERT_FALSE(r.fits(fragment(3, 1, LHRP_REASSEMBLY_WINDOW, 20)));
+    TEST_ASSERT_TRUE(r.fits(fragment(3, 1, 1, 20)));
+}
+
+static void test_timer_aborts_idle_messages(void)
+{
+    r.receive(fragment(2, 7, 0, 3));
+    clockUs += (LHRP_REASSEMBLY_TIMEOUT_MS - 1) * 1000ull;
+    r.expire();
+    TEST_ASSERT_EQUAL(1, log_.size());
+
+    clockUs += 1000;
+    r.expire(); // no fragment needed
+    TEST_ASSERT_EQUAL(2, log_.size());
+    TEST_ASSERT_TRUE(log_[1] == "2:7:aborted@10");
+}
+
+static void test_source_quota_evicts_its_own_oldest(void)
+{
+    // one source may not take every slot
+    for (uint16_t m = 0; m < LHRP_REASSEMBLY_PER_SOURCE; m++)
+    {
+        r.receive(fragment(2, m, 0, 5));
+        clockUs += 1000;
+    }
+    r.receive(fragment(3, 100, 0, 5));
+
+    r.receive(fragment(2, 50, 0, 5)); // over its quota: gives up message 0
+    TEST_ASSERT_TRUE(log_.back() == "2:50:0:10");
+    TEST_ASSERT_TRUE(log_[log_.size() - 2] == "2:0:aborted@10");
+
+    // the other source's message is untouched
+    r.receive(fragment(3, 100, 1, 5));
+    TEST_ASSERT_TRUE(log_.back() == "3:100:10:10");
+}
+
+static void test_single_messages_are_never_evicted(void)
+{
+    for (uint8_t src = 2; src < 2 + LHRP_REASSEMBLY_SLOTS; src++)
+        r.receive(fragment(src, 1, 0, 5));
+    size_t before = log_.size();
+
+    TEST_ASSERT_FALSE(r.fits(fragment(99, 1, 0, 5)));
+    r.receive(fragment(99, 1, 0, 5));
+    TEST_ASSERT_EQUAL(before, log_.size());
+}
+
+static void test_source_above_one_slot_yields_to_a_new_source(void)
+{
+    r.receive(fragment(2, 1, 0, 5));
+    clockUs += 1000;
+    r.receive(fragment(2, 2, 0, 5));
+    for (uint8_t src = 3; src < 1 + LHRP_REASSEMBLY_SLOTS; src++)
+        r.receive(fragment(src, 1, 0, 5));
+
+    r.receive(fragment(99, 1, 0, 5));
+    TEST_ASSERT_TRUE(log_.back() == "99:1:0:10");
+    TEST_ASSERT_TRUE(log_[log_.size() - 2] == "2:1:aborted@10");
+}
+
+static void test_callback_may_reenter(void)
+{
+    // the lock is not held while the callback runs: feeding the next
+    // fragment from inside it must not deadlock
+    r.callback = [](const StreamChunk &c)
+    {
+        log_.push_back(entry(c));
+        if (!c.last && c.offset == 0)
+            r.receive(fragment(2, 7, 1, 2));
+    };
+
+    r.receive(fragment(2, 7, 0, 2));
+    TEST_ASSERT_EQUAL(2, log_.size());
+    TEST_ASSERT_TRUE(log_[1] == "2:7:10:10:last");
+}
+
+// three nodes, 5 % loss per frame, link acks: the stream arrives complete and in order
+// without onStreamReceive() fragments are counted as dropped, not as delivered
+static void test_fragments_without_stream_callback_are_dropped(void)
+{
+    Reassembler none;
+    none.begin();
+    TEST_ASSERT_FALSE(none.receive(fragment(2, 7, 0, 1)));
+
+    platformUseClock(nullptr);
+    VirtualMedium medium(3);
+    array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+    Address a = {1}, b = {1, 1};
+    array<uint8_t, 6> macA = {2, 0, 0, 0, 0, 1}, macB = {2, 0, 0, 0, 0, 2};
+
+    LHRP_Node_Secure nodeA(1, key, {{macA, a}, {macB, b}});
+    LHRP_Node_Secure nodeB(1, key, {{macB, b}, {macA, a}});
+    nodeA.useRadio(medium.attach(macA));
+    nodeB.useRadio(medium.attach(macB));
+
+    atomic<int> pockets{0};
+    nodeA.onPocketReceive([&](const Pocket &)
+                          { pockets++; });
+    TEST_ASSERT_TRUE(nodeA.begin());
+    TEST_ASSERT_TRUE(nodeB.begin());
+    medium.start();
+
+    vector<uint8_t> message(3 * nodeB.maxPayloadSize(a));
+    TEST_ASSERT_TRUE(nodeB.send(a, message)); // fragmented
+    medium.waitIdle(1000);
+    medium.stop();
+
+    const LHRP_Metrics &m = nodeA.metrics();
+    TEST_ASSERT_EQUAL(0, pockets.load());
+    TEST_ASSERT_EQUAL(0, m.delivered.load());
+    TEST_ASSERT_TRUE(m.drops[LHRP_DROP_FRAGMENT].load() >= 3);
+}
+
+// the first fragment has no route: the others are not sent after it
+static void test_send_message_stops_at_first_failed_fragment(void)
+{
+    platformUseClock(nullptr);
+    VirtualMedium medium(3);
+    array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+    array<uint8_t, 6> macA = {2, 0, 0, 0, 0, 1}, macB = {2, 0, 0, 0, 0, 2};
+
+    LHRP_Node_Secure nodeA(1, key, {{macA, {1}}, {macB, {1, 1}}});
+    nodeA.useRadio(medium.attach(macA));
+    TEST_ASSERT_TRUE(nodeA.begin());
+
+    Address nowhere = {2};
+    vector<uint8_t> message(5 * nodeA.maxPayloadSize(nowhere));
+    TEST_ASSERT_FALSE(nodeA.sendMessage(nowhere, message.data(), message.size()));
+    TEST_ASSERT_EQUAL(1, nodeA.metrics().drops[LHRP_DROP_NO_ROUTE].load());
+}
+
+// with link acks sendMessage() would wait for acks the callback's thread has to process
+static void test_send_message_refused_in_callback(void)
+{
+    platformUseClock(nullptr);
+    VirtualMedium medium(3);
+    array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+    Address a = {1}, b = {1, 1};
+    array<uint8_t, 6> macA = {2, 0, 0, 0, 0, 1}, macB = {2, 0, 0, 0, 0, 2};
+
+    LHRP_Node_Secure nodeA(1, key, {{macA, a}, {macB, b}});
+    LHRP_Node_Secure nodeB(1, key, {{macB, b}, {macA, a}});
+    nodeA.useRadio(medium.attach(macA));
+    nodeB.useRadio(medium.attach(macB));
+    nodeA.useReliability();
+    nodeB.useReliability();
+
+    atomic<int> calls{0}, refused{0};
+    nodeA.onPocketReceive([&](const Pocket &p)
+                          {
+        vector<uint8_t> reply(3 * nodeA.maxPayloadSize(b));
+        refused += !nodeA.send(b, reply);
+        refused += !nodeA.sendMessage(b, reply.data(), reply.size());
+        calls++; });
+    TEST_ASSERT_TRUE(nodeA.begin());
+    TEST_ASSERT_TRUE(nodeB.begin());
+    medium.start();
+
+    TEST_ASSERT_TRUE(nodeB.send(a, vector<uint8_t>{1, 2, 3}));
+    for (int i = 0; i < 100 && calls.load() == 0; i++)
+        platformSleep(10);
+    medium.waitIdle(1000);
+    medium.stop();
+
+    TEST_ASSERT_EQUAL(1, calls.load());
+    TEST_ASSERT_EQUAL(2, refused.load());
+
+    // outside a callback the same message goes out
+    vector<uint8_t> reply(3 * nodeA.maxPayloadSize(b));
+    medium.start();
+    TEST_ASSERT_TRUE(nodeA.sendMessage(b, reply.data(), reply.size()));
+    medium.stop();
+}
+
+static void test_message_over_lossy_relays(void)
+{
+    platformUseClock(nullptr); // link timers and the medium run on real time
+
+    VirtualMedium medium(3);
+    VirtualLink link;
+    link.latencyUs = 300;
+    link.loss = 0.05f;
+    medium.setDefaultLink(link);
+
+    array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+    vector<Address> addresses = {{1}, {1, 1}, {1, 1, 1}};
+    vector<unique_ptr<LHRP_Node_Secure>> nodes;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        vector<LHRP_Peer> peers = {{{2, 0, 0, 0, 0, i}, addresses[i]}};
+        if (i > 0)
+            peers.push_back({{2, 0, 0, 0, 0, (uint8_t)(i - 1)}, addresses[i - 1]});
+        if (i < 2)
+            peers.push_back({{2, 0, 0, 0, 0, (uint8_t)(i + 1)}, addresses[i + 1]});
+
+        nodes.emplace_back(new LHRP_Node_Secure(1, key, peers));
+        nodes[i]->useRadio(medium.attach(peers[0].mac));
+        nodes[i]->useReliability();
+    }
+
+    mutex lock;
+    vector<uint8_t> received;
+    bool last = false, aborted = false, ordered = true;
+    nodes[0]->onStreamReceive([&](const StreamChunk &c)
+                              {
+        lock_guard<mutex> guard(lock);
+        if (c.aborted)
+        {
+            aborted = true;
+            return;
+        }
+        ordered &= c.offset == received.size();
+        received.insert(received.end(), c.data, c.data + c.len);
+        last |= c.last; });
+
+    for (auto &n : nodes)
+        TEST_ASSERT_TRUE(n->begin());
+    medium.start();
+
+    vector<uint8_t> message(8000);
+    for (size_t i = 0; i < message.size(); i++)
+        message[i] = i * 7;
+    TEST_ASSERT_TRUE(nodes[2]->sendMessage(addresses[0], message.data(), message.size()));
+
+    for (int i = 0; i < 1000; i++)
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            if (last || aborted)
+                break;
+        }
+        platformSleep(10);
+    }
+    medium.stop();
+
+    lock_guard<mutex> guard(lock);
+    TEST_ASSERT_FALSE(aborted);
+    TEST_ASSERT_TRUE(last);
+    TEST_ASSERT_TRUE(ordered);
+    TEST_ASSERT_TRUE(received == message);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_in_order_stream);
+    RUN_TEST(test_gap_is_buffered_and_drained);
+    RUN_TEST(test_duplicates_and_too_far_ahead_are_dropped);
+    RUN_TEST(test_timer_aborts_idle_messages);
+    RUN_TEST(test_source_quota_evicts_its_own_oldest);
+    RUN_TEST(test_single_messages_are_never_evicted);
+    RUN_TEST(test_source_above_one_slot_yields_to_a_new_source);
+    RUN_TEST(test_callback_may_reenter);
+    RUN_TEST(test_fragments_without_stream_callback_are_dropped);
+    RUN_TEST(test_send_message_stops_at_first_failed_fragment);
+    RUN_TEST(test_send_message_refused_in_callback);
+    RUN_TEST(test_message_over_lossy_relays);
+    return UNITY_END();
+}
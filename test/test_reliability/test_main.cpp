@@ -0,0 +1,179 @@
+// Link acks over a lossy line of relays: no pocket arrives twice, only given up
+// frames go missing, and every frame in flight stays coverable by an ack
+// (`pio test -e native`)
+
+#include <unity.h>
+#include <mutex>
+#include <memory>
+
+#include "LHRP-secure/LHRP.hpp"
+#include "LHRP-secure/virtual-radio.hpp"
+
+using namespace std;
+
+static array<uint8_t, 6> nodeMac(uint32_t i)
+{
+    return {0x02, 0x00, 0, 0, 0, (uint8_t)i};
+}
+
+struct Outcome
+{
+    vector<uint32_t> copies; // per pocket id
+    uint32_t expired;
+    uint32_t retransmits;
+};
+
+static Outcome run(bool pipeline, uint32_t nodeCount, uint32_t pockets, float loss)
+{
+    vector<Address> addresses(nodeCount);
+    addresses[0] = {1};
+    for (uint32_t i = 1; i < nodeCount; i++)
+    {
+        addresses[i] = addresses[i - 1];
+        addresses[i].push_back(1);
+    }
+
+    VirtualMedium medium(7);
+    VirtualLink link;
+    link.latencyUs = 500;
+    link.loss = loss;
+    medium.setDefaultLink(link);
+
+    array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+    Outcome o{vector<uint32_t>(pockets), 0, 0};
+    mutex lock;
+
+    vector<unique_ptr<LHRP_Node_Secure>> nodes;
+    for (uint32_t i = 0; i < nodeCount; i++)
+    {
+        vector<LHRP_Peer> peers = {{nodeMac(i), addresses[i]}};
+        if (i > 0)
+            peers.push_back({nodeMac(i - 1), addresses[i - 1]});
+        if (i + 1 < nodeCount)
+            peers.push_back({nodeMac(i + 1), addresses[i + 1]});
+
+        nodes.emplace_back(new LHRP_Node_Secure(1, key, peers));
+        nodes[i]->useRadio(medium.attach(nodeMac(i)));
+        nodes[i]->useReliability();
+        if (pipeline)
+            nodes[i]->usePipeline(-1);
+    }
+
+    nodes[0]->onPocketReceive([&](const Pocket &p)
+                              {
+        uint32_t id = p.payload[0] | p.payload[1] << 8;
+        lock_guard<mutex> guard(lock);
+        if (id < o.copies.size())
+            o.copies[id]++; });
+
+    for (auto &n : nodes)
+        TEST_ASSERT_TRUE(n->begin());
+    medium.start();
+
+    LHRP_Node_Secure &sender = *nodes[nodeCount - 1];
+    for (uint32_t id = 0; id < pockets; id++)
+    {
+        vector<uint8_t> payload = {(uint8_t)id, (uint8_t)(id >> 8), 0, 0, 0, 0, 0, 0};
+        while (!sender.send(addresses[0], payload))
+            platformSleep(1); // window to the next hop full
+    }
+
+    // the last retransmissions come from the link timers
+    for (uint32_t waited = 0; waited < 10 * LHRP_RTO_MAX_MS; waited += 10)
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            if (count(o.copies.begin(), o.copies.end(), 0) == 0)
+                break;
+        }
+        platformSleep(10);
+    }
+    medium.waitIdle(1000);
+    medium.stop();
+
+    for (auto &n : nodes)
+        for (uint8_t pin = 1; pin <= n->node.connections().size(); pin++)
+        {
+            LHRP_LinkStats s = n->linkStats(pin);
+            o.expired += s.expired;
+            o.retransmits += s.retransmits;
+        }
+    return o;
+}
+
+// a frame can still run out of retries behind a stalled next hop (backpressure)
+static void checkAtMostOnce(const Outcome &o)
+{
+    TEST_ASSERT_TRUE(o.retransmits > 0); // the loss did hit
+
+    uint32_t missing = 0;
+    for (uint32_t copies : o.copies)
+    {
+        TEST_ASSERT_TRUE(copies <= 1);
+        missing += copies == 0;
+    }
+    TEST_ASSERT_TRUE(missing <= o.expired);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_window_keeps_frames_inside_ack_span()
+{
+    LinkWindow w;
+    RawPacket raw;
+    memset(&raw, 0, sizeof(raw));
+
+    LinkWindow::Slot *oldest = w.reserve(false, 100);
+    TEST_ASSERT_NOT_NULL(oldest);
+    w.track(*oldest, raw, 100, 0);
+
+    // seqs taken by acks and beacons in between, one slot in use
+    TEST_ASSERT_NOT_NULL(w.reserve(false, 100 + LHRP_ACK_SPAN - 1));
+    TEST_ASSERT_NULL(w.reserve(false, 100 + LHRP_ACK_SPAN));
+
+    // held frames are sealed later with higher seqs
+    TEST_ASSERT_TRUE(w.hold(110));
+    TEST_ASSERT_NULL(w.reserve(false, 100 + LHRP_ACK_SPAN - 1));
+    w.unhold();
+
+    w.onAck(100, 1, 5);
+    TEST_ASSERT_EQUAL_UINT8(0, w.inFlight);
+    TEST_ASSERT_NOT_NULL(w.reserve(false, 100 + LHRP_ACK_SPAN));
+}
+
+void test_ack_anchored_behind_top_covers_old_seq()
+{
+    ReplayWindow r;
+    r.reset(0);
+    r.update(1000);
+    for (uint32_t seq = 1002; seq <= 1050; seq++)
+        r.update(seq);
+
+    // at top the retransmitted 1000 is out of reach, anchored at it it is covered
+    TEST_ASSERT_FALSE(ackCovers(r.top, r.ackBits(r.top), 1000));
+    TEST_ASSERT_TRUE(ackCovers(1000, r.ackBits(1000), 1000));
+    TEST_ASSERT_FALSE(ackCovers(1005, r.ackBits(1005), 1001)); // never arrived
+    TEST_ASSERT_TRUE(ackCovers(1005, r.ackBits(1005), 1004));
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)r.bits[0], r.ackBits(r.top));
+}
+
+void test_acks_deliver_at_most_once()
+{
+    checkAtMostOnce(run(false, 4, 200, 0.1f));
+}
+
+void test_acks_with_pipeline_deliver_at_most_once()
+{
+    checkAtMostOnce(run(true, 4, 200, 0.1f));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_window_keeps_frames_inside_ack_span);
+    RUN_TEST(test_ack_anchored_behind_top_covers_old_seq);
+    RUN_TEST(test_acks_deliver_at_most_once);
+    RUN_TEST(test_acks_with_pipeline_deliver_at_most_once);
+    return UNITY_END();
+}
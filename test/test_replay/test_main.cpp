@@ -0,0 +1,168 @@
+// Sliding replay window: reordered frames are accepted once, replays never
+// (`pio test -e native`)
+
+#include <unity.h>
+#include <set>
+#include <random>
+#include <algorithm>
+
+#include "LHRP-secure/LHRP.hpp"
+#include "LHRP-secure/replay-window.hpp"
+
+using namespace std;
+
+static mt19937 rng;
+
+// 1..count, every seq moved by less than `spread` positions
+static vector<uint32_t> shuffled(uint32_t first, uint32_t count, uint32_t spread)
+{
+    vector<uint32_t> seqs(count);
+    for (uint32_t i = 0; i < count; i++)
+        seqs[i] = first + i;
+    for (uint32_t i = 0; i < count; i += spread)
+        shuffle(seqs.begin() + i, seqs.begin() + min(count, i + spread), rng);
+    return seqs;
+}
+
+void setUp() { rng.seed(1); }
+void tearDown() {}
+
+void test_reordered_inside_window_accepted_once()
+{
+    ReplayWindow w;
+    vector<uint32_t> seqs = shuffled(1, 5000, LHRP_REPLAY_WINDOW / 2);
+
+    for (uint32_t seq : seqs)
+        TEST_ASSERT_EQUAL(REPLAY_ACCEPTED, w.update(seq));
+    TEST_ASSERT_EQUAL_UINT32(5000, w.top);
+
+    // the same frames again, in another order
+    shuffle(seqs.begin(), seqs.end(), rng);
+    for (uint32_t seq : seqs)
+        TEST_ASSERT_NOT_EQUAL(REPLAY_ACCEPTED, w.update(seq));
+}
+
+void test_matches_reference_model()
+{
+    ReplayWindow w;
+    w.reset(1000);
+
+    // seen seqs plus the newest one, everything up to 1000 counts as seen
+    set<uint32_t> seen;
+    uint32_t top = 1000;
+
+    for (int i = 0; i < 100000; i++)
+    {
+        int32_t step = (int32_t)(rng() % (3 * LHRP_REPLAY_WINDOW)) - 2 * LHRP_REPLAY_WINDOW;
+        if (rng() % 8 == 0)
+            step += 1 + rng() % (2 * LHRP_REPLAY_WINDOW); // jump ahead
+        uint32_t seq = top + step;
+
+        ReplayResult expected;
+        if ((int32_t)(seq - top) > 0)
+            expected = REPLAY_ACCEPTED;
+        else if (top - seq >= LHRP_REPLAY_WINDOW)
+            expected = REPLAY_LATE;
+        else
+            expected = seq <= 1000 || seen.count(seq) ? REPLAY_DUPLICATE : REPLAY_ACCEPTED;
+
+        TEST_ASSERT_EQUAL(expected, w.check(seq));
+        TEST_ASSERT_EQUAL(expected, w.update(seq));
+
+        if (expected == REPLAY_ACCEPTED)
+        {
+            seen.insert(seq);
+            if ((int32_t)(seq - top) > 0)
+                top = seq;
+        }
+        TEST_ASSERT_EQUAL_UINT32(top, w.top);
+    }
+}
+
+void test_seq_wraps_around()
+{
+    ReplayWindow w;
+    w.reset(0xFFFFFF00u);
+
+    vector<uint32_t> seqs = shuffled(0xFFFFFF01u, 512, LHRP_REPLAY_WINDOW / 2); // crosses 0
+    for (uint32_t seq : seqs)
+        TEST_ASSERT_EQUAL(REPLAY_ACCEPTED, w.update(seq));
+    TEST_ASSERT_EQUAL_UINT32(0xFFFFFF00u + 512, w.top);
+
+    TEST_ASSERT_EQUAL(REPLAY_DUPLICATE, w.update(0xFFFFFF00u + 512));
+    TEST_ASSERT_EQUAL(REPLAY_LATE, w.update(0xFFFFFFFFu));
+}
+
+// keeps every frame sent, the test hands them on in any order
+struct RecordRadio : Radio
+{
+    ReceiveFn receiveFn = nullptr;
+    void *receiveArg = nullptr;
+    vector<vector<uint8_t>> frames;
+
+    bool begin(uint8_t channel, ReceiveFn receive, SentFn sent, void *arg) override
+    {
+        receiveFn = receive;
+        receiveArg = arg;
+        return true;
+    }
+
+    bool addPeer(const uint8_t mac[6], uint8_t channel) override { return true; }
+
+    bool send(const uint8_t mac[6], const uint8_t *data, size_t len) override
+    {
+        frames.emplace_back(data, data + len);
+        return true;
+    }
+};
+
+void test_node_delivers_shuffled_frames_once()
+{
+    array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+    array<uint8_t, 6> macA = {2, 0, 0, 0, 0, 1}, macB = {2, 0, 0, 0, 0, 2};
+
+    RecordRadio radioA, radioB;
+    LHRP_Node_Secure a(1, key, {{macA, {1}}, {macB, {1, 1}}});
+    LHRP_Node_Secure b(1, key, {{macB, {1, 1}}, {macA, {1}}});
+    a.useRadio(radioA);
+    b.useRadio(radioB);
+
+    vector<uint32_t> delivered;
+    b.onPocketReceive([&](const Pocket &p)
+                      { delivered.push_back(p.payload[0] | p.payload[1] << 8); });
+
+    TEST_ASSERT_TRUE(a.begin());
+    TEST_ASSERT_TRUE(b.begin());
+
+    const uint16_t count = 1000;
+    for (uint16_t i = 0; i < count; i++)
+        TEST_ASSERT_TRUE(a.send({1, 1}, {(uint8_t)i, (uint8_t)(i >> 8)}));
+    TEST_ASSERT_EQUAL_size_t(count, radioA.frames.size());
+
+    vector<uint32_t> order = shuffled(0, count, LHRP_REPLAY_WINDOW / 2);
+    for (uint32_t i : order)
+        radioB.receiveFn(radioB.receiveArg, macA.data(), radioA.frames[i].data(), radioA.frames[i].size(), 0);
+
+    TEST_ASSERT_EQUAL_size_t(count, delivered.size());
+    sort(delivered.begin(), delivered.end());
+    for (uint16_t i = 0; i < count; i++)
+        TEST_ASSERT_EQUAL_UINT32(i, delivered[i]);
+
+    // replayed by an attacker, in any order: nothing new arrives
+    shuffle(order.begin(), order.end(), rng);
+    for (uint32_t i : order)
+        radioB.receiveFn(radioB.receiveArg, macA.data(), radioA.frames[i].data(), radioA.frames[i].size(), 0);
+
+    TEST_ASSERT_EQUAL_size_t(count, delivered.size());
+    TEST_ASSERT_EQUAL_UINT32(count, b.metrics().drops[LHRP_DROP_REPLAY].load());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_reordered_inside_window_accepted_once);
+    RUN_TEST(test_matches_reference_model);
+    RUN_TEST(test_seq_wraps_around);
+    RUN_TEST(test_node_delivers_shuffled_frames_once);
+    return UNITY_END();
+}
@@ -0,0 +1,211 @@
+// Node::route() (lanes or compiled trie) against Node::routeLinear(), and
+// ECMP in RouteCache: one flow keeps its pin, flows spread over the ties
+// (`pio test -e native`)
+
+#include <unity.h>
+#include <random>
+
+#include "LHRP-secure/protocol.hpp"
+#include "LHRP-secure/route-cache.hpp"
+
+using namespace std;
+
+static mt19937 rng;
+
+static Address randomAddress(size_t maxDepth)
+{
+    Address a;
+    size_t depth = rng() % (maxDepth + 1);
+    for (size_t i = 0; i < depth; i++)
+        a.push_back(1 + rng() % 3);
+    return a;
+}
+
+static Node randomNode(size_t connections)
+{
+    Node node;
+    node.setYou(randomAddress(4));
+    for (size_t i = 0; i < connections; i++)
+        node.addConnection({.address = randomAddress(6), .pin = (uint8_t)(i + 1)});
+    node.compile();
+    return node;
+}
+
+// random nodes, random destinations up to depth 7
+static void checkAgainstLinear(size_t minConnections, size_t maxConnections)
+{
+    for (int round = 0; round < 200; round++)
+    {
+        size_t connections = minConnections + rng() % (maxConnections - minConnections + 1);
+        Node node = randomNode(connections);
+
+        for (int i = 0; i < 200; i++)
+        {
+            Address dest = randomAddress(7);
+            TEST_ASSERT_EQUAL_UINT8(node.routeLinear(dest), node.route(dest));
+        }
+    }
+}
+
+void setUp() { rng.seed(1); }
+void tearDown() {}
+
+void test_lanes_match_linear()
+{
+    checkAgainstLinear(1, LHRP_LANE_LIMIT);
+}
+
+void test_trie_matches_linear()
+{
+    checkAgainstLinear(LHRP_LANE_LIMIT + 1, 200);
+}
+
+void test_trie_ties()
+{
+    // same matchIndex: the longer address wins, then the first connection
+    Node node;
+    node.setYou({1, 1});
+    node.addConnection({.address = {1}, .pin = 1});
+    for (uint8_t i = 0; i < 20; i++)
+        node.addConnection({.address = {1, 1, 2}, .pin = (uint8_t)(i + 2)});
+    node.addConnection({.address = {1, 1, 3, 1}, .pin = 30});
+    node.compile();
+
+    TEST_ASSERT_EQUAL_UINT8(2, node.route({1, 1, 2, 5}));
+    TEST_ASSERT_EQUAL_UINT8(30, node.route({1, 1, 3, 1, 4}));
+    TEST_ASSERT_EQUAL_UINT8(1, node.route({2}));
+    TEST_ASSERT_EQUAL_UINT8(0, node.route({1, 1}));
+    TEST_ASSERT_EQUAL_UINT8(0, node.route({1, 1, 4}));
+}
+
+void test_no_connections()
+{
+    Node node;
+    node.setYou({1});
+    node.compile();
+
+    TEST_ASSERT_EQUAL_UINT8(0, node.route({1}));
+    TEST_ASSERT_EQUAL_UINT8(node.routeLinear({2}), node.route({2}));
+}
+
+// {1, 1, 2} over four equal links, {1} as parent
+static Node ecmpNode()
+{
+    Node node;
+    node.setYou({1, 1});
+    node.addConnection({.address = {1}, .pin = 1});
+    for (uint8_t i = 0; i < 4; i++)
+        node.addConnection({.address = {1, 1, 2}, .pin = (uint8_t)(i + 2)});
+    node.compile();
+    return node;
+}
+
+void test_ecmp_ties()
+{
+    Node node = ecmpNode();
+
+    uint16_t ties[LHRP_ECMP_MAX_PATHS];
+    TEST_ASSERT_EQUAL(4, node.routeTies({1, 1, 2, 7}, ties, LHRP_ECMP_MAX_PATHS));
+    for (uint16_t i = 0; i < 4; i++)
+        TEST_ASSERT_EQUAL_UINT16(i + 1, ties[i]);
+
+    TEST_ASSERT_EQUAL(0, node.routeTies({1, 1}, ties, LHRP_ECMP_MAX_PATHS)); // local
+    TEST_ASSERT_EQUAL(1, node.routeTies({2}, ties, LHRP_ECMP_MAX_PATHS));
+}
+
+// hits, misses and a flushed cache all give a flow the same pin
+void test_ecmp_flow_keeps_its_pin()
+{
+    Node node = ecmpNode();
+    RouteCache cache;
+    cache.setEcmp(true);
+
+    Address dest = {1, 1, 2, 7}, src = {1, 1};
+    uint8_t first[64];
+    for (uint16_t flow = 0; flow < 64; flow++)
+    {
+        first[flow] = cache.resolve(node, dest, src, flow);
+        TEST_ASSERT_TRUE(first[flow] >= 2 && first[flow] <= 5);
+    }
+
+    for (int round = 0; round < 3; round++)
+    {
+        // push dest out of the cache, then drop the whole cache
+        for (uint8_t i = 0; i < LHRP_ROUTE_CACHE_SIZE; i++)
+            cache.resolve(node, {1, 1, 2, (uint8_t)(10 + i)});
+        if (round == 2)
+            cache.setEcmp(true);
+
+        for (uint16_t flow = 0; flow < 64; flow++)
+        {
+            TEST_ASSERT_EQUAL_UINT8(first[flow], cache.resolve(node, dest, src, flow));
+            TEST_ASSERT_EQUAL_UINT8(first[flow], cache.resolve(node, dest, src, flow)); // hit
+        }
+    }
+
+    // the flow key is src, dest and flow id, nothing else
+    TEST_ASSERT_EQUAL_UINT32(flowHash(src, dest, 9), flowHash(src, dest, 9));
+    TEST_ASSERT_NOT_EQUAL(flowHash({1}, {1, 2}, 0), flowHash({1, 1}, {2}, 0));
+}
+
+void test_ecmp_spreads_flows()
+{
+    Node node = ecmpNode();
+    RouteCache cache;
+    cache.setEcmp(true);
+
+    const int flows = 1024;
+    int perPin[6] = {};
+    for (uint16_t flow = 0; flow < flows; flow++)
+        perPin[cache.resolve(node, {1, 1, 2, 7}, {1, 1}, flow)]++;
+
+    TEST_ASSERT_EQUAL(0, perPin[0] + perPin[1]);
+    for (uint8_t pin = 2; pin <= 5; pin++)
+        TEST_ASSERT_TRUE(perPin[pin] > flows / 4 / 2); // no tie gets less than half its share
+
+    // by src as well: many senders, one flow id each
+    int perSrc[6] = {};
+    for (uint8_t s = 0; s < 200; s++)
+        perSrc[cache.resolve(node, {1, 1, 2, 7}, {1, 3, s}, 0)]++;
+    for (uint8_t pin = 2; pin <= 5; pin++)
+        TEST_ASSERT_TRUE(perSrc[pin] > 0);
+
+    // without ECMP every flow takes route()'s pin
+    cache.setEcmp(false);
+    for (uint16_t flow = 0; flow < 64; flow++)
+        TEST_ASSERT_EQUAL_UINT8(node.route({1, 1, 2, 7}), cache.resolve(node, {1, 1, 2, 7}, {1, 1}, flow));
+}
+
+// a tie the policy turns away (maxCost) gets no flow
+void test_ecmp_skips_links_over_max_cost()
+{
+    Node node = ecmpNode();
+    RouteCache cache;
+    cache.setEcmp(true);
+
+    RoutePolicy policy;
+    policy.maxCost = 100;
+    cache.setPolicy(policy);
+    cache.setCosts({10, 10, 500, 10, 10}); // pin 3 is bad
+
+    for (uint16_t flow = 0; flow < 256; flow++)
+    {
+        uint8_t pin = cache.resolve(node, {1, 1, 2, 7}, {1, 1}, flow);
+        TEST_ASSERT_TRUE(pin >= 2 && pin <= 5);
+        TEST_ASSERT_NOT_EQUAL(3, pin);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_lanes_match_linear);
+    RUN_TEST(test_trie_matches_linear);
+    RUN_TEST(test_trie_ties);
+    RUN_TEST(test_no_connections);
+    RUN_TEST(test_ecmp_ties);
+    RUN_TEST(test_ecmp_flow_keeps_its_pin);
+    RUN_TEST(test_ecmp_spreads_flows);
+    RUN_TEST(test_ecmp_skips_links_over_max_cost);
+    return UNITY_END();
+}
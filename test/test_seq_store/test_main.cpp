@@ -0,0 +1,148 @@
+// Send seq leases: no seq is sent twice across a crash between lease commits,
+// and flush() never writes back a lease older than one committed meanwhile
+// (`pio test -e native`)
+
+#include <unity.h>
+#include <thread>
+#include <atomic>
+
+#include "LHRP-secure/LHRP.hpp"
+
+using namespace std;
+
+static const array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+static const array<uint8_t, 6> macA = {2, 0, 0, 0, 0, 1}, macB = {2, 0, 0, 0, 0, 2};
+
+// keeps every frame sent
+struct RecordRadio : Radio
+{
+    vector<vector<uint8_t>> frames;
+
+    bool begin(uint8_t channel, ReceiveFn receive, SentFn sent, void *arg) override { return true; }
+    bool addPeer(const uint8_t mac[6], uint8_t channel) override { return true; }
+
+    bool send(const uint8_t mac[6], const uint8_t *data, size_t len) override
+    {
+        frames.emplace_back(data, data + len);
+        return true;
+    }
+};
+
+struct NullRadio : Radio
+{
+    bool begin(uint8_t channel, ReceiveFn receive, SentFn sent, void *arg) override { return true; }
+    bool addPeer(const uint8_t mac[6], uint8_t channel) override { return true; }
+    bool send(const uint8_t mac[6], const uint8_t *data, size_t len) override { return true; }
+};
+
+// the seqs of the recorded frames, in send order
+static vector<uint32_t> sentSeqs(RecordRadio &radio)
+{
+    AesGcm gcm;
+    TEST_ASSERT_TRUE(gcm.setKey(key));
+
+    vector<uint32_t> seqs;
+    for (auto &f : radio.frames)
+    {
+        RawPacket raw;
+        memcpy(&raw, f.data(), f.size());
+        TEST_ASSERT_EQUAL(OPEN_OK, openRawPacketChecked(raw, 1, gcm));
+        seqs.push_back(readRawSeq(raw));
+    }
+    radio.frames.clear();
+    return seqs;
+}
+
+static void sendPockets(LHRP_Node_Secure &node, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+        TEST_ASSERT_TRUE(node.send({1, 1}, {(uint8_t)i}));
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_no_seq_reused_after_crash()
+{
+    map<string, uint32_t> disk; // what survives the power loss
+    uint32_t highest = 0;
+
+    for (int boot = 0; boot < 3; boot++)
+    {
+        RecordRadio radio;
+        LHRP_Node_Secure a(1, key, {{macA, {1}}, {macB, {1, 1}}});
+        a.store.committed = disk;
+        a.useRadio(radio);
+        TEST_ASSERT_TRUE(a.begin());
+        uint32_t commits = a.store.commits;
+
+        // across the lease begin() took: extended by getNextSendSeq() or the flush task
+        sendPockets(a, LHRP_SEQ_LEASE + LHRP_SEQ_LEASE / 2);
+        a.flush(); // waits for a running background flush, the store is read below
+        TEST_ASSERT_TRUE(a.store.commits > commits);
+
+        sendPockets(a, 10); // taken from the lease, never committed one by one
+        for (uint32_t seq : sentSeqs(radio))
+        {
+            TEST_ASSERT_TRUE(seq > highest);
+            highest = seq;
+        }
+
+        a.store.crash();
+        disk = a.store.committed; // the destructor's flush() no longer reaches `disk`
+    }
+}
+
+void test_later_seq_across_wrap()
+{
+    TEST_ASSERT_EQUAL_UINT32(2048, laterSeq(1024, 2048));
+    TEST_ASSERT_EQUAL_UINT32(2048, laterSeq(2048, 1024));
+    TEST_ASSERT_EQUAL_UINT32(0x100, laterSeq(0xFFFFFF00u, 0x100)); // lease wrapped past 0
+    TEST_ASSERT_EQUAL_UINT32(0x100, laterSeq(0x100, 0xFFFFFF00u));
+}
+
+// flush() runs while getNextSendSeq() commits new leases on its own:
+// the committed lease only ever grows and stays ahead of every sent seq
+void test_flush_keeps_the_later_lease()
+{
+    char sendKey[16];
+    macToNvsKey(sendKey, 's', macB.data());
+    uint32_t lease = 0;
+    bool shrunk = false; // outlive the node: its destructor flushes once more
+
+    NullRadio radio;
+    LHRP_Node_Secure a(1, key, {{macA, {1}}, {macB, {1, 1}}});
+    a.useRadio(radio);
+    a.store.onCommit = [&]()
+    {
+        uint32_t committed = a.store.get(sendKey, 0);
+        shrunk |= lease != 0 && laterSeq(lease, committed) != committed;
+        lease = committed;
+    };
+    TEST_ASSERT_TRUE(a.begin());
+
+    const uint32_t count = 20 * LHRP_SEQ_LEASE;
+    atomic<bool> done{false};
+    thread sender([&]()
+                  {
+        for (uint32_t i = 0; i < count; i++)
+            a.send({1, 1}, {1});
+        done = true; });
+
+    while (!done)
+        a.flush();
+    sender.join();
+    a.flush();
+
+    TEST_ASSERT_FALSE(shrunk);
+    TEST_ASSERT_TRUE(a.store.get(sendKey, 0) > count); // every seq sent is below the lease
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_no_seq_reused_after_crash);
+    RUN_TEST(test_later_seq_across_wrap);
+    RUN_TEST(test_flush_keeps_the_later_lease);
+    return UNITY_END();
+}
@@ -0,0 +1,160 @@
+// LHRP_CHECK_TOPOLOGY: each check rejects its misconfiguration, and
+// topologyNextHop() agrees with Node for every node and destination
+// (`pio test -e native`)
+
+#include <unity.h>
+
+#include "LHRP-secure/topology.hpp"
+
+using namespace std;
+
+constexpr auto good = makeTopology(
+    topologyNode({0x02, 0, 0, 0, 0, 1}, {1}, {1, 2}),
+    topologyNode({0x02, 0, 0, 0, 0, 2}, {1, 1}, {0, 3, 4}),
+    topologyNode({0x02, 0, 0, 0, 0, 3}, {1, 2}, {0, 5}),
+    topologyNode({0x02, 0, 0, 0, 0, 4}, {1, 1, 1}, {1}),
+    topologyNode({0x02, 0, 0, 0, 0, 5}, {1, 1, 2}, {1, 5}),
+    topologyNode({0x02, 0, 0, 0, 0, 6}, {1, 2, 1}, {2, 4}));
+LHRP_CHECK_TOPOLOGY(good);
+
+// one more address byte than MAX_ADDRESS_DEPTH
+constexpr auto tooDeep = makeTopology(
+    topologyNode({0x02, 0, 0, 0, 0, 1}, {1}, {1}),
+    topologyNode({0x02, 0, 0, 0, 0, 2}, {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}, {0}));
+
+constexpr auto oneWay = makeTopology(
+    topologyNode({0x02, 0, 0, 0, 0, 1}, {1}, {1}),
+    topologyNode({0x02, 0, 0, 0, 0, 2}, {1, 1}, {}));
+
+constexpr auto unknownNode = makeTopology(
+    topologyNode({0x02, 0, 0, 0, 0, 1}, {1}, {1}),
+    topologyNode({0x02, 0, 0, 0, 0, 2}, {1, 1}, {0, 2}));
+
+constexpr auto toItself = makeTopology(
+    topologyNode({0x02, 0, 0, 0, 0, 1}, {1}, {0, 1}),
+    topologyNode({0x02, 0, 0, 0, 0, 2}, {1, 1}, {0}));
+
+constexpr auto twice = makeTopology(
+    topologyNode({0x02, 0, 0, 0, 0, 1}, {1}, {1, 1}),
+    topologyNode({0x02, 0, 0, 0, 0, 2}, {1, 1}, {0, 0}));
+
+constexpr auto sameMac = makeTopology(
+    topologyNode({0x02, 0, 0, 0, 0, 1}, {1}, {1}),
+    topologyNode({0x02, 0, 0, 0, 0, 1}, {1, 1}, {0}));
+
+constexpr auto sameAddress = makeTopology(
+    topologyNode({0x02, 0, 0, 0, 0, 1}, {1, 1}, {1}),
+    topologyNode({0x02, 0, 0, 0, 0, 2}, {1, 1}, {0}));
+
+constexpr auto island = makeTopology(
+    topologyNode({0x02, 0, 0, 0, 0, 1}, {1}, {1}),
+    topologyNode({0x02, 0, 0, 0, 0, 2}, {1, 1}, {0}),
+    topologyNode({0x02, 0, 0, 0, 0, 3}, {1, 2}, {3}),
+    topologyNode({0x02, 0, 0, 0, 0, 4}, {1, 2, 1}, {2}));
+
+// {2} hangs below {1, 1}: {1} has no route towards it
+constexpr auto wrongBranch = makeTopology(
+    topologyNode({0x02, 0, 0, 0, 0, 1}, {1}, {1}),
+    topologyNode({0x02, 0, 0, 0, 0, 2}, {1, 1}, {0, 2}),
+    topologyNode({0x02, 0, 0, 0, 0, 3}, {2}, {1}));
+
+void setUp() {}
+void tearDown() {}
+
+void test_good_topology_passes_every_check()
+{
+    TEST_ASSERT_TRUE(topologyFits(good));
+    TEST_ASSERT_TRUE(topologyLinksValid(good));
+    TEST_ASSERT_TRUE(topologyUniqueMacs(good));
+    TEST_ASSERT_TRUE(topologyUniqueAddresses(good));
+    TEST_ASSERT_TRUE(topologyConnected(good));
+    TEST_ASSERT_TRUE(topologyLoopFree(good));
+    TEST_ASSERT_TRUE(topologyRoutable(good));
+}
+
+void test_address_too_deep()
+{
+    TEST_ASSERT_FALSE(topologyFits(tooDeep));
+    TEST_ASSERT_EQUAL_UINT8(MAX_ADDRESS_DEPTH, tooDeep.nodes[1].address.len);
+}
+
+void test_invalid_links()
+{
+    TEST_ASSERT_FALSE(topologyLinksValid(oneWay));
+    TEST_ASSERT_FALSE(topologyLinksValid(unknownNode));
+    TEST_ASSERT_FALSE(topologyLinksValid(toItself));
+    TEST_ASSERT_FALSE(topologyLinksValid(twice));
+
+    // the routing checks leave invalid links to topologyLinksValid()
+    TEST_ASSERT_TRUE(topologyLoopFree(unknownNode));
+    TEST_ASSERT_TRUE(topologyRoutable(unknownNode));
+}
+
+void test_duplicates()
+{
+    TEST_ASSERT_FALSE(topologyUniqueMacs(sameMac));
+    TEST_ASSERT_TRUE(topologyUniqueAddresses(sameMac));
+    TEST_ASSERT_FALSE(topologyUniqueAddresses(sameAddress));
+    TEST_ASSERT_TRUE(topologyUniqueMacs(sameAddress));
+}
+
+void test_unreachable_node()
+{
+    TEST_ASSERT_TRUE(topologyLinksValid(island));
+    TEST_ASSERT_FALSE(topologyConnected(island));
+}
+
+void test_pocket_ends_up_without_route()
+{
+    TEST_ASSERT_TRUE(topologyLinksValid(wrongBranch));
+    TEST_ASSERT_TRUE(topologyConnected(wrongBranch));
+    TEST_ASSERT_TRUE(topologyLoopFree(wrongBranch));
+    TEST_ASSERT_FALSE(topologyRoutable(wrongBranch));
+    TEST_ASSERT_FALSE(topologyRouteArrives(wrongBranch, 0, 2));
+}
+
+// the same pick as Node::route() and routeLinear() on the node built from the table
+template <size_t N>
+static void checkNextHopMatchesNode(const Topology<N> &t)
+{
+    for (size_t at = 0; at < N; at++)
+    {
+        Node node;
+        node.setYou(t.address(at));
+        for (size_t l = 0; l < t.nodes[at].linkCount; l++)
+            node.addConnection({t.address(t.nodes[at].links[l]), (uint8_t)(l + 1)});
+        node.compile();
+
+        for (size_t to = 0; to < N; to++)
+        {
+            Address dest = t.address(to);
+            uint8_t pin = node.routeLinear(dest);
+            int expected = pin == 0                ? LHRP_TOPOLOGY_LOCAL
+                           : pin == LHRP_PIN_ERROR ? LHRP_TOPOLOGY_NO_ROUTE
+                                                   : t.nodes[at].links[pin - 1];
+
+            TEST_ASSERT_EQUAL_INT(expected, topologyNextHop(t, at, t.nodes[to].address));
+            TEST_ASSERT_EQUAL_UINT8(pin, node.route(dest));
+        }
+    }
+}
+
+void test_next_hop_matches_node()
+{
+    checkNextHopMatchesNode(good);
+    checkNextHopMatchesNode(wrongBranch);
+    checkNextHopMatchesNode(island);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_good_topology_passes_every_check);
+    RUN_TEST(test_address_too_deep);
+    RUN_TEST(test_invalid_links);
+    RUN_TEST(test_duplicates);
+    RUN_TEST(test_unreachable_node);
+    RUN_TEST(test_pocket_ends_up_without_route);
+    RUN_TEST(test_next_hop_matches_node);
+    return UNITY_END();
+}
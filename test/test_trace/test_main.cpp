@@ -0,0 +1,212 @@
+// Per-hop tracing on a virtual clock: one record per node in path order, times
+// that add up to no more than the end-to-end time, and traced pockets that do
+// not fit are refused (`pio test -e native`)
+
+#include <unity.h>
+#include <deque>
+#include <memory>
+#include <atomic>
+
+#include "LHRP-secure/LHRP.hpp"
+
+using namespace std;
+
+#define STEP_US 3   // every clock read moves time on: crypto and queueing take time
+#define AIR_US 1000 // between two nodes, not part of any hop record
+
+static atomic<uint64_t> clockUs;
+static uint64_t steppingClock() { return clockUs.fetch_add(STEP_US); }
+
+static array<uint8_t, 6> nodeMac(uint8_t i)
+{
+    return {0x02, 0, 0, 0, 0, i};
+}
+
+// frames wait here until pump() hands them to the next node
+struct HandRadio : Radio
+{
+    struct Frame
+    {
+        array<uint8_t, 6> from, to;
+        vector<uint8_t> data;
+    };
+
+    ReceiveFn receiveFn = nullptr;
+    void *receiveArg = nullptr;
+    deque<Frame> *air = nullptr;
+    array<uint8_t, 6> mac;
+
+    bool begin(uint8_t channel, ReceiveFn receive, SentFn sent, void *arg) override
+    {
+        receiveFn = receive;
+        receiveArg = arg;
+        return true;
+    }
+
+    bool addPeer(const uint8_t mac[6], uint8_t channel) override { return true; }
+
+    bool send(const uint8_t mac[6], const uint8_t *data, size_t len) override
+    {
+        Frame f;
+        f.from = this->mac;
+        memcpy(f.to.data(), mac, 6);
+        f.data.assign(data, data + len);
+        air->push_back(f);
+        return true;
+    }
+};
+
+// node i has address {1, 1, ...} of depth i + 1 and links to i - 1 and i + 1
+struct Line
+{
+    array<uint8_t, 16> key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+    deque<HandRadio::Frame> air;
+    vector<Address> addresses;
+    vector<unique_ptr<HandRadio>> radios;
+    vector<unique_ptr<LHRP_Node_Secure>> nodes;
+
+    explicit Line(uint8_t count) : addresses(count)
+    {
+        for (uint8_t i = 0; i < count; i++)
+            addresses[i] = Address(i + 1, 1);
+
+        for (uint8_t i = 0; i < count; i++)
+        {
+            vector<LHRP_Peer> peers = {{nodeMac(i), addresses[i]}};
+            if (i > 0)
+                peers.push_back({nodeMac(i - 1), addresses[i - 1]});
+            if (i + 1 < count)
+                peers.push_back({nodeMac(i + 1), addresses[i + 1]});
+
+            radios.emplace_back(new HandRadio);
+            radios[i]->air = &air;
+            radios[i]->mac = nodeMac(i);
+            nodes.emplace_back(new LHRP_Node_Secure(1, key, peers));
+            nodes[i]->useRadio(*radios[i]);
+            TEST_ASSERT_TRUE(nodes[i]->begin());
+        }
+    }
+
+    // every frame on the air to its node, AIR_US after it was sent
+    void pump()
+    {
+        while (!air.empty())
+        {
+            HandRadio::Frame f = air.front();
+            air.pop_front();
+            clockUs += AIR_US;
+
+            HandRadio &to = *radios[f.to[5]];
+            to.receiveFn(to.receiveArg, f.from.data(), f.data.data(), f.data.size(), 0);
+        }
+    }
+};
+
+static Pocket traced(Line &line, uint8_t from, uint8_t to, size_t payload)
+{
+    Pocket p{};
+    p.destAddress = line.addresses[to];
+    p.srcAddress = line.addresses[from];
+    p.payload.resize(payload);
+    p.trace = true;
+    return p;
+}
+
+void setUp()
+{
+    clockUs = 1000000;
+    platformUseClock(steppingClock);
+}
+
+void tearDown()
+{
+    platformUseClock(nullptr);
+}
+
+void test_every_hop_adds_its_record()
+{
+    const uint8_t count = 5;
+    Line line(count);
+
+    vector<Pocket> received;
+    line.nodes[0]->onPocketReceive([&](const Pocket &p)
+                                   { received.push_back(p); });
+
+    uint64_t sentAt = clockUs;
+    TEST_ASSERT_TRUE(line.nodes[count - 1]->send(traced(line, count - 1, 0, 20)));
+    line.pump();
+    uint64_t elapsed = clockUs - sentAt;
+
+    TEST_ASSERT_EQUAL(1, received.size());
+    const Pocket &p = received[0];
+    TEST_ASSERT_TRUE(p.trace);
+    TEST_ASSERT_EQUAL(count, p.hopCount);
+    TEST_ASSERT_EQUAL(count, p.hops.size());
+
+    // source first, destination last; the air time is in no record
+    uint64_t recorded = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const TraceHop &h = p.hops[i];
+        TEST_ASSERT_EQUAL_UINT16(count - 1 - i, h.node);
+        TEST_ASSERT_TRUE(h.queuedUs > 0);
+        TEST_ASSERT_TRUE(h.queuedUs < AIR_US);
+        if (i > 0)
+            TEST_ASSERT_TRUE(h.cryptoUs > 0); // every node but the source opened the frame
+        recorded += h.queuedUs + h.cryptoUs;
+    }
+    TEST_ASSERT_TRUE(recorded + (count - 1) * AIR_US <= elapsed);
+}
+
+// records stop once the area is full, the hop count goes on
+void test_full_trace_area_keeps_counting_hops()
+{
+    const uint8_t count = LHRP_TRACE_MAX_HOPS + 2;
+    Line line(count);
+
+    vector<Pocket> received;
+    line.nodes[0]->onPocketReceive([&](const Pocket &p)
+                                   { received.push_back(p); });
+
+    TEST_ASSERT_TRUE(line.nodes[count - 1]->send(traced(line, count - 1, 0, 8)));
+    line.pump();
+
+    TEST_ASSERT_EQUAL(1, received.size());
+    TEST_ASSERT_EQUAL(count, received[0].hopCount);
+    TEST_ASSERT_EQUAL(LHRP_TRACE_MAX_HOPS, received[0].hops.size());
+    for (uint8_t i = 0; i < LHRP_TRACE_MAX_HOPS; i++)
+        TEST_ASSERT_EQUAL_UINT16(count - 1 - i, received[0].hops[i].node);
+}
+
+// the trace area takes payload room: too large is refused, not cut
+void test_traced_pocket_that_does_not_fit_is_refused()
+{
+    Line line(2);
+    LHRP_Node_Secure &source = *line.nodes[1];
+    Address dest = line.addresses[0];
+
+    int room = source.maxPayloadSize(dest, true);
+    TEST_ASSERT_TRUE(room < source.maxPayloadSize(dest));
+
+    TEST_ASSERT_FALSE(source.send(traced(line, 1, 0, room + 1)));
+    TEST_ASSERT_EQUAL(1, source.metrics().drops[LHRP_DROP_TRUNCATED].load());
+    TEST_ASSERT_TRUE(line.air.empty());
+
+    vector<Pocket> received;
+    line.nodes[0]->onPocketReceive([&](const Pocket &p)
+                                   { received.push_back(p); });
+    TEST_ASSERT_TRUE(source.send(traced(line, 1, 0, room)));
+    line.pump();
+    TEST_ASSERT_EQUAL(1, received.size());
+    TEST_ASSERT_EQUAL(room, received[0].payload.size());
+    TEST_ASSERT_EQUAL(2, received[0].hops.size());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_every_hop_adds_its_record);
+    RUN_TEST(test_full_trace_area_keeps_counting_hops);
+    RUN_TEST(test_traced_pocket_that_does_not_fit_is_refused);
+    return UNITY_END();
+}